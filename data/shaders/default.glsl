@@ -4,104 +4,158 @@ layout (location = 0) in vec3 position;
 layout (location = 1) in vec2 uv0;
 layout (location = 2) in vec4 color0;
 layout (location = 3) in vec3 normal0;
+layout (location = 4) in mat4 instance_xform;
 
 uniform mat4 projection;
 uniform mat4 view;
-uniform mat4 view_light;
 uniform mat4 xform;
+uniform bool instanced;
 
 out vec2 uv;
 out vec4 color;
 out vec3 normal;
 out vec3 frag_pos;
-out vec4 frag_pos_light_space;
+out float view_depth;
+out vec4 clip_pos;
+
+invariant gl_Position;
 
 void main() {
 	uv = uv0;
     color = color0;
-	normal = transpose(inverse(mat3(xform))) * normalize(normal0);
-	frag_pos = vec3(xform * vec4(position, 1.0));
-	frag_pos_light_space = view_light * vec4(frag_pos, 1.0);
+	mat4 model = instanced ? instance_xform : xform;
+	normal = transpose(inverse(mat3(model))) * normalize(normal0);
+	frag_pos = vec3(model * vec4(position, 1.0));
+	
+	vec4 view_pos = view * vec4(frag_pos, 1.0);
+	view_depth = -view_pos.z;
 	
-	gl_Position = projection * view * xform * vec4(position, 1.0);
+	clip_pos = projection * view_pos;
+	gl_Position = clip_pos;
 }
 
 #else
 
 uniform sampler2D texture0;
-uniform sampler2D shadow_map;
+uniform sampler2DArrayShadow shadow_map;
+uniform mat4 shadow_view_light[4];
+uniform vec4 shadow_splits;
+uniform int shadow_cascade_count;
+uniform vec3 shadow_light_dir;
+
+uniform samplerBuffer light_data;
+uniform usamplerBuffer light_grid;
+uniform usamplerBuffer light_indices;
+uniform int light_directional_count;
+uniform vec3 light_cluster_dims;
+uniform vec2 light_cluster_scale_bias;
+uniform vec3 light_ambient;
 
 in vec2 uv;
 in vec4 color;
 in vec3 normal;
 in vec3 frag_pos;
-in vec4 frag_pos_light_space;
+in float view_depth;
+in vec4 clip_pos;
 
 uniform vec3 view_pos;
 
-// light_pos = vec3(-1.0f, 2.0f, 5.0f)
-
-float calculate_shadow() {
-    // perform perspective divide
-    vec3 projCoords = frag_pos_light_space.xyz / frag_pos_light_space.w;
-    // transform to [0,1] range
-    projCoords = projCoords * 0.5 + 0.5;
-    // get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
-    float closestDepth = texture(shadow_map, projCoords.xy).r; 
-    // get depth of current fragment from light's perspective
-    float currentDepth = projCoords.z;
-    // calculate bias (based on depth map resolution and slope)
-    vec3 normal = normalize(normal);
-    vec3 lightDir = normalize(vec3(-1.0f, 2.0f, 5.0f) - frag_pos);
-    float bias = max(0.005 * (1.0 - dot(normal, lightDir)), 0.005);
-    // check whether current frag pos is in shadow
-    // float shadow = currentDepth - bias > closestDepth  ? 1.0 : 0.0;
-    // PCF
-    float shadow = 0.0;
-    vec2 texelSize = 1.0 / textureSize(shadow_map, 0);
-    for(int x = -1; x <= 1; ++x)
-    {
-        for(int y = -1; y <= 1; ++y)
-        {
-            float pcfDepth = texture(shadow_map, projCoords.xy + vec2(x, y) * texelSize).r; 
-            shadow += currentDepth - bias > pcfDepth  ? 1.0 : 0.0;        
-        }    
+float calculate_shadow(vec3 normal) {
+    // pick the cascade covering this fragment, nothing is shadowed past the last split
+    if (shadow_cascade_count == 0 || view_depth > shadow_splits[shadow_cascade_count - 1])
+        return 0.0;
+    
+    int cascade = shadow_cascade_count - 1;
+    for (int i = 0; i < shadow_cascade_count; ++i) {
+        if (view_depth < shadow_splits[i]) {
+            cascade = i;
+            break;
+        }
     }
-    shadow /= 9.0;
+    
+    vec4 light_space = shadow_view_light[cascade] * vec4(frag_pos, 1.0);
+    vec3 coords = light_space.xyz / light_space.w * 0.5 + 0.5;
     
     // keep the shadow at 0.0 when outside the far_plane region of the light's frustum.
-    if(projCoords.z > 1.0)
-        shadow = 0.0;
+    if (coords.z > 1.0)
+        return 0.0;
+    
+    // most of the bias comes from the polygon offset of the caster pass
+    float bias = max(0.001 * (1.0 - dot(normal, -shadow_light_dir)), 0.0002);
+    
+    // 4 taps, each one a hardware filtered 2x2 depth comparison
+    vec2 texel_size = 1.0 / vec2(textureSize(shadow_map, 0).xy);
+    float lit = 0.0;
+    for (int x = 0; x < 2; ++x) {
+        for (int y = 0; y < 2; ++y) {
+            vec2 offset = (vec2(x, y) - 0.5) * texel_size;
+            lit += texture(shadow_map, vec4(coords.xy + offset, float(cascade), coords.z - bias));
+        }
+    }
 	
-    return shadow;
+    return 1.0 - lit / 4.0;
+}
+
+// light_data texels: pos/range, color/type, dir/cos_outer, cos_inner
+vec3 shade_light(int index, vec3 normal, vec3 view_dir) {
+    vec4 t0 = texelFetch(light_data, index * 4 + 0);
+    vec4 t1 = texelFetch(light_data, index * 4 + 1);
+    vec4 t2 = texelFetch(light_data, index * 4 + 2);
+    
+    vec3 light_dir;
+    float attenuation = 1.0;
+    
+    if (t1.w == 2.0) {
+        // directional
+        light_dir = -t2.xyz;
+    } else {
+        vec3 to_light = t0.xyz - frag_pos;
+        float dist = length(to_light);
+        light_dir = to_light / dist;
+        
+        float falloff = clamp(1.0 - pow(dist / t0.w, 4.0), 0.0, 1.0);
+        attenuation = falloff * falloff / (dist * dist + 1.0);
+        
+        // spot cone
+        if (t1.w == 1.0) {
+            float cos_inner = texelFetch(light_data, index * 4 + 3).x;
+            attenuation *= smoothstep(t2.w, cos_inner, dot(-light_dir, t2.xyz));
+        }
+    }
+    
+    float diff = max(dot(light_dir, normal), 0.0);
+    vec3 halfway_dir = normalize(light_dir + view_dir);
+    float spec = pow(max(dot(normal, halfway_dir), 0.0), 64.0);
+    
+    return (diff + spec) * attenuation * t1.rgb;
 }
 
 void main() {
 	vec4 frag_color = texture(texture0, uv);
     vec3 normal = normalize(normal);
-    vec3 light_color = vec3(0.3);
-
-	// ambient
-    vec3 ambient = 0.3 * light_color;
-	
-    // diffuse
-    vec3 light_dir = normalize(vec3(-1.0f, 2.0f, 5.0f) - frag_pos);
-    float diff = max(dot(light_dir, normal), 0.0);
-    vec3 diffuse = diff * light_color;
+    vec3 view_dir = normalize(view_pos - frag_pos);
+    
+    // ambient
+    vec3 lighting = light_ambient;
     
-	// specular
-    vec3 viewDir = normalize(view_pos - frag_pos);
-    vec3 reflectDir = reflect(-light_dir, normal);
-    float spec = 0.0;
-    vec3 halfwayDir = normalize(light_dir + viewDir);  
-    spec = pow(max(dot(normal, halfwayDir), 0.0), 64.0);
-    vec3 specular = spec * light_color;    
+    // directional lights, the first one casts the cascaded shadow
+    for (int i = 0; i < light_directional_count; ++i) {
+        float shadow = (i == 0) ? calculate_shadow(normal) : 0.0;
+        lighting += (1.0 - shadow) * shade_light(i, normal, view_dir);
+    }
+    
+    // point and spot lights of this cluster
+    vec2 ndc = clip_pos.xy / clip_pos.w * 0.5 + 0.5;
+    ivec3 dims = ivec3(light_cluster_dims);
+    ivec3 cell = clamp(ivec3(ivec2(ndc * vec2(dims.xy)), int(log(view_depth) * light_cluster_scale_bias.x + light_cluster_scale_bias.y)), ivec3(0), dims - 1);
+    uvec2 cluster = texelFetch(light_grid, (cell.z * dims.y + cell.y) * dims.x + cell.x).xy;
     
-	// calculate shadow
-    float shadow = calculate_shadow();                      
-    vec3 lighting = (ambient + (1.0 - shadow) * (diffuse + specular)) * frag_color.rgb;    
+    for (uint i = 0u; i < cluster.y; ++i) {
+        int index = int(texelFetch(light_indices, int(cluster.x + i)).r);
+        lighting += shade_light(index, normal, view_dir);
+    }
 	
-	gl_FragColor = vec4(lighting, frag_color.w);
+	gl_FragColor = vec4(lighting * frag_color.rgb, frag_color.w);
 }
 
 #endif
\ No newline at end of file
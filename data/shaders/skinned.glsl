@@ -0,0 +1,55 @@
+#ifdef VERTEX_SHADER
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec2 uv0;
+layout (location = 2) in vec4 color0;
+layout (location = 3) in vec3 normal0;
+layout (location = 4) in uvec4 joints0;
+layout (location = 5) in vec4 weights0;
+
+uniform mat4 projection;
+uniform mat4 view;
+
+// bone matrices of every instance, four texels each, already in world space
+uniform samplerBuffer skin_palette;
+uniform int skin_bones;
+
+out vec2 uv;
+out vec4 color;
+out vec3 normal;
+
+mat4 skin_matrix(uint joint) {
+	int base = (gl_InstanceID * skin_bones + int(joint)) * 4;
+	return mat4(texelFetch(skin_palette, base), texelFetch(skin_palette, base + 1),
+				texelFetch(skin_palette, base + 2), texelFetch(skin_palette, base + 3));
+}
+
+void main() {
+	mat4 skin = skin_matrix(joints0.x) * weights0.x + skin_matrix(joints0.y) * weights0.y +
+				skin_matrix(joints0.z) * weights0.z + skin_matrix(joints0.w) * weights0.w;
+	
+	uv = uv0;
+	color = color0;
+	normal = mat3(skin) * normal0;
+	gl_Position = projection * view * skin * vec4(position, 1.0);
+}
+
+#else
+
+uniform sampler2D texture0;
+uniform vec3 light_dir;
+uniform vec3 light_ambient;
+
+in vec2 uv;
+in vec4 color;
+in vec3 normal;
+
+out vec4 frag_color;
+
+void main() {
+	vec4 albedo = texture(texture0, uv) * color;
+	float diff = max(dot(normalize(normal), -normalize(light_dir)), 0.0);
+	frag_color = vec4(albedo.rgb * (light_ambient + diff), albedo.a);
+}
+
+#endif
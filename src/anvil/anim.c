@@ -0,0 +1,438 @@
+#include "base.h"
+#include "core.h"
+#include "math.h"
+#include "job.h"
+#include "skin.h"
+#include "anim.h"
+#include <assimp/cimport.h>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ANIM_SIMD 1
+#endif
+
+//
+// animation clips
+//
+
+#define ANIM_ROTATION 0
+#define ANIM_POSITION 1
+#define ANIM_SCALE    2
+
+// smallest three components lie within +-1/sqrt(2)
+#define ANIM_SQRT1_2 0.70710678f
+
+typedef struct anim_job {
+	anim_sample_t *samples;
+	uint32_t joint_count;
+	joint_pose_t *poses;
+} anim_job_t;
+
+internal vec4_t _anim_channel(joint_pose_t *pose, uint32_t channel) {
+	switch (channel) {
+		case ANIM_ROTATION: return pose->rot;
+		case ANIM_POSITION: return (vec4_t){ pose->pos.x, pose->pos.y, pose->pos.z, 0.0f };
+		default:            return (vec4_t){ pose->scale.x, pose->scale.y, pose->scale.z, 0.0f };
+	}
+}
+
+internal void _anim_channel_set(joint_pose_t *pose, uint32_t channel, vec4_t value) {
+	switch (channel) {
+		case ANIM_ROTATION: pose->rot = value; break;
+		case ANIM_POSITION: pose->pos = (vec3_t){ value.x, value.y, value.z }; break;
+		default:            pose->scale = (vec3_t){ value.x, value.y, value.z }; break;
+	}
+}
+
+internal float32_t _anim_error(vec4_t a, vec4_t b, uint32_t channel) {
+	if (channel == ANIM_ROTATION) {
+		float32_t d = fabsf(dot4(a, b));
+		return 2.0f * acosf(MIN(d, 1.0f));
+	}
+	
+	return distance3((vec3_t){ a.x, a.y, a.z }, (vec3_t){ b.x, b.y, b.z });
+}
+
+// lerp, or normalized lerp along the shorter arc for rotations
+internal vec4_t _anim_mix(vec4_t a, vec4_t b, float32_t t, bool8_t rotation) {
+#if ANIM_SIMD
+	__m128 va = _mm_loadu_ps(&a.x), vb = _mm_loadu_ps(&b.x);
+	
+	if (rotation) {
+		__m128 d = _mm_mul_ps(va, vb);
+		d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+		d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+		vb = _mm_xor_ps(vb, _mm_and_ps(_mm_cmplt_ps(d, _mm_setzero_ps()), _mm_set1_ps(-0.0f)));
+	}
+	
+	__m128 v = _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), _mm_set1_ps(t)));
+	
+	if (rotation) {
+		__m128 l = _mm_mul_ps(v, v);
+		l = _mm_add_ps(l, _mm_shuffle_ps(l, l, _MM_SHUFFLE(2, 3, 0, 1)));
+		l = _mm_add_ps(l, _mm_shuffle_ps(l, l, _MM_SHUFFLE(1, 0, 3, 2)));
+		v = _mm_div_ps(v, _mm_sqrt_ps(l));
+	}
+	
+	vec4_t r;
+	_mm_storeu_ps(&r.x, v);
+	return r;
+#else
+	return rotation ? quat_nlerp(a, b, t) : lerp4(a, b, t);
+#endif
+}
+
+internal anim_key_t _anim_quantize(vec4_t v, anim_track_t *track, uint32_t channel, uint32_t frame) {
+	anim_key_t key = { (uint16_t)frame, 0, 0, 0 };
+	
+	if (channel == ANIM_ROTATION) {
+		float32_t q[4] = { v.x, v.y, v.z, v.w };
+		uint32_t largest = 0;
+		for (uint32_t i = 1; i < 4; ++i) {
+			if (fabsf(q[i]) > fabsf(q[largest])) {
+				largest = i;
+			}
+		}
+		
+		// the dropped component is rebuilt as positive, so flip the whole quaternion to match
+		float32_t sign = q[largest] < 0.0f ? -1.0f : 1.0f;
+		uint16_t packed[3];
+		for (uint32_t i = 0, j = 0; i < 4; ++i) {
+			if (i != largest) {
+				float32_t c = MIN(MAX(q[i] * sign / ANIM_SQRT1_2, -1.0f), 1.0f);
+				packed[j++] = (uint16_t)((c * 0.5f + 0.5f) * 32767.0f + 0.5f);
+			}
+		}
+		
+		key.x = packed[0] | (uint16_t)((largest & 1) << 15);
+		key.y = packed[1] | (uint16_t)((largest >> 1) << 15);
+		key.z = packed[2];
+		return key;
+	}
+	
+	float32_t *value = &v.x, *min = &track->min.x, *extent = &track->extent.x;
+	uint16_t *out = &key.x;
+	for (uint32_t i = 0; i < 3; ++i) {
+		float32_t n = extent[i] > 0.0f ? (value[i] - min[i]) / extent[i] : 0.0f;
+		out[i] = (uint16_t)(MIN(MAX(n, 0.0f), 1.0f) * 65535.0f + 0.5f);
+	}
+	
+	return key;
+}
+
+internal vec4_t _anim_dequantize(anim_key_t *key, anim_track_t *track, uint32_t channel) {
+	if (channel == ANIM_ROTATION) {
+		uint32_t largest = (key->x >> 15) | ((key->y >> 15) << 1);
+		float32_t c[3] = {
+			((key->x & 0x7fff) / 32767.0f * 2.0f - 1.0f) * ANIM_SQRT1_2,
+			((key->y & 0x7fff) / 32767.0f * 2.0f - 1.0f) * ANIM_SQRT1_2,
+			((key->z & 0x7fff) / 32767.0f * 2.0f - 1.0f) * ANIM_SQRT1_2
+		};
+		
+		float32_t q[4];
+		for (uint32_t i = 0, j = 0; i < 4; ++i) {
+			q[i] = (i == largest) ? sqrtf(MAX(1.0f - c[0] * c[0] - c[1] * c[1] - c[2] * c[2], 0.0f)) : c[j++];
+		}
+		
+		return (vec4_t){ q[0], q[1], q[2], q[3] };
+	}
+
+#if ANIM_SIMD
+	__m128 n = _mm_cvtepi32_ps(_mm_set_epi32(0, key->z, key->y, key->x));
+	__m128 v = _mm_add_ps(_mm_loadu_ps(&track->min.x), _mm_mul_ps(n, _mm_mul_ps(_mm_loadu_ps(&track->extent.x), _mm_set1_ps(1.0f / 65535.0f))));
+	vec4_t r;
+	_mm_storeu_ps(&r.x, v);
+	return r;
+#else
+	return (vec4_t) {
+		track->min.x + key->x / 65535.0f * track->extent.x,
+		track->min.y + key->y / 65535.0f * track->extent.y,
+		track->min.z + key->z / 65535.0f * track->extent.z,
+		0.0f
+	};
+#endif
+}
+
+// true when every frame between a and c is within error of the line between their stored keys
+internal bool8_t _anim_fits(joint_pose_t *frames, uint32_t joint_count, uint32_t joint, uint32_t channel, anim_track_t *track,
+							uint32_t a, uint32_t c, float32_t error) {
+	anim_key_t ka = _anim_quantize(_anim_channel(&frames[a * joint_count + joint], channel), track, channel, 0);
+	anim_key_t kc = _anim_quantize(_anim_channel(&frames[c * joint_count + joint], channel), track, channel, 0);
+	vec4_t va = _anim_dequantize(&ka, track, channel);
+	vec4_t vc = _anim_dequantize(&kc, track, channel);
+	
+	for (uint32_t f = a + 1; f < c; ++f) {
+		vec4_t v = _anim_mix(va, vc, (float32_t)(f - a) / (c - a), channel == ANIM_ROTATION);
+		if (_anim_error(v, _anim_channel(&frames[f * joint_count + joint], channel), channel) > error) {
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+anim_clip_t anim_clip_create(joint_pose_t *frames, uint32_t frame_count, uint32_t joint_count, anim_compress_params_t params) {
+	if (!frame_count || !joint_count || joint_count > SKIN_MAX_JOINTS) {
+		os_message(OS_MESSAGE_ERROR, "Animation clip needs frames and between 1 and %d joints", SKIN_MAX_JOINTS);
+		return ZERO_STRUCT(anim_clip_t);
+	}
+	
+	anim_clip_t clip = { 0 };
+	clip.sample_rate = params.sample_rate > 0.0f ? params.sample_rate : 30.0f;
+	clip.frame_count = frame_count;
+	clip.joint_count = joint_count;
+	clip.duration = (frame_count - 1) / clip.sample_rate;
+	clip.tracks = calloc(joint_count * 3, sizeof(anim_track_t));
+	
+	float32_t errors[3] = { params.rotation_error, params.position_error, params.scale_error };
+	
+	// constant tracks are stored once, the rest get a quantization range
+	for (uint32_t joint = 0; joint < joint_count; ++joint) {
+		for (uint32_t channel = 0; channel < 3; ++channel) {
+			anim_track_t *track = &clip.tracks[joint * 3 + channel];
+			vec4_t first = _anim_channel(&frames[joint], channel);
+			vec4_t min = first, max = first;
+			bool8_t constant = true;
+			
+			for (uint32_t f = 1; f < frame_count; ++f) {
+				vec4_t v = _anim_channel(&frames[f * joint_count + joint], channel);
+				constant = constant && _anim_error(first, v, channel) <= errors[channel];
+				min = (vec4_t){ MIN(min.x, v.x), MIN(min.y, v.y), MIN(min.z, v.z), 0.0f };
+				max = (vec4_t){ MAX(max.x, v.x), MAX(max.y, v.y), MAX(max.z, v.z), 0.0f };
+			}
+			
+			track->value = channel == ANIM_ROTATION ? normalize4(first) : first;
+			track->min = min;
+			track->extent = sub4(max, min);
+			track->animated = constant ? -1 : (int32_t)clip.animated_count++;
+		}
+	}
+	
+	clip.segment_count = frame_count > 1 ? (frame_count - 1 + ANIM_SEGMENT_FRAMES - 1) / ANIM_SEGMENT_FRAMES : 1;
+	clip.offsets = malloc(clip.segment_count * (clip.animated_count + 1) * sizeof(uint32_t));
+	
+	uint32_t key_capacity = 1024;
+	clip.keys = malloc(key_capacity * sizeof(anim_key_t));
+	
+	// every segment starts and ends on a key of its own, so sampling never leaves it
+	for (uint32_t segment = 0; segment < clip.segment_count; ++segment) {
+		uint32_t f0 = segment * ANIM_SEGMENT_FRAMES;
+		uint32_t f1 = MIN(f0 + ANIM_SEGMENT_FRAMES, frame_count - 1);
+		uint32_t *offsets = clip.offsets + segment * (clip.animated_count + 1);
+		
+		for (uint32_t t = 0; t < joint_count * 3; ++t) {
+			anim_track_t *track = &clip.tracks[t];
+			if (track->animated < 0) {
+				continue;
+			}
+			
+			uint32_t joint = t / 3, channel = t % 3;
+			offsets[track->animated] = clip.key_count;
+			
+			// greedy reduction, extend each span until a skipped frame drifts too far
+			uint32_t a = f0;
+			for (;;) {
+				if (clip.key_count + 1 > key_capacity) {
+					key_capacity *= 2;
+					clip.keys = realloc(clip.keys, key_capacity * sizeof(anim_key_t));
+				}
+				
+				vec4_t v = _anim_channel(&frames[a * joint_count + joint], channel);
+				clip.keys[clip.key_count++] = _anim_quantize(v, track, channel, a - f0);
+				
+				if (a >= f1) {
+					break;
+				}
+				
+				uint32_t b = a + 1;
+				while (b < f1 && _anim_fits(frames, joint_count, joint, channel, track, a, b + 1, errors[channel])) {
+					++b;
+				}
+				
+				a = b;
+			}
+		}
+		
+		offsets[clip.animated_count] = clip.key_count;
+	}
+	
+	clip.keys = realloc(clip.keys, MAX(clip.key_count, 1) * sizeof(anim_key_t));
+	return clip;
+}
+
+// linear between the assimp keys surrounding time, in ticks
+internal vec4_t _anim_ai_vector(struct aiVectorKey *keys, uint32_t count, float64_t time, vec4_t fallback) {
+	if (!count) {
+		return fallback;
+	}
+	
+	uint32_t i = 0;
+	while (i + 1 < count && keys[i + 1].mTime <= time) {
+		++i;
+	}
+	
+	struct aiVector3D a = keys[i].mValue, b = keys[MIN(i + 1, count - 1)].mValue;
+	float64_t span = keys[MIN(i + 1, count - 1)].mTime - keys[i].mTime;
+	float32_t t = span > 0.0 ? (float32_t)MIN(MAX((time - keys[i].mTime) / span, 0.0), 1.0) : 0.0f;
+	return lerp4((vec4_t){ a.x, a.y, a.z, 0.0f }, (vec4_t){ b.x, b.y, b.z, 0.0f }, t);
+}
+
+internal vec4_t _anim_ai_quat(struct aiQuatKey *keys, uint32_t count, float64_t time, vec4_t fallback) {
+	if (!count) {
+		return fallback;
+	}
+	
+	uint32_t i = 0;
+	while (i + 1 < count && keys[i + 1].mTime <= time) {
+		++i;
+	}
+	
+	struct aiQuaternion a = keys[i].mValue, b = keys[MIN(i + 1, count - 1)].mValue;
+	float64_t span = keys[MIN(i + 1, count - 1)].mTime - keys[i].mTime;
+	float32_t t = span > 0.0 ? (float32_t)MIN(MAX((time - keys[i].mTime) / span, 0.0), 1.0) : 0.0f;
+	return quat_nlerp((vec4_t){ a.x, a.y, a.z, a.w }, (vec4_t){ b.x, b.y, b.z, b.w }, t);
+}
+
+anim_clip_t anim_clip_load(string_t path, uint32_t index, skeleton_t *skeleton, anim_compress_params_t params) {
+	const struct aiScene *scene = aiImportFile(path, 0);
+	
+	if (!scene || index >= scene->mNumAnimations) {
+		os_message(OS_MESSAGE_ERROR, "Failed to load animation %u\nPath: %s", index, path);
+		if (scene) {
+			aiReleaseImport(scene);
+		}
+		return ZERO_STRUCT(anim_clip_t);
+	}
+	
+	struct aiAnimation *animation = scene->mAnimations[index];
+	float64_t ticks_per_second = animation->mTicksPerSecond > 0.0 ? animation->mTicksPerSecond : 25.0;
+	float64_t duration = animation->mDuration / ticks_per_second;
+	float32_t rate = params.sample_rate > 0.0f ? params.sample_rate : 30.0f;
+	uint32_t frame_count = (uint32_t)ceil(duration * rate) + 1;
+	uint32_t joint_count = skeleton->joint_count;
+	
+	// channel per joint, joints without one hold their bind pose
+	struct aiNodeAnim **channels = calloc(joint_count, sizeof(struct aiNodeAnim *));
+	for (uint32_t i = 0; i < animation->mNumChannels; ++i) {
+		int32_t joint = skeleton_find(skeleton, animation->mChannels[i]->mNodeName.data);
+		if (joint >= 0) {
+			channels[joint] = animation->mChannels[i];
+		}
+	}
+	
+	joint_pose_t *frames = malloc(frame_count * joint_count * sizeof(joint_pose_t));
+	for (uint32_t f = 0; f < frame_count; ++f) {
+		float64_t time = MIN(f / rate, duration) * ticks_per_second;
+		
+		for (uint32_t joint = 0; joint < joint_count; ++joint) {
+			joint_pose_t *pose = &frames[f * joint_count + joint];
+			struct aiNodeAnim *channel = channels[joint];
+			*pose = skeleton->joints[joint].bind;
+			
+			if (channel) {
+				_anim_channel_set(pose, ANIM_ROTATION, _anim_ai_quat(channel->mRotationKeys, channel->mNumRotationKeys, time, pose->rot));
+				_anim_channel_set(pose, ANIM_POSITION, _anim_ai_vector(channel->mPositionKeys, channel->mNumPositionKeys, time, _anim_channel(pose, ANIM_POSITION)));
+				_anim_channel_set(pose, ANIM_SCALE, _anim_ai_vector(channel->mScalingKeys, channel->mNumScalingKeys, time, _anim_channel(pose, ANIM_SCALE)));
+			}
+		}
+	}
+	
+	params.sample_rate = rate;
+	anim_clip_t clip = anim_clip_create(frames, frame_count, joint_count, params);
+	
+	free(frames);
+	free(channels);
+	aiReleaseImport(scene);
+	return clip;
+}
+
+void anim_clip_delete(anim_clip_t *clip) {
+	free(clip->tracks);
+	free(clip->offsets);
+	free(clip->keys);
+	ZERO_MEMORY(clip);
+}
+
+uint32_t anim_clip_size(anim_clip_t *clip) {
+	return sizeof(anim_clip_t) +
+		clip->joint_count * 3 * sizeof(anim_track_t) +
+		clip->segment_count * (clip->animated_count + 1) * sizeof(uint32_t) +
+		clip->key_count * sizeof(anim_key_t);
+}
+
+void anim_clip_sample(anim_clip_t *clip, float32_t time, joint_pose_t *pose) {
+	if (!clip->tracks) {
+		return;
+	}
+	
+	if (clip->duration > 0.0f) {
+		time = fmodf(time, clip->duration);
+		time = time < 0.0f ? time + clip->duration : time;
+	} else {
+		time = 0.0f;
+	}
+	
+	float32_t frame = MIN(time * clip->sample_rate, (float32_t)(clip->frame_count - 1));
+	uint32_t segment = MIN((uint32_t)frame / ANIM_SEGMENT_FRAMES, clip->segment_count - 1);
+	float32_t local = frame - (float32_t)(segment * ANIM_SEGMENT_FRAMES);
+	uint32_t *offsets = clip->offsets + segment * (clip->animated_count + 1);
+	
+	// tracks and their keys are visited in storage order
+	for (uint32_t t = 0; t < clip->joint_count * 3; ++t) {
+		anim_track_t *track = &clip->tracks[t];
+		uint32_t channel = t % 3;
+		vec4_t value = track->value;
+		
+		if (track->animated >= 0) {
+			uint32_t first = offsets[track->animated], end = offsets[track->animated + 1];
+			anim_key_t *keys = clip->keys;
+			
+			if (end - first == 1) {
+				value = _anim_dequantize(&keys[first], track, channel);
+			} else {
+				uint32_t i = first + 1;
+				while (i + 1 < end && keys[i].frame < local) {
+					++i;
+				}
+				
+				float32_t span = (float32_t)(keys[i].frame - keys[i - 1].frame);
+				float32_t f = MIN(MAX((local - keys[i - 1].frame) / span, 0.0f), 1.0f);
+				value = _anim_mix(_anim_dequantize(&keys[i - 1], track, channel), _anim_dequantize(&keys[i], track, channel), f, channel == ANIM_ROTATION);
+			}
+		}
+		
+		_anim_channel_set(&pose[t / 3], channel, value);
+	}
+}
+
+void anim_pose_blend(joint_pose_t *a, joint_pose_t *b, float32_t t, uint32_t count, joint_pose_t *out) {
+	for (uint32_t i = 0; i < count; ++i) {
+		for (uint32_t channel = 0; channel < 3; ++channel) {
+			vec4_t v = _anim_mix(_anim_channel(&a[i], channel), _anim_channel(&b[i], channel), t, channel == ANIM_ROTATION);
+			_anim_channel_set(&out[i], channel, v);
+		}
+	}
+}
+
+internal void _anim_sample_many(void *data, uint32_t start, uint32_t end) {
+	anim_job_t *job = data;
+	joint_pose_t blend[SKIN_MAX_JOINTS];
+	
+	for (uint32_t i = start; i < end; ++i) {
+		anim_sample_t *sample = &job->samples[i];
+		joint_pose_t *pose = job->poses + i * job->joint_count;
+		anim_clip_sample(sample->clip, sample->time, pose);
+		
+		if (sample->blend_clip && sample->blend > 0.0f) {
+			anim_clip_sample(sample->blend_clip, sample->blend_time, blend);
+			anim_pose_blend(pose, blend, sample->blend, job->joint_count, pose);
+		}
+	}
+}
+
+void anim_sample_many(anim_sample_t *samples, uint32_t count, uint32_t joint_count, joint_pose_t *poses) {
+	anim_job_t job = { samples, joint_count, poses };
+	job_parallel_for(count, 8, _anim_sample_many, &job);
+}
@@ -0,0 +1,67 @@
+#ifndef ANIM_H
+#define ANIM_H
+
+#include "base.h"
+#include "math.h"
+#include "skin.h"
+
+//
+// animation clips
+//
+
+// frames per segment, sampling reads the keys of one segment front to back
+#define ANIM_SEGMENT_FRAMES 16
+
+typedef struct anim_compress_params {
+	float32_t sample_rate;              // frames per second the channels are resampled at
+	float32_t position_error;           // largest error a dropped key may leave, world units
+	float32_t rotation_error;           // radians
+	float32_t scale_error;
+} anim_compress_params_t;
+
+// rotations are smallest three in 15 bits per component, positions and scales 16 bit in the
+// track range. frame is relative to the start of the segment
+typedef struct anim_key {
+	uint16_t frame, x, y, z;
+} anim_key_t;
+
+// every joint has a rotation, position and scale track in that order
+typedef struct anim_track {
+	vec4_t value;                       // constant tracks, never stored as keys
+	vec4_t min, extent;                 // dequantization range of position and scale keys
+	int32_t animated;                   // index among the animated tracks, -1 when constant
+} anim_track_t;
+
+typedef struct anim_clip {
+	float32_t duration, sample_rate;
+	uint32_t frame_count, joint_count;
+	uint32_t segment_count, animated_count, key_count;
+	anim_track_t *tracks;
+	uint32_t *offsets;                  // animated_count + 1 key offsets per segment
+	anim_key_t *keys;                   // segment major, then track, then frame
+} anim_clip_t;
+
+// one character's sample, blend_clip is optional and mixed in by blend
+typedef struct anim_sample {
+	anim_clip_t *clip, *blend_clip;
+	float32_t time, blend_time, blend;
+} anim_sample_t;
+
+// frames holds frame_count * joint_count local poses, packed per frame
+anim_clip_t anim_clip_create(joint_pose_t *frames, uint32_t frame_count, uint32_t joint_count, anim_compress_params_t params);
+
+// resamples the channels of animation index onto the skeleton's joints, unanimated joints keep the bind pose
+anim_clip_t anim_clip_load(string_t path, uint32_t index, skeleton_t *skeleton, anim_compress_params_t params);
+void anim_clip_delete(anim_clip_t *clip);
+
+// bytes held by the clip
+uint32_t anim_clip_size(anim_clip_t *clip);
+
+// time wraps around the duration, clamp it beforehand for clips that do not loop
+void anim_clip_sample(anim_clip_t *clip, float32_t time, joint_pose_t *pose);
+void anim_pose_blend(joint_pose_t *a, joint_pose_t *b, float32_t t, uint32_t count, joint_pose_t *out);
+
+// samples and blends every character across the job threads, poses are packed per character
+void anim_sample_many(anim_sample_t *samples, uint32_t count, uint32_t joint_count, joint_pose_t *poses);
+
+#endif // ANIM_H
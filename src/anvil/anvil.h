@@ -4,8 +4,27 @@
 #include "base.h"
 #include "math.h"
 #include "core.h"
+#include "job.h"
+#include "frame.h"
 #include "audio.h"
 #include "render.h"
+#include "command.h"
+#include "shadow.h"
+#include "light.h"
+#include "occlusion.h"
+#include "particle.h"
+#include "skin.h"
+#include "anim.h"
+#include "tilemap.h"
+#include "debug.h"
+#include "meshlet.h"
+#include "graph.h"
+#include "resolution.h"
+#include "post.h"
+#include "foliage.h"
+#include "impostor.h"
+#include "terrain.h"
+#include "portal.h"
 #include "ui.h"
 
 #endif // ANVIL_H
\ No newline at end of file
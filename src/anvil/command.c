@@ -0,0 +1,343 @@
+#include "base.h"
+#include "core.h"
+#include "math.h"
+#include "render.h"
+#include "command.h"
+
+//
+// command buffers
+//
+
+internal command_t *_command_push(command_buffer_t *buffer, command_type_e type) {
+	if (buffer->command_count == buffer->command_capacity) {
+		buffer->command_capacity = MAX(256, buffer->command_capacity * 2);
+		buffer->commands = realloc(buffer->commands, buffer->command_capacity * sizeof(command_t));
+	}
+	
+	// commands before the first key land in a group with key 0
+	if (!buffer->group_count) {
+		command_key(buffer, 0);
+	}
+	
+	command_t *command = &buffer->commands[buffer->command_count++];
+	command->type = type;
+	command->shader = buffer->shader;
+	command->name = NULL;
+	buffer->groups[buffer->group_count - 1].end = buffer->command_count;
+	return command;
+}
+
+internal int _command_group_compare(const void *a, const void *b) {
+	const command_group_t *ga = a, *gb = b;
+	if (ga->key != gb->key) {
+		return (ga->key < gb->key) ? -1 : 1;
+	}
+	
+	// keep recording order for equal keys
+	return (ga->start < gb->start) ? -1 : (ga->start > gb->start);
+}
+
+command_buffer_t command_buffer_create(uint32_t capacity, render_state_t state) {
+	command_buffer_t buffer = { 0 };
+	buffer.command_capacity = MAX(capacity, 1);
+	buffer.commands = malloc(buffer.command_capacity * sizeof(command_t));
+	buffer.group_capacity = 64;
+	buffer.groups = malloc(buffer.group_capacity * sizeof(command_group_t));
+	buffer.state = state;
+	return buffer;
+}
+
+void command_buffer_delete(command_buffer_t *buffer) {
+	free(buffer->commands);
+	free(buffer->groups);
+	ZERO_MEMORY(buffer);
+}
+
+void command_buffer_reset(command_buffer_t *buffer, render_state_t state) {
+	buffer->command_count = 0;
+	buffer->group_count = 0;
+	buffer->shader = 0;
+	buffer->state = state;
+}
+
+void command_buffer_end(command_buffer_t *buffer) {
+	if (buffer->group_count > 1) {
+		qsort(buffer->groups, buffer->group_count, sizeof(command_group_t), _command_group_compare);
+	}
+}
+
+void command_key(command_buffer_t *buffer, uint64_t key) {
+	// an empty group is simply rekeyed
+	if (buffer->group_count) {
+		command_group_t *last = &buffer->groups[buffer->group_count - 1];
+		if (last->start == last->end) {
+			last->key = key;
+			return;
+		}
+	}
+	
+	if (buffer->group_count == buffer->group_capacity) {
+		buffer->group_capacity = MAX(64, buffer->group_capacity * 2);
+		buffer->groups = realloc(buffer->groups, buffer->group_capacity * sizeof(command_group_t));
+	}
+	
+	buffer->groups[buffer->group_count++] = (command_group_t){ key, buffer->command_count, buffer->command_count, buffer->shader, buffer->state };
+}
+
+void command_state(command_buffer_t *buffer, render_state_t state) {
+	_command_push(buffer, COMMAND_STATE)->state = state;
+	buffer->state = state;
+}
+
+void command_shader(command_buffer_t *buffer, shader_t shader) {
+	buffer->shader = shader;
+	_command_push(buffer, COMMAND_SHADER);
+}
+
+void command_texture(command_buffer_t *buffer, texture_t *texture, uint32_t slot) {
+	command_t *command = _command_push(buffer, COMMAND_TEXTURE);
+	command->texture.id = texture->id;
+	command->texture.slot = slot;
+}
+
+void command_uniform_matrix(command_buffer_t *buffer, string_t name, matrix_t matrix) {
+	command_t *command = _command_push(buffer, COMMAND_UNIFORM_MATRIX);
+	command->name = name;
+	command->matrix = matrix;
+}
+
+void command_uniform_vec4(command_buffer_t *buffer, string_t name, vec4_t vec) {
+	command_t *command = _command_push(buffer, COMMAND_UNIFORM_VEC4);
+	command->name = name;
+	command->vec4 = vec;
+}
+
+void command_uniform_vec3(command_buffer_t *buffer, string_t name, vec3_t vec) {
+	command_t *command = _command_push(buffer, COMMAND_UNIFORM_VEC3);
+	command->name = name;
+	command->vec3 = vec;
+}
+
+void command_uniform_vec2(command_buffer_t *buffer, string_t name, vec2_t vec) {
+	command_t *command = _command_push(buffer, COMMAND_UNIFORM_VEC2);
+	command->name = name;
+	command->vec2 = vec;
+}
+
+void command_uniform_float(command_buffer_t *buffer, string_t name, float32_t value) {
+	command_t *command = _command_push(buffer, COMMAND_UNIFORM_FLOAT);
+	command->name = name;
+	command->f = value;
+}
+
+void command_uniform_int(command_buffer_t *buffer, string_t name, int32_t value) {
+	command_t *command = _command_push(buffer, COMMAND_UNIFORM_INT);
+	command->name = name;
+	command->i = value;
+}
+
+void command_draw(command_buffer_t *buffer, mesh_t *mesh) {
+	command_t *command = _command_push(buffer, COMMAND_DRAW);
+	command->draw.mesh = mesh;
+	command->draw.count = 1;
+}
+
+void command_draw_instanced(command_buffer_t *buffer, mesh_t *mesh, uint32_t count) {
+	command_t *command = _command_push(buffer, COMMAND_DRAW_INSTANCED);
+	command->draw.mesh = mesh;
+	command->draw.count = count;
+}
+
+
+//
+// replay
+//
+
+#define COMMAND_MAX_TEXTURE_SLOTS 32
+#define COMMAND_MAX_INSTANCES 256
+
+global struct {
+	shader_t shader;
+	render_state_t state;
+	uint32_t textures[COMMAND_MAX_TEXTURE_SLOTS];
+	
+	// an xform uniform is held back until it is known whether a draw of the batched mesh follows
+	bool8_t xform_pending;
+	matrix_t xform;
+	
+	// draws of one mesh with nothing but the xform changing in between
+	mesh_t *mesh;
+	uint32_t instance_count;
+	matrix_t instances[COMMAND_MAX_INSTANCES];
+} _replay;
+
+// runs the held back draws and uniform, before anything else changes the gl state they see
+internal void _command_flush() {
+	if (_replay.instance_count) {
+		mesh_draw_xforms(_replay.mesh, _replay.shader, _replay.instances, _replay.instance_count);
+		_replay.instance_count = 0;
+	}
+	
+	if (_replay.xform_pending) {
+		shader_uniform_matrix(_replay.shader, "xform", _replay.xform);
+		_replay.xform_pending = false;
+	}
+}
+
+internal void _command_bind_shader(shader_t shader) {
+	if (shader != _replay.shader) {
+		_command_flush();
+		shader_bind(shader);
+		_replay.shader = shader;
+	}
+}
+
+internal void _command_bind_state(render_state_t state) {
+	if (memcmp(&state, &_replay.state, sizeof(render_state_t))) {
+		_command_flush();
+		render_state_set(state);
+		_replay.state = state;
+	}
+}
+
+internal void _command_replay(command_t *command) {
+	switch (command->type) {
+		case COMMAND_STATE: {
+			_command_bind_state(command->state);
+		} break;
+		
+		case COMMAND_SHADER: {
+			_command_bind_shader(command->shader);
+		} break;
+		
+		case COMMAND_TEXTURE: {
+			uint32_t slot = command->texture.slot;
+			if (slot >= COMMAND_MAX_TEXTURE_SLOTS || _replay.textures[slot] != command->texture.id) {
+				_command_flush();
+				texture_t texture = { .id = command->texture.id };
+				texture_bind(&texture, slot);
+				
+				if (slot < COMMAND_MAX_TEXTURE_SLOTS) {
+					_replay.textures[slot] = command->texture.id;
+				}
+			}
+		} break;
+		
+		// uniforms are per program, the one they were recorded for has to be current
+		case COMMAND_UNIFORM_MATRIX: {
+			_command_bind_shader(command->shader);
+			if (!strcmp(command->name, "xform")) {
+				_replay.xform_pending = true;
+				_replay.xform = command->matrix;
+				break;
+			}
+			
+			_command_flush();
+			shader_uniform_matrix(command->shader, command->name, command->matrix);
+		} break;
+		
+		case COMMAND_UNIFORM_VEC4: {
+			_command_bind_shader(command->shader);
+			_command_flush();
+			shader_uniform_vec4(command->shader, command->name, command->vec4);
+		} break;
+		
+		case COMMAND_UNIFORM_VEC3: {
+			_command_bind_shader(command->shader);
+			_command_flush();
+			shader_uniform_vec3(command->shader, command->name, command->vec3);
+		} break;
+		
+		case COMMAND_UNIFORM_VEC2: {
+			_command_bind_shader(command->shader);
+			_command_flush();
+			shader_uniform_vec2(command->shader, command->name, command->vec2);
+		} break;
+		
+		case COMMAND_UNIFORM_FLOAT: {
+			_command_bind_shader(command->shader);
+			_command_flush();
+			shader_uniform_float(command->shader, command->name, command->f);
+		} break;
+		
+		case COMMAND_UNIFORM_INT: {
+			_command_bind_shader(command->shader);
+			_command_flush();
+			shader_uniform_int(command->shader, command->name, command->i);
+		} break;
+		
+		// a draw right after a new xform joins the batch, it becomes one instanced draw
+		case COMMAND_DRAW: {
+			_command_bind_shader(command->shader);
+			if (_replay.xform_pending) {
+				if (_replay.instance_count == COMMAND_MAX_INSTANCES || (_replay.instance_count && _replay.mesh != command->draw.mesh)) {
+					mesh_draw_xforms(_replay.mesh, _replay.shader, _replay.instances, _replay.instance_count);
+					_replay.instance_count = 0;
+				}
+				
+				_replay.mesh = command->draw.mesh;
+				_replay.instances[_replay.instance_count++] = _replay.xform;
+				_replay.xform_pending = false;
+				break;
+			}
+			
+			_command_flush();
+			mesh_draw(command->draw.mesh);
+		} break;
+		
+		case COMMAND_DRAW_INSTANCED: {
+			_command_bind_shader(command->shader);
+			_command_flush();
+			mesh_draw_instanced(command->draw.mesh, command->draw.count);
+		} break;
+	}
+}
+
+void command_submit(command_buffer_t *buffers, uint32_t count) {
+	uint32_t heads[COMMAND_MAX_BUFFERS];
+	count = MIN(count, COMMAND_MAX_BUFFERS);
+	
+	// unknown gl state, the first bind of everything goes through
+	_replay.state = render_state_get();
+	render_state_t old_state = _replay.state;
+	_replay.shader = (shader_t)-1;
+	_replay.xform_pending = false;
+	_replay.instance_count = 0;
+	memset(_replay.textures, 0xff, sizeof(_replay.textures));
+	
+	for (uint32_t i = 0; i < count; ++i) {
+		heads[i] = 0;
+	}
+	
+	// every buffer is already sorted, so merge by always taking the lowest head
+	for (;;) {
+		command_buffer_t *best = NULL;
+		uint32_t best_index = 0;
+		
+		for (uint32_t i = 0; i < count; ++i) {
+			if (heads[i] < buffers[i].group_count) {
+				if (!best || buffers[i].groups[heads[i]].key < best->groups[heads[best_index]].key) {
+					best = &buffers[i];
+					best_index = i;
+				}
+			}
+		}
+		
+		if (!best) {
+			break;
+		}
+		
+		command_group_t *group = &best->groups[heads[best_index]++];
+		if (group->shader) {
+			_command_bind_shader(group->shader);
+		}
+		_command_bind_state(group->state);
+		
+		for (uint32_t c = group->start; c < group->end; ++c) {
+			_command_replay(&best->commands[c]);
+		}
+	}
+	
+	_command_flush();
+	render_state_set(old_state);
+}
@@ -0,0 +1,97 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include "base.h"
+#include "math.h"
+#include "render.h"
+
+//
+// command buffers
+//
+
+#define COMMAND_MAX_BUFFERS 64
+
+typedef enum command_type {
+	COMMAND_STATE,
+	COMMAND_SHADER,
+	COMMAND_TEXTURE,
+	COMMAND_UNIFORM_MATRIX,
+	COMMAND_UNIFORM_VEC4,
+	COMMAND_UNIFORM_VEC3,
+	COMMAND_UNIFORM_VEC2,
+	COMMAND_UNIFORM_FLOAT,
+	COMMAND_UNIFORM_INT,
+	COMMAND_DRAW,
+	COMMAND_DRAW_INSTANCED
+} command_type_e;
+
+typedef struct command {
+	command_type_e type;
+	shader_t shader;        // shader the uniform was recorded for
+	string_t name;          // uniform name, has to outlive the submit
+	union {
+		render_state_t state;
+		struct { uint32_t id, slot; } texture;
+		struct { mesh_t *mesh; uint32_t count; } draw;
+		matrix_t matrix;
+		vec4_t vec4;
+		vec3_t vec3;
+		vec2_t vec2;
+		float32_t f;
+		int32_t i;
+	};
+} command_t;
+
+// run of commands sharing a sort key, replayed with the shader and state current when it was opened
+typedef struct command_group {
+	uint64_t key;
+	uint32_t start, end;
+	shader_t shader;
+	render_state_t state;
+} command_group_t;
+
+// owned by one thread while recording, nothing in here touches gl or the render state
+typedef struct command_buffer {
+	command_t *commands;
+	uint32_t command_count, command_capacity;
+	command_group_t *groups;
+	uint32_t group_count, group_capacity;
+	shader_t shader;
+	render_state_t state;
+} command_buffer_t;
+
+// state is what replay starts from, take it with render_state_get on the gl thread before
+// handing the buffer to a worker
+command_buffer_t command_buffer_create(uint32_t capacity, render_state_t state);
+void command_buffer_delete(command_buffer_t *buffer);
+
+// keeps the memory, call once per frame before recording
+void command_buffer_reset(command_buffer_t *buffer, render_state_t state);
+
+// sorts the groups by key, call on the recording thread once it is done
+void command_buffer_end(command_buffer_t *buffer);
+
+// opens a new group, lower keys are replayed first (pack shader, material and depth into it)
+void command_key(command_buffer_t *buffer, uint64_t key);
+
+void command_state(command_buffer_t *buffer, render_state_t state);
+void command_shader(command_buffer_t *buffer, shader_t shader);
+void command_texture(command_buffer_t *buffer, texture_t *texture, uint32_t slot);
+
+void command_uniform_matrix(command_buffer_t *buffer, string_t name, matrix_t matrix);
+void command_uniform_vec4(command_buffer_t *buffer, string_t name, vec4_t vec);
+void command_uniform_vec3(command_buffer_t *buffer, string_t name, vec3_t vec);
+void command_uniform_vec2(command_buffer_t *buffer, string_t name, vec2_t vec);
+void command_uniform_float(command_buffer_t *buffer, string_t name, float32_t value);
+void command_uniform_int(command_buffer_t *buffer, string_t name, int32_t value);
+
+// meshes are read at submit time and have to stay alive until then
+void command_draw(command_buffer_t *buffer, mesh_t *mesh);
+void command_draw_instanced(command_buffer_t *buffer, mesh_t *mesh, uint32_t count);
+
+// merges the sorted groups of up to COMMAND_MAX_BUFFERS buffers and replays them, gl thread only.
+// redundant shader, state and texture binds are skipped. draws of the same mesh with only an
+// "xform" matrix uniform between them are merged into one mesh_draw_xforms call
+void command_submit(command_buffer_t *buffers, uint32_t count);
+
+#endif // COMMAND_H
@@ -68,6 +68,27 @@ typedef enum os_message_icon {
 
 void os_message(os_message_icon_e icon, string_t format, ...);
 
+// threads
+typedef struct os_thread os_thread_o;
+typedef struct os_mutex os_mutex_o;
+typedef struct os_condition os_condition_o;
+typedef void (*os_thread_proc_t)(void *data);
+
+os_thread_o *os_thread_create(os_thread_proc_t proc, void *data);
+void os_thread_join(os_thread_o *thread);
+uint32_t os_thread_hardware_count();
+
+os_mutex_o *os_mutex_create();
+void os_mutex_delete(os_mutex_o *mutex);
+void os_mutex_lock(os_mutex_o *mutex);
+void os_mutex_unlock(os_mutex_o *mutex);
+
+os_condition_o *os_condition_create();
+void os_condition_delete(os_condition_o *condition);
+void os_condition_wait(os_condition_o *condition, os_mutex_o *mutex);
+void os_condition_signal(os_condition_o *condition);
+void os_condition_broadcast(os_condition_o *condition);
+
 // window
 typedef struct os_window os_window_o;
 
@@ -77,7 +98,8 @@ typedef enum os_window_flags {
 	OS_WINDOW_FULLSCREEN = BIT(1),
 	OS_WINDOW_RESIZABLE  = BIT(2),
 	OS_WINDOW_MINIMIZED  = BIT(3),
-	OS_WINDOW_MAXIMIZED  = BIT(4)
+	OS_WINDOW_MAXIMIZED  = BIT(4),
+	OS_WINDOW_HEADLESS   = BIT(5)  // offscreen context, no display server needed
 } os_window_flags_e;
 
 os_window_o *os_window_create(const string_t title, uint16_t width, uint16_t height, int32_t x, int32_t y, uint32_t flags);
@@ -85,6 +107,13 @@ void os_window_delete(os_window_o *window);
 void os_window_swap_buffers(os_window_o *window);
 void os_window_vsync(os_window_o *window, bool8_t enabled);
 
+// the gl context is current on one thread at a time, release it before another thread takes it
+void os_window_make_current(os_window_o *window, bool8_t current);
+
+// entry points beyond what glad loads for the 3.3 context, NULL or unusable when the driver
+// lacks them, so check the context version first
+void *os_gl_proc(string_t name);
+
 // event
 typedef struct os_event {
     bool8_t should_quit;
@@ -0,0 +1,283 @@
+#include "base.h"
+#include "core.h"
+#include "math.h"
+#include "render.h"
+#include "debug.h"
+#include <glad.h>
+
+//
+// debug draw
+//
+
+typedef struct debug_vertex {
+	vec3_t pos;
+	float32_t size;
+	uint32_t color;
+} debug_vertex_t;
+
+// lines and points, each with and without depth testing
+typedef struct debug_batch {
+	debug_vertex_t *vertices;
+	float32_t *lifetimes;               // one per primitive
+	uint32_t count, capacity;           // primitives
+} debug_batch_t;
+
+enum {
+	DEBUG_LINES,
+	DEBUG_LINES_OVERLAY,
+	DEBUG_POINTS,
+	DEBUG_POINTS_OVERLAY,
+	DEBUG_BATCH_COUNT
+};
+
+global struct {
+	shader_t shader;
+	uint32_t vao, vbo, vbo_capacity;
+	debug_batch_t batches[DEBUG_BATCH_COUNT];
+} _debug;
+
+const string_t _debug_source = "#ifdef VERTEX_SHADER\n\nlayout (location = 0) in vec3 position;\nlayout (location = 1) in float size;\nlayout (location = 2) in vec4 color;\n\nuniform mat4 view_projection;\n\nout vec4 vertex_color;\n\nvoid main() {\n	gl_Position = view_projection * vec4(position, 1.0);\n	gl_PointSize = size;\n	vertex_color = color;\n}\n\n#else\n\nin vec4 vertex_color;\n\nout vec4 frag_color;\n\nvoid main() {\n	frag_color = vertex_color;\n}\n\n#endif";
+
+internal uint32_t _debug_color(vec4_t color) {
+	uint32_t r = (uint32_t)(CLAMP(color.x, 0.0f, 1.0f) * 255.0f + 0.5f);
+	uint32_t g = (uint32_t)(CLAMP(color.y, 0.0f, 1.0f) * 255.0f + 0.5f);
+	uint32_t b = (uint32_t)(CLAMP(color.z, 0.0f, 1.0f) * 255.0f + 0.5f);
+	uint32_t a = (uint32_t)(CLAMP(color.w, 0.0f, 1.0f) * 255.0f + 0.5f);
+	return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+internal void _debug_push(uint32_t batch_index, debug_vertex_t *vertices, uint32_t per_primitive, float32_t lifetime) {
+	debug_batch_t *batch = &_debug.batches[batch_index];
+	
+	if (batch->count == batch->capacity) {
+		batch->capacity = MAX(batch->capacity * 2, 1024);
+		batch->vertices = realloc(batch->vertices, batch->capacity * per_primitive * sizeof(debug_vertex_t));
+		batch->lifetimes = realloc(batch->lifetimes, batch->capacity * sizeof(float32_t));
+	}
+	
+	memcpy(batch->vertices + batch->count * per_primitive, vertices, per_primitive * sizeof(debug_vertex_t));
+	batch->lifetimes[batch->count++] = lifetime;
+}
+
+void debug_line(vec3_t a, vec3_t b, vec4_t color, float32_t lifetime, bool8_t depth_test) {
+	uint32_t c = _debug_color(color);
+	debug_vertex_t line[2] = { { a, 1.0f, c }, { b, 1.0f, c } };
+	_debug_push(depth_test ? DEBUG_LINES : DEBUG_LINES_OVERLAY, line, 2, lifetime);
+}
+
+void debug_point(vec3_t p, float32_t size, vec4_t color, float32_t lifetime, bool8_t depth_test) {
+	debug_vertex_t point = { p, size, _debug_color(color) };
+	_debug_push(depth_test ? DEBUG_POINTS : DEBUG_POINTS_OVERLAY, &point, 1, lifetime);
+}
+
+void debug_cross(vec3_t p, float32_t size, vec4_t color, float32_t lifetime, bool8_t depth_test) {
+	float32_t h = size * 0.5f;
+	debug_line((vec3_t){ p.x - h, p.y, p.z }, (vec3_t){ p.x + h, p.y, p.z }, color, lifetime, depth_test);
+	debug_line((vec3_t){ p.x, p.y - h, p.z }, (vec3_t){ p.x, p.y + h, p.z }, color, lifetime, depth_test);
+	debug_line((vec3_t){ p.x, p.y, p.z - h }, (vec3_t){ p.x, p.y, p.z + h }, color, lifetime, depth_test);
+}
+
+void debug_circle(vec3_t center, vec3_t normal, float32_t radius, vec4_t color, float32_t lifetime, bool8_t depth_test) {
+	// any axis not parallel to the normal gives the circle's plane
+	vec3_t n = normalize3(normal);
+	vec3_t helper = fabsf(n.y) < 0.99f ? (vec3_t){ 0.0f, 1.0f, 0.0f } : (vec3_t){ 1.0f, 0.0f, 0.0f };
+	vec3_t u = normalize3(cross3(n, helper));
+	vec3_t v = cross3(n, u);
+	
+	vec3_t prev = add3(center, mul3(u, vec3_scalar(radius)));
+	for (uint32_t i = 1; i <= DEBUG_CIRCLE_SEGMENTS; ++i) {
+		float32_t angle = (float32_t)i / DEBUG_CIRCLE_SEGMENTS * 2.0f * (float32_t)PI;
+		vec3_t offset = add3(mul3(u, vec3_scalar(cosf(angle) * radius)), mul3(v, vec3_scalar(sinf(angle) * radius)));
+		vec3_t next = add3(center, offset);
+		debug_line(prev, next, color, lifetime, depth_test);
+		prev = next;
+	}
+}
+
+void debug_aabb(range3_t box, vec4_t color, float32_t lifetime, bool8_t depth_test) {
+	debug_obb(box, IDENTITY_MATRIX, color, lifetime, depth_test);
+}
+
+void debug_obb(range3_t box, matrix_t xform, vec4_t color, float32_t lifetime, bool8_t depth_test) {
+	vec3_t corners[8];
+	for (uint32_t i = 0; i < 8; ++i) {
+		vec4_t p = {
+			(i & 1) ? box.max.x : box.min.x,
+			(i & 2) ? box.max.y : box.min.y,
+			(i & 4) ? box.max.z : box.min.z,
+			1.0f
+		};
+		
+		p = matrix_transform(xform, p);
+		corners[i] = (vec3_t){ p.x, p.y, p.z };
+	}
+	
+	// corner bits are x, y, z so every edge flips exactly one of them
+	for (uint32_t i = 0; i < 8; ++i) {
+		for (uint32_t axis = 1; axis < 8; axis <<= 1) {
+			if (!(i & axis)) {
+				debug_line(corners[i], corners[i | axis], color, lifetime, depth_test);
+			}
+		}
+	}
+}
+
+void debug_sphere(vec3_t center, float32_t radius, vec4_t color, float32_t lifetime, bool8_t depth_test) {
+	debug_circle(center, (vec3_t){ 1.0f, 0.0f, 0.0f }, radius, color, lifetime, depth_test);
+	debug_circle(center, (vec3_t){ 0.0f, 1.0f, 0.0f }, radius, color, lifetime, depth_test);
+	debug_circle(center, (vec3_t){ 0.0f, 0.0f, 1.0f }, radius, color, lifetime, depth_test);
+}
+
+void debug_axes(matrix_t xform, float32_t size, float32_t lifetime, bool8_t depth_test) {
+	vec4_t o = matrix_transform(xform, (vec4_t){ 0.0f, 0.0f, 0.0f, 1.0f });
+	vec4_t x = matrix_transform(xform, (vec4_t){ size, 0.0f, 0.0f, 1.0f });
+	vec4_t y = matrix_transform(xform, (vec4_t){ 0.0f, size, 0.0f, 1.0f });
+	vec4_t z = matrix_transform(xform, (vec4_t){ 0.0f, 0.0f, size, 1.0f });
+	
+	vec3_t origin = { o.x, o.y, o.z };
+	debug_line(origin, (vec3_t){ x.x, x.y, x.z }, (vec4_t){ 1.0f, 0.0f, 0.0f, 1.0f }, lifetime, depth_test);
+	debug_line(origin, (vec3_t){ y.x, y.y, y.z }, (vec4_t){ 0.0f, 1.0f, 0.0f, 1.0f }, lifetime, depth_test);
+	debug_line(origin, (vec3_t){ z.x, z.y, z.z }, (vec4_t){ 0.0f, 0.0f, 1.0f, 1.0f }, lifetime, depth_test);
+}
+
+void debug_frustum(matrix_t view_projection, vec4_t color, float32_t lifetime, bool8_t depth_test) {
+	// the clip space cube taken back to world space is the frustum
+	matrix_t inverse = matrix_inverse(view_projection);
+	vec3_t corners[8];
+	
+	for (uint32_t i = 0; i < 8; ++i) {
+		vec4_t p = {
+			(i & 1) ? 1.0f : -1.0f,
+			(i & 2) ? 1.0f : -1.0f,
+			(i & 4) ? 1.0f : -1.0f,
+			1.0f
+		};
+		
+		p = matrix_transform(inverse, p);
+		corners[i] = (vec3_t){ p.x / p.w, p.y / p.w, p.z / p.w };
+	}
+	
+	for (uint32_t i = 0; i < 8; ++i) {
+		for (uint32_t axis = 1; axis < 8; axis <<= 1) {
+			if (!(i & axis)) {
+				debug_line(corners[i], corners[i | axis], color, lifetime, depth_test);
+			}
+		}
+	}
+}
+
+void debug_init() {
+	_debug.shader = shader_create(_debug_source);
+	
+	int32_t old_vao = 0, old_buffer = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &old_buffer);
+	
+	glGenVertexArrays(1, &_debug.vao);
+	glBindVertexArray(_debug.vao);
+	glGenBuffers(1, &_debug.vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, _debug.vbo);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(debug_vertex_t), (void *)offsetof(debug_vertex_t, pos));
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(debug_vertex_t), (void *)offsetof(debug_vertex_t, size));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(debug_vertex_t), (void *)offsetof(debug_vertex_t, color));
+	glEnableVertexAttribArray(2);
+	
+	glBindVertexArray(old_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, old_buffer);
+}
+
+void debug_close() {
+	shader_delete(_debug.shader);
+	glDeleteVertexArrays(1, &_debug.vao);
+	glDeleteBuffers(1, &_debug.vbo);
+	
+	for (uint32_t i = 0; i < DEBUG_BATCH_COUNT; ++i) {
+		free(_debug.batches[i].vertices);
+		free(_debug.batches[i].lifetimes);
+	}
+	
+	ZERO_MEMORY(&_debug);
+}
+
+void debug_flush(matrix_t view_projection, float32_t dt) {
+	uint32_t first[DEBUG_BATCH_COUNT], counts[DEBUG_BATCH_COUNT], total = 0;
+	
+	for (uint32_t i = 0; i < DEBUG_BATCH_COUNT; ++i) {
+		first[i] = total;
+		counts[i] = _debug.batches[i].count * (i < DEBUG_POINTS ? 2 : 1);
+		total += counts[i];
+	}
+	
+	if (!total) {
+		return;
+	}
+	
+	int32_t old_program = 0, old_vao = 0, old_buffer = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &old_program);
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &old_buffer);
+	
+	// every batch goes into one orphaned buffer, then each is a single draw
+	glBindVertexArray(_debug.vao);
+	glBindBuffer(GL_ARRAY_BUFFER, _debug.vbo);
+	_debug.vbo_capacity = MAX(_debug.vbo_capacity, total);
+	glBufferData(GL_ARRAY_BUFFER, _debug.vbo_capacity * sizeof(debug_vertex_t), NULL, GL_STREAM_DRAW);
+	
+	for (uint32_t i = 0; i < DEBUG_BATCH_COUNT; ++i) {
+		if (counts[i]) {
+			glBufferSubData(GL_ARRAY_BUFFER, first[i] * sizeof(debug_vertex_t), counts[i] * sizeof(debug_vertex_t), _debug.batches[i].vertices);
+		}
+	}
+	
+	render_state_t old_state = render_state_get();
+	shader_bind(_debug.shader);
+	shader_uniform_matrix(_debug.shader, "view_projection", view_projection);
+	glEnable(GL_PROGRAM_POINT_SIZE);
+	
+	for (uint32_t i = 0; i < DEBUG_BATCH_COUNT; ++i) {
+		if (!counts[i]) {
+			continue;
+		}
+		
+		bool8_t overlay = i == DEBUG_LINES_OVERLAY || i == DEBUG_POINTS_OVERLAY;
+		render_state_set((render_state_t){ .depth_testing = !overlay, .blending = true, .face_culling = false, .wireframe = false });
+		glDrawArrays(i < DEBUG_POINTS ? GL_LINES : GL_POINTS, first[i], counts[i]);
+		render_statistics_add((render_statistics_t){ .draw_calls = 1, .vertices = counts[i], .uploaded = counts[i] * sizeof(debug_vertex_t) });
+	}
+	
+	glDisable(GL_PROGRAM_POINT_SIZE);
+	render_state_set(old_state);
+	glBindVertexArray(old_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, old_buffer);
+	glUseProgram(old_program);
+	
+	// age and keep whatever still has time left, in push order
+	for (uint32_t i = 0; i < DEBUG_BATCH_COUNT; ++i) {
+		debug_batch_t *batch = &_debug.batches[i];
+		uint32_t per_primitive = i < DEBUG_POINTS ? 2 : 1;
+		uint32_t kept = 0;
+		
+		for (uint32_t j = 0; j < batch->count; ++j) {
+			float32_t lifetime = batch->lifetimes[j] - dt;
+			if (lifetime <= 0.0f) {
+				continue;
+			}
+			
+			if (kept != j) {
+				memcpy(batch->vertices + kept * per_primitive, batch->vertices + j * per_primitive, per_primitive * sizeof(debug_vertex_t));
+			}
+			
+			batch->lifetimes[kept++] = lifetime;
+		}
+		
+		batch->count = kept;
+	}
+}
+
+void debug_clear() {
+	for (uint32_t i = 0; i < DEBUG_BATCH_COUNT; ++i) {
+		_debug.batches[i].count = 0;
+	}
+}
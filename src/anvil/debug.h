@@ -0,0 +1,36 @@
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#include "base.h"
+#include "math.h"
+#include "render.h"
+
+//
+// debug draw
+//
+
+// segments used for each circle of debug_sphere and debug_circle
+#define DEBUG_CIRCLE_SEGMENTS 24
+
+// every call takes a lifetime in seconds, 0 draws it for the next flush only.
+// shapes without depth testing are drawn over the scene
+void debug_line(vec3_t a, vec3_t b, vec4_t color, float32_t lifetime, bool8_t depth_test);
+void debug_point(vec3_t p, float32_t size, vec4_t color, float32_t lifetime, bool8_t depth_test);
+void debug_cross(vec3_t p, float32_t size, vec4_t color, float32_t lifetime, bool8_t depth_test);
+void debug_circle(vec3_t center, vec3_t normal, float32_t radius, vec4_t color, float32_t lifetime, bool8_t depth_test);
+void debug_aabb(range3_t box, vec4_t color, float32_t lifetime, bool8_t depth_test);
+void debug_obb(range3_t box, matrix_t xform, vec4_t color, float32_t lifetime, bool8_t depth_test);
+void debug_sphere(vec3_t center, float32_t radius, vec4_t color, float32_t lifetime, bool8_t depth_test);
+void debug_axes(matrix_t xform, float32_t size, float32_t lifetime, bool8_t depth_test);
+
+// outlines the volume seen through view_projection, e.g. a culling camera
+void debug_frustum(matrix_t view_projection, vec4_t color, float32_t lifetime, bool8_t depth_test);
+
+void debug_init();
+void debug_close();
+
+// draws everything pushed so far in at most four calls, then ages the shapes by dt
+void debug_flush(matrix_t view_projection, float32_t dt);
+void debug_clear();
+
+#endif // DEBUG_H
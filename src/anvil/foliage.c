@@ -0,0 +1,323 @@
+#include "base.h"
+#include "core.h"
+#include "math.h"
+#include "render.h"
+#include "foliage.h"
+#include <glad.h>
+
+//
+// foliage
+//
+
+// glad only loads the 3.3 core profile, the rest is loaded by hand in foliage_init
+#define GL_SHADER_STORAGE_BUFFER            0x90D2
+#define GL_DRAW_INDIRECT_BUFFER             0x8F3F
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT  0x00000001
+#define GL_COMMAND_BARRIER_BIT              0x00000040
+#define GL_SHADER_STORAGE_BARRIER_BIT       0x00002000
+
+typedef void (GLAD_API_PTR *foliage_dispatch_f)(GLuint x, GLuint y, GLuint z);
+typedef void (GLAD_API_PTR *foliage_barrier_f)(GLbitfield barriers);
+typedef void (GLAD_API_PTR *foliage_draw_indirect_f)(GLenum mode, GLenum type, const void *indirect);
+
+enum {
+	FOLIAGE_FLAG,                       // visibility of every instance and the visible count of every group
+	FOLIAGE_SCAN,                       // group counts to group offsets, the total is the instance count to draw
+	FOLIAGE_COMPACT,                    // visible transforms to their offset, which keeps the instance order
+	FOLIAGE_SHADER_COUNT
+};
+
+global struct {
+	bool8_t supported;
+	shader_t shaders[FOLIAGE_SHADER_COUNT];
+	foliage_dispatch_f dispatch;
+	foliage_barrier_f barrier;
+	foliage_draw_indirect_f draw_indirect;
+} _foliage;
+
+const string_t _foliage_defines[FOLIAGE_SHADER_COUNT] = {
+	"#define FOLIAGE_FLAG 1\n",
+	"#define FOLIAGE_SCAN 1\n",
+	"#define FOLIAGE_COMPACT 1\n"
+};
+
+// precise keeps the compiler from fusing multiplies and adds, so the gpu rounds like the cpu path
+const string_t _foliage_source = "#ifdef FOLIAGE_SCAN\nlayout (local_size_x = 1) in;\n#else\nlayout (local_size_x = 64) in;\n#endif\n\nlayout (std430, binding = 0) readonly buffer instance_buffer { mat4 instances[]; };\nlayout (std430, binding = 1) writeonly buffer visible_buffer { mat4 visible[]; };\nlayout (std430, binding = 2) buffer flag_buffer { uint flags[]; };\nlayout (std430, binding = 3) buffer group_buffer { uint groups[]; };\nlayout (std430, binding = 4) buffer command_buffer { uint command[5]; };\n\nuniform int instance_count;\nuniform vec4 planes[6];\nuniform vec4 sphere;\nuniform vec3 camera_pos;\nuniform float max_distance;\n\nshared uint prefix[64];\n\n#ifdef FOLIAGE_FLAG\n\nbool visible_test(mat4 m) {\n	precise vec4 center = m[0] * sphere.x + m[1] * sphere.y + m[2] * sphere.z + m[3];\n	precise float scale = 0.0;\n	for (int i = 0; i < 3; ++i) {\n		precise float length_sq = m[i].x * m[i].x + m[i].y * m[i].y + m[i].z * m[i].z;\n		scale = max(scale, sqrt(length_sq));\n	}\n	\n	precise float radius = sphere.w * scale;\n	for (int p = 0; p < 6; ++p) {\n		precise float distance = planes[p].x * center.x + planes[p].y * center.y + planes[p].z * center.z + planes[p].w;\n		if (distance < -radius) {\n			return false;\n		}\n	}\n	\n	precise vec3 d = center.xyz - camera_pos;\n	precise float reach = max_distance + radius;\n	return max_distance <= 0.0 || d.x * d.x + d.y * d.y + d.z * d.z <= reach * reach;\n}\n\nvoid main() {\n	uint i = gl_GlobalInvocationID.x;\n	uint flag = (i < uint(instance_count) && visible_test(instances[i])) ? 1u : 0u;\n	if (i < uint(instance_count)) {\n		flags[i] = flag;\n	}\n	\n	if (gl_LocalInvocationIndex == 0u) {\n		prefix[0] = 0u;\n	}\n	barrier();\n	atomicAdd(prefix[0], flag);\n	barrier();\n	\n	if (gl_LocalInvocationIndex == 0u) {\n		groups[gl_WorkGroupID.x] = prefix[0];\n	}\n}\n\n#endif\n\n#ifdef FOLIAGE_SCAN\n\nvoid main() {\n	uint group_count = (uint(instance_count) + 63u) / 64u;\n	uint total = 0u;\n	for (uint g = 0u; g < group_count; ++g) {\n		uint count = groups[g];\n		groups[g] = total;\n		total += count;\n	}\n	\n	command[1] = total;\n}\n\n#endif\n\n#ifdef FOLIAGE_COMPACT\n\nvoid main() {\n	uint i = gl_GlobalInvocationID.x;\n	uint local = gl_LocalInvocationIndex;\n	uint flag = (i < uint(instance_count)) ? flags[i] : 0u;\n	\n	prefix[local] = flag;\n	barrier();\n	\n	for (uint offset = 1u; offset < 64u; offset <<= 1u) {\n		uint add = (local >= offset) ? prefix[local - offset] : 0u;\n		barrier();\n		prefix[local] += add;\n		barrier();\n	}\n	\n	if (flag != 0u) {\n		visible[groups[gl_WorkGroupID.x] + prefix[local] - 1u] = instances[i];\n	}\n}\n\n#endif";
+
+const string_t _foliage_planes[6] = { "planes[0]", "planes[1]", "planes[2]", "planes[3]", "planes[4]", "planes[5]" };
+
+void foliage_init() {
+	int32_t major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	
+	if (major > 4 || (major == 4 && minor >= 3)) {
+		_foliage.dispatch = (foliage_dispatch_f)os_gl_proc("glDispatchCompute");
+		_foliage.barrier = (foliage_barrier_f)os_gl_proc("glMemoryBarrier");
+		_foliage.draw_indirect = (foliage_draw_indirect_f)os_gl_proc("glDrawElementsIndirect");
+		_foliage.supported = _foliage.dispatch && _foliage.barrier && _foliage.draw_indirect;
+	}
+	
+	if (!_foliage.supported) {
+		return;
+	}
+	
+	uint64_t length = strlen(_foliage_source);
+	char *source = malloc(length + 64);
+	
+	for (uint32_t i = 0; i < FOLIAGE_SHADER_COUNT; ++i) {
+		snprintf(source, length + 64, "%s%s", _foliage_defines[i], _foliage_source);
+		_foliage.shaders[i] = shader_create_compute(source);
+	}
+	
+	free(source);
+}
+
+void foliage_close() {
+	for (uint32_t i = 0; i < FOLIAGE_SHADER_COUNT; ++i) {
+		if (_foliage.shaders[i]) {
+			shader_delete(_foliage.shaders[i]);
+		}
+	}
+	
+	ZERO_MEMORY(&_foliage);
+}
+
+bool8_t foliage_compute_supported() {
+	return _foliage.supported;
+}
+
+foliage_t foliage_create(mesh_t *mesh, matrix_t *xforms, uint32_t count) {
+	foliage_t foliage = { 0 };
+	foliage.count = count;
+	foliage.index_count = mesh->curr_index;
+	foliage.vertex_count = mesh->vertex_count;
+	foliage.mode = mesh->mode;
+	foliage.xforms = malloc(MAX(count, 1) * sizeof(matrix_t));
+	foliage.visible = malloc(MAX(count, 1) * sizeof(matrix_t));
+	memcpy(foliage.xforms, xforms, count * sizeof(matrix_t));
+	
+	range3_t bounds = mesh_bounds(mesh);
+	vec3_t extent = mul3(sub3(bounds.max, bounds.min), vec3_scalar(0.5f));
+	foliage.center = add3(bounds.min, extent);
+	foliage.radius = sqrtf(dot3(extent, extent));
+	
+	int32_t old_vao = 0, old_buffer = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &old_buffer);
+	
+	uint32_t group_count = (count + FOLIAGE_GROUP_SIZE - 1) / FOLIAGE_GROUP_SIZE;
+	uint32_t command[5] = { foliage.index_count, 0, 0, 0, 0 };
+	
+	glGenBuffers(1, &foliage.instance_buffer);
+	glGenBuffers(1, &foliage.visible_buffer);
+	glGenBuffers(1, &foliage.flag_buffer);
+	glGenBuffers(1, &foliage.group_buffer);
+	glGenBuffers(1, &foliage.command_buffer);
+	
+	// buffers are not bound to a target for good, the ssbo ones just go through array buffer
+	glBindBuffer(GL_ARRAY_BUFFER, foliage.instance_buffer);
+	glBufferData(GL_ARRAY_BUFFER, MAX(count, 1) * sizeof(matrix_t), xforms, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, foliage.flag_buffer);
+	glBufferData(GL_ARRAY_BUFFER, MAX(count, 1) * sizeof(uint32_t), NULL, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_ARRAY_BUFFER, foliage.group_buffer);
+	glBufferData(GL_ARRAY_BUFFER, MAX(group_count, 1) * sizeof(uint32_t), NULL, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_ARRAY_BUFFER, foliage.command_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(command), command, GL_DYNAMIC_COPY);
+	
+	glGenVertexArrays(1, &foliage.vao);
+	glGenBuffers(1, &foliage.vbo);
+	glGenBuffers(1, &foliage.ebo);
+	
+	glBindVertexArray(foliage.vao);
+	glBindBuffer(GL_ARRAY_BUFFER, foliage.vbo);
+	glBufferData(GL_ARRAY_BUFFER, mesh->curr_vertex * sizeof(vertex_t), mesh->vertices, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, pos));
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, uv));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, color));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, normal));
+	glEnableVertexAttribArray(3);
+	
+	// the compacted transforms are the instance_xform attribute
+	glBindBuffer(GL_ARRAY_BUFFER, foliage.visible_buffer);
+	glBufferData(GL_ARRAY_BUFFER, MAX(count, 1) * sizeof(matrix_t), NULL, GL_DYNAMIC_COPY);
+	for (uint32_t column = 0; column < 4; ++column) {
+		glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(matrix_t), (void *)(column * sizeof(vec4_t)));
+		glVertexAttribDivisor(4 + column, 1);
+		glEnableVertexAttribArray(4 + column);
+	}
+	
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, foliage.ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->curr_index * sizeof(uint32_t), mesh->indices, GL_STATIC_DRAW);
+	
+	glBindVertexArray(old_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, old_buffer);
+	return foliage;
+}
+
+void foliage_delete(foliage_t *foliage) {
+	uint32_t buffers[7] = { foliage->vbo, foliage->ebo, foliage->instance_buffer, foliage->visible_buffer, foliage->flag_buffer, foliage->group_buffer, foliage->command_buffer };
+	glDeleteBuffers(7, buffers);
+	glDeleteVertexArrays(1, &foliage->vao);
+	
+	free(foliage->xforms);
+	free(foliage->visible);
+	ZERO_MEMORY(foliage);
+}
+
+//
+// culling
+//
+
+// the same operations in the same order as visible_test in the compute source
+internal bool8_t _foliage_visible(foliage_t *foliage, matrix_t m, vec4_t planes[6], vec3_t camera_pos, float32_t max_distance) {
+	vec4_t center = matrix_transform(m, (vec4_t){ foliage->center.x, foliage->center.y, foliage->center.z, 1.0f });
+	
+	float32_t scale = 0.0f;
+	for (uint32_t i = 0; i < 3; ++i) {
+		float32_t length_sq = m.elements[i][0] * m.elements[i][0] + m.elements[i][1] * m.elements[i][1] + m.elements[i][2] * m.elements[i][2];
+		scale = MAX(scale, sqrtf(length_sq));
+	}
+	
+	float32_t radius = foliage->radius * scale;
+	for (uint32_t p = 0; p < 6; ++p) {
+		float32_t distance = planes[p].x * center.x + planes[p].y * center.y + planes[p].z * center.z + planes[p].w;
+		if (distance < -radius) {
+			return false;
+		}
+	}
+	
+	vec3_t d = { center.x - camera_pos.x, center.y - camera_pos.y, center.z - camera_pos.z };
+	float32_t reach = max_distance + radius;
+	return max_distance <= 0.0f || d.x * d.x + d.y * d.y + d.z * d.z <= reach * reach;
+}
+
+internal void _foliage_cull_cpu(foliage_t *foliage, vec4_t planes[6], vec3_t camera_pos, float32_t max_distance) {
+	foliage->visible_count = 0;
+	for (uint32_t i = 0; i < foliage->count; ++i) {
+		if (_foliage_visible(foliage, foliage->xforms[i], planes, camera_pos, max_distance)) {
+			foliage->visible[foliage->visible_count++] = foliage->xforms[i];
+		}
+	}
+	
+	int32_t old_buffer = 0;
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &old_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, foliage->visible_buffer);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, foliage->visible_count * sizeof(matrix_t), foliage->visible);
+	glBindBuffer(GL_ARRAY_BUFFER, old_buffer);
+}
+
+internal void _foliage_cull_gpu(foliage_t *foliage, vec4_t planes[6], vec3_t camera_pos, float32_t max_distance) {
+	int32_t old_program = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &old_program);
+	
+	uint32_t buffers[5] = { foliage->instance_buffer, foliage->visible_buffer, foliage->flag_buffer, foliage->group_buffer, foliage->command_buffer };
+	for (uint32_t i = 0; i < 5; ++i) {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, buffers[i]);
+	}
+	
+	shader_t flag = _foliage.shaders[FOLIAGE_FLAG];
+	shader_bind(flag);
+	shader_uniform_int(flag, "instance_count", (int32_t)foliage->count);
+	shader_uniform_vec4(flag, "sphere", (vec4_t){ foliage->center.x, foliage->center.y, foliage->center.z, foliage->radius });
+	shader_uniform_vec3(flag, "camera_pos", camera_pos);
+	shader_uniform_float(flag, "max_distance", max_distance);
+	for (uint32_t p = 0; p < 6; ++p) {
+		shader_uniform_vec4(flag, _foliage_planes[p], planes[p]);
+	}
+	
+	uint32_t group_count = (foliage->count + FOLIAGE_GROUP_SIZE - 1) / FOLIAGE_GROUP_SIZE;
+	_foliage.dispatch(group_count, 1, 1);
+	_foliage.barrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	
+	shader_bind(_foliage.shaders[FOLIAGE_SCAN]);
+	shader_uniform_int(_foliage.shaders[FOLIAGE_SCAN], "instance_count", (int32_t)foliage->count);
+	_foliage.dispatch(1, 1, 1);
+	_foliage.barrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	
+	shader_bind(_foliage.shaders[FOLIAGE_COMPACT]);
+	shader_uniform_int(_foliage.shaders[FOLIAGE_COMPACT], "instance_count", (int32_t)foliage->count);
+	_foliage.dispatch(group_count, 1, 1);
+	_foliage.barrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+	
+	glUseProgram(old_program);
+}
+
+void foliage_cull(foliage_t *foliage, matrix_t view_projection, vec3_t camera_pos, float32_t max_distance, foliage_cull_e mode) {
+	if (!foliage->count) {
+		foliage->visible_count = 0;
+		foliage->gpu = false;
+		return;
+	}
+	
+	vec4_t planes[6];
+	matrix_frustum(view_projection, planes);
+	
+	foliage->gpu = _foliage.supported && mode != FOLIAGE_CULL_CPU;
+	if (foliage->gpu) {
+		_foliage_cull_gpu(foliage, planes, camera_pos, max_distance);
+	} else {
+		_foliage_cull_cpu(foliage, planes, camera_pos, max_distance);
+	}
+}
+
+void foliage_draw(foliage_t *foliage, shader_t shader) {
+	if (!foliage->gpu && !foliage->visible_count) {
+		return;
+	}
+	
+	int32_t old_vao = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+	int32_t instanced = shader_instancing(shader).instanced;
+	
+	uint32_t mode = (uint32_t)foliage->mode;
+	if (!mode) {
+		mode = GL_TRIANGLES;
+	} else {
+		mode += GL_POINTS - 1;
+	}
+	
+	glUniform1i(instanced, 1);
+	glBindVertexArray(foliage->vao);
+	
+	// the gpu keeps its visible count, reading it back would wait for the cull
+	if (foliage->gpu) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, foliage->command_buffer);
+		_foliage.draw_indirect(mode, GL_UNSIGNED_INT, NULL);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	} else {
+		glDrawElementsInstanced(mode, foliage->index_count, GL_UNSIGNED_INT, NULL, foliage->visible_count);
+	}
+	
+	glBindVertexArray(old_vao);
+	glUniform1i(instanced, 0);
+	
+	uint32_t instances = foliage->gpu ? foliage->count : foliage->visible_count;
+	render_statistics_add((render_statistics_t){
+		.draw_calls = 1,
+		.vertices = foliage->vertex_count * instances,
+		.indices = foliage->index_count * instances,
+		.uploaded = foliage->gpu ? 0 : foliage->visible_count * sizeof(matrix_t)
+	});
+}
+
+uint32_t foliage_read(foliage_t *foliage, matrix_t *xforms) {
+	uint32_t count = foliage->visible_count;
+	int32_t old_buffer = 0;
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &old_buffer);
+	
+	if (foliage->gpu) {
+		uint32_t command[5];
+		glBindBuffer(GL_ARRAY_BUFFER, foliage->command_buffer);
+		glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(command), command);
+		count = command[1];
+	}
+	
+	glBindBuffer(GL_ARRAY_BUFFER, foliage->visible_buffer);
+	glGetBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(matrix_t), xforms);
+	glBindBuffer(GL_ARRAY_BUFFER, old_buffer);
+	return count;
+}
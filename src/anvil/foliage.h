@@ -0,0 +1,60 @@
+#ifndef FOLIAGE_H
+#define FOLIAGE_H
+
+#include "base.h"
+#include "math.h"
+#include "render.h"
+
+//
+// foliage
+//
+
+// instances are culled in groups of this many, the local size of the compute shaders
+#define FOLIAGE_GROUP_SIZE 64
+
+typedef enum foliage_cull {
+	FOLIAGE_CULL_AUTO,                  // compute shaders on a gl 4.3 context, the cpu otherwise
+	FOLIAGE_CULL_CPU,
+	FOLIAGE_CULL_GPU                    // falls back to the cpu when compute is not supported
+} foliage_cull_e;
+
+// one mesh drawn at many static transforms. both cull paths write the visible transforms,
+// in instance order, to the buffer feeding the instance_xform attribute
+typedef struct foliage {
+	uint32_t count, index_count, vertex_count;
+	render_mode_e mode;                 // of the mesh
+	matrix_t *xforms;
+	matrix_t *visible;                  // staging of the cpu path
+	vec3_t center;                      // bounding sphere of the mesh
+	float32_t radius;
+	
+	uint32_t visible_count;             // of the last cpu cull, a gpu cull leaves its count on the gpu
+	bool8_t gpu;                        // the last cull ran as compute
+	
+	uint32_t vao, vbo, ebo;
+	uint32_t instance_buffer, visible_buffer, flag_buffer, group_buffer, command_buffer;
+} foliage_t;
+
+void foliage_init();
+void foliage_close();
+bool8_t foliage_compute_supported();
+
+// the transforms are copied, the mesh is only read here
+foliage_t foliage_create(mesh_t *mesh, matrix_t *xforms, uint32_t count);
+void foliage_delete(foliage_t *foliage);
+
+// drops instances outside the frustum or further than max_distance from the camera, 0 keeps
+// every distance. the gpu path also writes the DrawElementsIndirect arguments, the cpu never
+// sees which instances survived
+void foliage_cull(foliage_t *foliage, matrix_t view_projection, vec3_t camera_pos, float32_t max_distance, foliage_cull_e mode);
+
+// shader is the bound one, it reads instance_xform and switches to it on the instanced uniform
+// like default.glsl. the render statistics count the visible instances, or every instance after
+// a gpu cull
+void foliage_draw(foliage_t *foliage, shader_t shader);
+
+// copies the visible transforms back and returns how many there are, waits for the gpu.
+// for tests and debugging
+uint32_t foliage_read(foliage_t *foliage, matrix_t *xforms);
+
+#endif // FOLIAGE_H
@@ -0,0 +1,145 @@
+#include "base.h"
+#include "core.h"
+#include "frame.h"
+
+//
+// render thread
+//
+
+#define FRAME_NONE UINT32_MAX
+
+global struct {
+	frame_desc_t desc;
+	os_thread_o *thread;
+	os_mutex_o *mutex;
+	os_condition_o *published, *consumed;
+	bool8_t quit;
+	
+	// two snapshots, the game thread writes one while the render thread reads the other
+	uint8_t *snapshots[2];
+	os_event_t events[2];
+	uint32_t write, pending, reading;
+	
+	os_event_t render_event;
+	frame_statistics_t statistics;
+} _frame;
+
+internal void _frame_thread(void *data) {
+	UNUSED(data);
+	
+	os_window_make_current(_frame.desc.window, true);
+	if (_frame.desc.init) {
+		_frame.desc.init(NULL, &_frame.render_event);
+	}
+	
+	os_mutex_lock(_frame.mutex);
+	for (;;) {
+		float64_t wait_start = os_time();
+		while (_frame.pending == FRAME_NONE && !_frame.quit) {
+			os_condition_wait(_frame.published, _frame.mutex);
+		}
+		_frame.statistics.render_wait += os_time() - wait_start;
+		
+		if (_frame.pending == FRAME_NONE) {
+			break;
+		}
+		
+		_frame.reading = _frame.pending;
+		_frame.pending = FRAME_NONE;
+		_frame.render_event = _frame.events[_frame.reading];
+		os_mutex_unlock(_frame.mutex);
+		
+		float64_t render_start = os_time();
+		_frame.desc.render(_frame.snapshots[_frame.reading], &_frame.render_event);
+		os_window_swap_buffers(_frame.desc.window);
+		float64_t render_time = os_time() - render_start;
+		
+		os_mutex_lock(_frame.mutex);
+		_frame.reading = FRAME_NONE;
+		_frame.statistics.render_time += render_time;
+		++_frame.statistics.frames;
+		os_condition_signal(_frame.consumed);
+	}
+	os_mutex_unlock(_frame.mutex);
+	
+	if (_frame.desc.close) {
+		_frame.desc.close(NULL, &_frame.render_event);
+	}
+	os_window_make_current(_frame.desc.window, false);
+}
+
+void frame_thread_init(frame_desc_t desc) {
+	if (!desc.render || !desc.window) {
+		os_message(OS_MESSAGE_ERROR, "Render thread needs a window and a render callback");
+		return;
+	}
+	
+	ZERO_MEMORY(&_frame);
+	_frame.desc = desc;
+	_frame.mutex = os_mutex_create();
+	_frame.published = os_condition_create();
+	_frame.consumed = os_condition_create();
+	_frame.pending = FRAME_NONE;
+	_frame.reading = FRAME_NONE;
+	
+	for (uint32_t i = 0; i < 2; ++i) {
+		_frame.snapshots[i] = calloc(1, MAX(desc.snapshot_size, 1));
+	}
+	
+	os_window_make_current(desc.window, false);
+	_frame.thread = os_thread_create(_frame_thread, NULL);
+}
+
+void frame_thread_close() {
+	if (!_frame.thread) {
+		return;
+	}
+	
+	os_mutex_lock(_frame.mutex);
+	_frame.quit = true;
+	os_condition_signal(_frame.published);
+	os_mutex_unlock(_frame.mutex);
+	
+	os_thread_join(_frame.thread);
+	os_window_make_current(_frame.desc.window, true);
+	
+	os_condition_delete(_frame.published);
+	os_condition_delete(_frame.consumed);
+	os_mutex_delete(_frame.mutex);
+	free(_frame.snapshots[0]);
+	free(_frame.snapshots[1]);
+	ZERO_MEMORY(&_frame);
+}
+
+void *frame_begin() {
+	float64_t wait_start = os_time();
+	
+	os_mutex_lock(_frame.mutex);
+	while (_frame.reading == _frame.write || _frame.pending == _frame.write) {
+		os_condition_wait(_frame.consumed, _frame.mutex);
+	}
+	os_mutex_unlock(_frame.mutex);
+	
+	_frame.statistics.game_wait += os_time() - wait_start;
+	return _frame.snapshots[_frame.write];
+}
+
+void frame_end(os_event_t *event) {
+	os_mutex_lock(_frame.mutex);
+	_frame.events[_frame.write] = *event;
+	_frame.pending = _frame.write;
+	_frame.write ^= 1;
+	os_condition_signal(_frame.published);
+	os_mutex_unlock(_frame.mutex);
+}
+
+frame_statistics_t frame_statistics_get() {
+	if (!_frame.mutex) {
+		return _frame.statistics;
+	}
+	
+	os_mutex_lock(_frame.mutex);
+	frame_statistics_t statistics = _frame.statistics;
+	os_mutex_unlock(_frame.mutex);
+	return statistics;
+}
@@ -0,0 +1,44 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "base.h"
+#include "core.h"
+
+//
+// render thread
+//
+
+// called on the render thread, snapshot is NULL for init and close.
+// event is the copy handed over with the snapshot, pass it to render_init
+typedef void (*frame_proc_t)(void *snapshot, os_event_t *event);
+
+typedef struct frame_desc {
+	os_window_o *window;
+	uint32_t snapshot_size;             // user snapshot struct, two of them are allocated
+	frame_proc_t init, render, close;
+} frame_desc_t;
+
+typedef struct frame_statistics {
+	uint32_t frames;
+	float64_t game_wait;                // time frame_begin blocked on the render thread
+	float64_t render_wait;              // time the render thread starved for a snapshot
+	float64_t render_time;              // render callback plus swap
+} frame_statistics_t;
+
+// moves the gl context of the window to a new render thread, which calls init and then
+// renders and swaps every published snapshot. os_event_pull stays on the calling thread
+void frame_thread_init(frame_desc_t desc);
+
+// renders the last published snapshot, calls close and gives the context back to the caller
+void frame_thread_close();
+
+// snapshot the game thread fills this frame, blocks while the render thread still reads it.
+// it holds whatever was written two frames ago, rebuild it completely
+void *frame_begin();
+
+// publishes the snapshot, it is immutable from here on
+void frame_end(os_event_t *event);
+
+frame_statistics_t frame_statistics_get();
+
+#endif // FRAME_H
@@ -0,0 +1,469 @@
+#include "base.h"
+#include "core.h"
+#include "math.h"
+#include "render.h"
+#include "graph.h"
+#include <glad.h>
+
+//
+// render graph
+//
+
+typedef struct graph_node_resource {
+	string_t name;
+	graph_texture_desc_t desc;
+	framebuffer_desc_t target;
+	int32_t width, height;
+	bool8_t external;
+	texture_t *imported;
+	int32_t first, last;                // execution order of the first and last pass using it
+	framebuffer_t *framebuffer;         // from the framebuffer pool, between the first and last use
+} graph_node_resource_t;
+
+typedef struct graph_node_pass {
+	string_t name;
+	graph_pass_flags_e flags;
+	graph_execute_f execute;
+	void *data;
+	graph_resource_t reads[GRAPH_MAX_USES], writes[GRAPH_MAX_USES];
+	bool8_t clears[GRAPH_MAX_USES];
+	uint32_t read_count, write_count;
+	uint64_t after;                     // passes that have to run first
+	uint64_t needs;                     // passes whose results this one uses
+	bool8_t alive;
+} graph_node_pass_t;
+
+global struct {
+	int32_t width, height;
+	
+	graph_node_pass_t passes[GRAPH_MAX_PASSES];
+	graph_node_resource_t resources[GRAPH_MAX_RESOURCES];
+	uint32_t pass_count, resource_count;
+	uint32_t order[GRAPH_MAX_PASSES], order_count;
+	
+	// passes writing several resources attach them to this one, its attachments change every pass
+	uint32_t framebuffer;
+	
+	graph_statistics_t stats;
+} _graph;
+
+void graph_init() {
+	ZERO_MEMORY(&_graph);
+}
+
+void graph_close() {
+	if (_graph.framebuffer) {
+		glDeleteFramebuffers(1, &_graph.framebuffer);
+	}
+	
+	ZERO_MEMORY(&_graph);
+}
+
+void graph_begin(int32_t width, int32_t height) {
+	_graph.width = width;
+	_graph.height = height;
+	_graph.pass_count = 0;
+	_graph.resource_count = 0;
+	_graph.order_count = 0;
+	
+	graph_import("backbuffer", NULL);
+}
+
+graph_resource_t graph_backbuffer() {
+	return 1;
+}
+
+internal graph_resource_t _graph_resource_push(string_t name) {
+	if (_graph.resource_count == GRAPH_MAX_RESOURCES) {
+		os_message(OS_MESSAGE_ERROR, "Render graph resource limit reached\nResource: %s", name);
+		return 0;
+	}
+	
+	graph_node_resource_t *resource = &_graph.resources[_graph.resource_count++];
+	*resource = ZERO_STRUCT(graph_node_resource_t);
+	resource->name = name;
+	resource->first = -1;
+	resource->last = -1;
+	return _graph.resource_count;
+}
+
+internal bool8_t _graph_depth_format(framebuffer_format_e format) {
+	return format == FRAMEBUFFER_FORMAT_DEPTH24 || format == FRAMEBUFFER_FORMAT_DEPTH24_STENCIL8 || format == FRAMEBUFFER_FORMAT_DEPTH32F;
+}
+
+graph_resource_t graph_create(string_t name, graph_texture_desc_t desc) {
+	graph_resource_t handle = _graph_resource_push(name);
+	if (!handle) {
+		return 0;
+	}
+	
+	graph_node_resource_t *resource = &_graph.resources[handle - 1];
+	float32_t scale = desc.scale > 0.0f ? desc.scale : 1.0f;
+	resource->desc = desc;
+	resource->width = desc.width ? desc.width : MAX((int32_t)(_graph.width * scale), 1);
+	resource->height = desc.height ? desc.height : MAX((int32_t)(_graph.height * scale), 1);
+	
+	framebuffer_format_e format = desc.format ? desc.format : FRAMEBUFFER_FORMAT_RGBA8;
+	resource->desc.format = format;
+	resource->target.width = resource->width;
+	resource->target.height = resource->height;
+	resource->target.params = (texture_params_t){ TEXTURE_FILTER_LINEAR, TEXTURE_FILTER_LINEAR, TEXTURE_WRAP_CLAMP_TO_EDGE, TEXTURE_WRAP_CLAMP_TO_EDGE, false };
+	if (_graph_depth_format(format)) {
+		resource->target.depth = format;
+	} else {
+		resource->target.colors[0] = format;
+	}
+	
+	return handle;
+}
+
+graph_resource_t graph_import(string_t name, texture_t *texture) {
+	graph_resource_t handle = _graph_resource_push(name);
+	if (!handle) {
+		return 0;
+	}
+	
+	graph_node_resource_t *resource = &_graph.resources[handle - 1];
+	resource->external = true;
+	resource->imported = texture;
+	if (texture) {
+		resource->width = texture->width;
+		resource->height = texture->height;
+	}
+	
+	return handle;
+}
+
+graph_pass_t graph_pass_add(string_t name, graph_pass_flags_e flags, graph_execute_f execute, void *data) {
+	if (_graph.pass_count == GRAPH_MAX_PASSES) {
+		os_message(OS_MESSAGE_ERROR, "Render graph pass limit reached\nPass: %s", name);
+		return 0;
+	}
+	
+	graph_node_pass_t *pass = &_graph.passes[_graph.pass_count++];
+	*pass = ZERO_STRUCT(graph_node_pass_t);
+	pass->name = name;
+	pass->flags = flags;
+	pass->execute = execute;
+	pass->data = data;
+	return _graph.pass_count;
+}
+
+void graph_pass_read(graph_pass_t pass, graph_resource_t resource) {
+	if (!pass || !resource) {
+		return;
+	}
+	
+	graph_node_pass_t *p = &_graph.passes[pass - 1];
+	if (p->read_count == GRAPH_MAX_USES) {
+		os_message(OS_MESSAGE_ERROR, "Render graph pass reads too many resources\nPass: %s", p->name);
+		return;
+	}
+	
+	p->reads[p->read_count++] = resource;
+}
+
+void graph_pass_write(graph_pass_t pass, graph_resource_t resource, bool8_t clear) {
+	if (!pass || !resource) {
+		return;
+	}
+	
+	graph_node_pass_t *p = &_graph.passes[pass - 1];
+	if (p->write_count == GRAPH_MAX_USES) {
+		os_message(OS_MESSAGE_ERROR, "Render graph pass writes too many resources\nPass: %s", p->name);
+		return;
+	}
+	
+	p->clears[p->write_count] = clear;
+	p->writes[p->write_count++] = resource;
+}
+
+texture_t graph_texture(graph_resource_t resource) {
+	if (!resource || resource > _graph.resource_count) {
+		return ZERO_STRUCT(texture_t);
+	}
+	
+	graph_node_resource_t *r = &_graph.resources[resource - 1];
+	if (r->imported) {
+		return *r->imported;
+	}
+	
+	return r->framebuffer ? r->framebuffer->texture : ZERO_STRUCT(texture_t);
+}
+
+graph_statistics_t graph_statistics_get() {
+	return _graph.stats;
+}
+
+//
+// compilation
+//
+
+internal bool8_t _graph_writes(graph_node_pass_t *pass, graph_resource_t resource) {
+	for (uint32_t i = 0; i < pass->write_count; ++i) {
+		if (pass->writes[i] == resource) {
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+// reads wait for every other writer, writers of one resource keep their declaration order.
+// a clearing write is ordered after earlier writers but does not need their results
+internal void _graph_dependencies() {
+	for (uint32_t i = 0; i < _graph.pass_count; ++i) {
+		graph_node_pass_t *pass = &_graph.passes[i];
+		
+		for (uint32_t j = 0; j < _graph.pass_count; ++j) {
+			graph_node_pass_t *other = &_graph.passes[j];
+			if (i == j) {
+				continue;
+			}
+			
+			for (uint32_t r = 0; r < pass->read_count; ++r) {
+				if (_graph_writes(other, pass->reads[r]) && (j < i || !_graph_writes(pass, pass->reads[r]))) {
+					pass->after |= 1ull << j;
+					pass->needs |= 1ull << j;
+				}
+			}
+			
+			for (uint32_t w = 0; w < pass->write_count && j < i; ++w) {
+				if (_graph_writes(other, pass->writes[w])) {
+					pass->after |= 1ull << j;
+					pass->needs |= pass->clears[w] ? 0 : 1ull << j;
+				}
+			}
+		}
+	}
+}
+
+// topological order, ties run in declaration order
+internal bool8_t _graph_sort() {
+	uint64_t placed = 0;
+	
+	while (_graph.order_count < _graph.pass_count) {
+		uint32_t next = UINT32_MAX;
+		for (uint32_t i = 0; i < _graph.pass_count; ++i) {
+			if (!(placed & (1ull << i)) && (_graph.passes[i].after & ~placed) == 0) {
+				next = i;
+				break;
+			}
+		}
+		
+		if (next == UINT32_MAX) {
+			return false;
+		}
+		
+		placed |= 1ull << next;
+		_graph.order[_graph.order_count++] = next;
+	}
+	
+	return true;
+}
+
+// walks back from the passes with visible results, everything they do not need is culled
+internal void _graph_cull() {
+	for (int32_t o = (int32_t)_graph.order_count - 1; o >= 0; --o) {
+		graph_node_pass_t *pass = &_graph.passes[_graph.order[o]];
+		
+		if (pass->flags & GRAPH_PASS_NEVER_CULL) {
+			pass->alive = true;
+		}
+		
+		for (uint32_t w = 0; w < pass->write_count && !pass->alive; ++w) {
+			pass->alive = _graph.resources[pass->writes[w] - 1].external;
+		}
+		
+		if (!pass->alive) {
+			continue;
+		}
+		
+		for (uint32_t j = 0; j < _graph.pass_count; ++j) {
+			if (pass->needs & (1ull << j)) {
+				_graph.passes[j].alive = true;
+			}
+		}
+	}
+}
+
+internal void _graph_lifetimes() {
+	for (uint32_t o = 0; o < _graph.order_count; ++o) {
+		graph_node_pass_t *pass = &_graph.passes[_graph.order[o]];
+		if (!pass->alive) {
+			continue;
+		}
+		
+		graph_resource_t uses[GRAPH_MAX_USES * 2];
+		uint32_t use_count = 0;
+		for (uint32_t i = 0; i < pass->read_count; ++i) {
+			uses[use_count++] = pass->reads[i];
+		}
+		for (uint32_t i = 0; i < pass->write_count; ++i) {
+			uses[use_count++] = pass->writes[i];
+		}
+		
+		for (uint32_t i = 0; i < use_count; ++i) {
+			graph_node_resource_t *resource = &_graph.resources[uses[i] - 1];
+			if (resource->first < 0) {
+				resource->first = (int32_t)o;
+			}
+			resource->last = (int32_t)o;
+		}
+	}
+}
+
+//
+// execution
+//
+
+internal bool8_t _graph_depth(graph_node_resource_t *resource) {
+	return !resource->external && _graph_depth_format(resource->desc.format);
+}
+
+// a single transient write binds its pooled framebuffer, anything else is attached to the shared one
+internal void _graph_pass_bind(graph_node_pass_t *pass) {
+	uint32_t colors[GRAPH_MAX_ATTACHMENTS] = { 0 };
+	uint32_t color_count = 0, depth = 0, depth_attachment = GL_DEPTH_ATTACHMENT;
+	framebuffer_t *single = NULL;
+	uint32_t attached = 0;
+	int32_t width = 0, height = 0;
+	bool8_t backbuffer = false;
+	
+	for (uint32_t i = 0; i < pass->write_count; ++i) {
+		graph_node_resource_t *resource = &_graph.resources[pass->writes[i] - 1];
+		texture_t texture = graph_texture(pass->writes[i]);
+		backbuffer |= pass->writes[i] == graph_backbuffer();
+		if (!texture.id) {
+			continue;
+		}
+		
+		if (_graph_depth(resource)) {
+			depth = texture.id;
+			depth_attachment = resource->desc.format == FRAMEBUFFER_FORMAT_DEPTH24_STENCIL8 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+		} else if (color_count < GRAPH_MAX_ATTACHMENTS) {
+			colors[color_count++] = texture.id;
+		}
+		
+		single = resource->framebuffer;
+		width = texture.width;
+		height = texture.height;
+		++attached;
+	}
+	
+	// the pass binds its own target when it has nothing to attach
+	if (backbuffer) {
+		framebuffer_unbind();
+	} else if (attached == 1 && single) {
+		framebuffer_bind(single);
+	} else if (width) {
+		if (!_graph.framebuffer) {
+			glGenFramebuffers(1, &_graph.framebuffer);
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, _graph.framebuffer);
+		
+		uint32_t draw_buffers[GRAPH_MAX_ATTACHMENTS];
+		for (uint32_t i = 0; i < GRAPH_MAX_ATTACHMENTS; ++i) {
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, colors[i], 0);
+			draw_buffers[i] = GL_COLOR_ATTACHMENT0 + i;
+		}
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, depth_attachment, GL_TEXTURE_2D, depth, 0);
+		
+		if (color_count) {
+			glDrawBuffers((int32_t)color_count, draw_buffers);
+		} else {
+			glDrawBuffer(GL_NONE);
+			glReadBuffer(GL_NONE);
+		}
+		
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			os_message(OS_MESSAGE_ERROR, "Render graph framebuffer is not complete\nPass: %s", pass->name);
+		}
+		
+		glViewport(0, 0, width, height);
+	} else {
+		return;
+	}
+	
+	uint32_t color = 0;
+	for (uint32_t i = 0; i < pass->write_count; ++i) {
+		graph_node_resource_t *resource = &_graph.resources[pass->writes[i] - 1];
+		bool8_t is_depth = _graph_depth(resource);
+		
+		if (pass->clears[i] && is_depth && resource->desc.format == FRAMEBUFFER_FORMAT_DEPTH24_STENCIL8) {
+			glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.0f, 0);
+		} else if (pass->clears[i] && is_depth) {
+			float32_t one = 1.0f;
+			glClearBufferfv(GL_DEPTH, 0, &one);
+		} else if (pass->clears[i]) {
+			glClearBufferfv(GL_COLOR, (int32_t)color, &resource->desc.clear.x);
+		}
+		
+		color += !is_depth && (graph_texture(pass->writes[i]).id || pass->writes[i] == graph_backbuffer());
+	}
+}
+
+void graph_execute() {
+	_graph.stats = ZERO_STRUCT(graph_statistics_t);
+	
+	_graph_dependencies();
+	if (!_graph_sort()) {
+		os_message(OS_MESSAGE_ERROR, "Render graph has a cycle, passes run in declaration order");
+		for (uint32_t i = 0; i < _graph.pass_count; ++i) {
+			_graph.order[i] = i;
+		}
+		_graph.order_count = _graph.pass_count;
+	}
+	
+	_graph_cull();
+	_graph_lifetimes();
+	
+	// transients are acquired at their first use and released after their last, so a later
+	// resource of the same desc gets the framebuffer back from the pool within the frame
+	framebuffer_t *backing[GRAPH_MAX_RESOURCES];
+	uint32_t backing_count = 0;
+	
+	for (uint32_t o = 0; o < _graph.order_count; ++o) {
+		graph_node_pass_t *pass = &_graph.passes[_graph.order[o]];
+		if (!pass->alive) {
+			++_graph.stats.culled;
+			continue;
+		}
+		
+		for (uint32_t r = 0; r < _graph.resource_count; ++r) {
+			graph_node_resource_t *resource = &_graph.resources[r];
+			if (resource->first != (int32_t)o || resource->external) {
+				continue;
+			}
+			
+			resource->framebuffer = framebuffer_pool_acquire(resource->target);
+			++_graph.stats.resources;
+			
+			bool8_t shared = !resource->framebuffer;
+			for (uint32_t i = 0; i < backing_count && !shared; ++i) {
+				shared = backing[i] == resource->framebuffer;
+			}
+			if (!shared) {
+				backing[backing_count++] = resource->framebuffer;
+			}
+		}
+		
+		_graph_pass_bind(pass);
+		if (pass->execute) {
+			pass->execute(pass->data);
+		}
+		++_graph.stats.passes;
+		
+		for (uint32_t r = 0; r < _graph.resource_count; ++r) {
+			graph_node_resource_t *resource = &_graph.resources[r];
+			if (resource->last == (int32_t)o && resource->framebuffer) {
+				framebuffer_pool_release(resource->framebuffer);
+			}
+		}
+	}
+	
+	framebuffer_unbind();
+	framebuffer_pool_trim();
+	_graph.stats.textures = backing_count;
+}
@@ -0,0 +1,71 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include "base.h"
+#include "math.h"
+#include "render.h"
+
+//
+// render graph
+//
+
+#define GRAPH_MAX_PASSES 64
+#define GRAPH_MAX_RESOURCES 64
+#define GRAPH_MAX_ATTACHMENTS 4             // color writes of a single pass
+#define GRAPH_MAX_USES 8                    // reads and writes of a single pass, each
+
+typedef enum graph_pass_flags {
+	GRAPH_PASS_NONE = 0,
+	GRAPH_PASS_NEVER_CULL = 1 << 0      // kept even when nothing reads its writes
+} graph_pass_flags_e;
+
+// width and height of 0 follow the backbuffer times scale, a scale of 0 is full size.
+// depth formats are attached as depth, FRAMEBUFFER_FORMAT_NONE picks RGBA8
+typedef struct graph_texture_desc {
+	int32_t width, height;
+	float32_t scale;
+	framebuffer_format_e format;
+	vec4_t clear;                       // color of clearing writes, depth always clears to 1
+} graph_texture_desc_t;
+
+typedef struct graph_statistics {
+	uint32_t passes, culled;
+	uint32_t resources, textures;       // transient resources and the pooled framebuffers backing them
+} graph_statistics_t;
+
+// handles are only valid until the next graph_begin, 0 is never a valid handle
+typedef uint32_t graph_resource_t;
+typedef uint32_t graph_pass_t;
+
+typedef void (*graph_execute_f)(void *data);
+
+void graph_init();
+void graph_close();
+
+// starts declaring a new frame, width and height are the backbuffer size
+void graph_begin(int32_t width, int32_t height);
+graph_resource_t graph_backbuffer();
+
+// transient textures come from the framebuffer pool and only live for the passes between their
+// first and last use, resources of the same size and format that do not overlap share one
+graph_resource_t graph_create(string_t name, graph_texture_desc_t desc);
+
+// external resources always count as used. without a texture the passes bind their own
+// target, and the resource only orders the passes writing and reading it
+graph_resource_t graph_import(string_t name, texture_t *texture);
+
+// passes may be added in any order, reads run after every other writer of the resource
+graph_pass_t graph_pass_add(string_t name, graph_pass_flags_e flags, graph_execute_f execute, void *data);
+void graph_pass_read(graph_pass_t pass, graph_resource_t resource);
+void graph_pass_write(graph_pass_t pass, graph_resource_t resource, bool8_t clear);
+
+// orders and culls the passes, then runs them with their writes bound as the framebuffer.
+// trims the framebuffer pool afterwards
+void graph_execute();
+
+// the texture of a resource, inside the execute callbacks
+texture_t graph_texture(graph_resource_t resource);
+
+graph_statistics_t graph_statistics_get();
+
+#endif // GRAPH_H
@@ -0,0 +1,237 @@
+#include "base.h"
+#include "core.h"
+#include "math.h"
+#include "render.h"
+#include "impostor.h"
+#include <glad.h>
+
+//
+// impostors
+//
+
+global struct {
+	shader_t bake_shader, draw_shader;
+} _impostor;
+
+// color and coverage to the first target, normal and depth in front of the center to the second
+const string_t _impostor_bake_source = "#ifdef VERTEX_SHADER\n\nlayout (location = 0) in vec3 position;\nlayout (location = 1) in vec2 uv0;\nlayout (location = 2) in vec4 color0;\nlayout (location = 3) in vec3 normal0;\n\nuniform mat4 view_projection;\n\nout vec2 uv;\nout vec4 color;\nout vec3 normal;\nout vec3 pos;\n\nvoid main() {\n	uv = uv0;\n	color = color0;\n	normal = normal0;\n	pos = position;\n	gl_Position = view_projection * vec4(position, 1.0);\n}\n\n#else\n\nin vec2 uv;\nin vec4 color;\nin vec3 normal;\nin vec3 pos;\n\nuniform sampler2D texture0;\nuniform vec4 sphere;\nuniform vec3 view_dir;\n\nlayout (location = 0) out vec4 frag_color;\nlayout (location = 1) out vec4 frag_normal;\n\nvoid main() {\n	vec4 c = color * texture(texture0, uv);\n	if (c.a < 0.5) {\n		discard;\n	}\n	\n	float depth = dot(pos - sphere.xyz, view_dir) / sphere.w;\n	frag_color = vec4(c.rgb, 1.0);\n	frag_normal = vec4(normalize(normal) * 0.5 + 0.5, depth * 0.5 + 0.5);\n}\n\n#endif";
+
+// quads turn around the up axis only, like the views were baked. the angle to the camera in
+// mesh space picks the two closest views
+const string_t _impostor_draw_source = "#ifdef VERTEX_SHADER\n\nlayout (location = 0) in vec2 corner;\nlayout (location = 4) in mat4 instance_xform;\n\nuniform mat4 view_projection;\nuniform vec3 camera_pos;\nuniform vec4 sphere;\nuniform int views;\nuniform vec2 grid;\n\nout vec2 uv_a;\nout vec2 uv_b;\nout vec3 world_pos;\nflat out float blend;\nflat out float radius;\nflat out vec3 forward;\nflat out mat3 rotation;\n\nvec2 tile_uv(int tile) {\n	vec2 origin = vec2(tile % int(grid.x), tile / int(grid.x));\n	return (origin + corner * 0.5 + 0.5) / grid;\n}\n\nvoid main() {\n	mat3 basis = mat3(instance_xform);\n	float scale = max(length(basis[0]), max(length(basis[1]), length(basis[2])));\n	vec3 center = (instance_xform * vec4(sphere.xyz, 1.0)).xyz;\n	radius = sphere.w * scale;\n	rotation = basis / scale;\n	\n	vec3 to_camera = camera_pos - center;\n	forward = normalize(vec3(to_camera.x, 0.0, to_camera.z) + vec3(0.0, 0.0, 0.00001));\n	vec3 right = normalize(cross(-forward, vec3(0.0, 1.0, 0.0)));\n	\n	vec3 local = transpose(rotation) * to_camera;\n	float view = mod(atan(local.z, local.x) / 6.28318531 * float(views), float(views));\n	int a = int(floor(view)) % views;\n	blend = fract(view);\n	uv_a = tile_uv(a);\n	uv_b = tile_uv((a + 1) % views);\n	\n	world_pos = center + right * corner.x * radius + vec3(0.0, corner.y * radius, 0.0);\n	gl_Position = view_projection * vec4(world_pos, 1.0);\n}\n\n#else\n\nin vec2 uv_a;\nin vec2 uv_b;\nin vec3 world_pos;\nflat in float blend;\nflat in float radius;\nflat in vec3 forward;\nflat in mat3 rotation;\n\nuniform sampler2D color_atlas;\nuniform sampler2D normal_atlas;\nuniform mat4 view_projection;\nuniform vec3 light_dir;\n\nout vec4 frag_color;\n\nvoid main() {\n	vec4 color = mix(texture(color_atlas, uv_a), texture(color_atlas, uv_b), blend);\n	if (color.a < 0.5) {\n		discard;\n	}\n	\n	vec4 normal_depth = mix(texture(normal_atlas, uv_a), texture(normal_atlas, uv_b), blend);\n	vec3 normal = normalize(rotation * (normal_depth.xyz * 2.0 - 1.0));\n	\n	// pushed toward the camera by the baked depth, so impostors intersect like the meshes\n	vec4 clip = view_projection * vec4(world_pos + forward * (normal_depth.w * 2.0 - 1.0) * radius, 1.0);\n	gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;\n	\n	float light = 0.35 + 0.65 * max(dot(normal, -normalize(light_dir)), 0.0);\n	frag_color = vec4(color.rgb / color.a * light, 1.0);\n}\n\n#endif";
+
+void impostor_init() {
+	_impostor.bake_shader = shader_create(_impostor_bake_source);
+	_impostor.draw_shader = shader_create(_impostor_draw_source);
+}
+
+void impostor_close() {
+	shader_delete(_impostor.bake_shader);
+	shader_delete(_impostor.draw_shader);
+	ZERO_MEMORY(&_impostor);
+}
+
+//
+// baking
+//
+
+internal void _impostor_bake(impostor_t *impostor, mesh_t *mesh, texture_t *texture) {
+	uint32_t vao, vbo, ebo;
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vbo);
+	glGenBuffers(1, &ebo);
+	
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, mesh->curr_vertex * sizeof(vertex_t), mesh->vertices, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, pos));
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, uv));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, color));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, normal));
+	glEnableVertexAttribArray(3);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->curr_index * sizeof(uint32_t), mesh->indices, GL_STATIC_DRAW);
+	
+	shader_t shader = _impostor.bake_shader;
+	shader_bind(shader);
+	texture_bind(texture, 0);
+	shader_uniform_texture(shader, "texture0", 0);
+	shader_uniform_vec4(shader, "sphere", (vec4_t){ impostor->center.x, impostor->center.y, impostor->center.z, impostor->radius });
+	
+	// orthographic views from outside the bounding sphere, each one fills its tile
+	float32_t r = impostor->radius;
+	uint32_t resolution = impostor->params.resolution;
+	matrix_t projection = matrix_projection_ortho(-r, r, -r, r, r, 3.0f * r);
+	
+	for (uint32_t v = 0; v < impostor->params.views; ++v) {
+		float32_t angle = 2.0f * PI * v / impostor->params.views;
+		vec3_t dir = { cosf(angle), 0.0f, sinf(angle) };
+		vec3_t eye = add3(impostor->center, mul3(dir, vec3_scalar(2.0f * r)));
+		
+		matrix_t rotation = xform_lookat(ZERO_STRUCT(vec3_t), (vec3_t){ -dir.x, -dir.y, -dir.z }, (vec3_t){ 0.0f, 1.0f, 0.0f });
+		matrix_t view = matrix_mul(xform_translate(IDENTITY_MATRIX, (vec3_t){ -eye.x, -eye.y, -eye.z }), rotation);
+		
+		glViewport((v % impostor->columns) * resolution, (v / impostor->columns) * resolution, resolution, resolution);
+		shader_uniform_matrix(shader, "view_projection", matrix_mul(view, projection));
+		shader_uniform_vec3(shader, "view_dir", dir);
+		glDrawElements(GL_TRIANGLES, mesh->curr_index, GL_UNSIGNED_INT, NULL);
+		render_statistics_add((render_statistics_t){ .draw_calls = 1, .vertices = mesh->curr_vertex, .indices = mesh->curr_index });
+	}
+	
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &vbo);
+	glDeleteBuffers(1, &ebo);
+}
+
+impostor_t impostor_create(mesh_t *mesh, texture_t *texture, impostor_params_t params) {
+	impostor_t impostor = { 0 };
+	params.views = params.views ? params.views : 8;
+	params.resolution = params.resolution ? params.resolution : 128;
+	impostor.params = params;
+	impostor.columns = (uint32_t)ceilf(sqrtf((float32_t)params.views));
+	impostor.rows = (params.views + impostor.columns - 1) / impostor.columns;
+	
+	range3_t bounds = mesh_bounds(mesh);
+	vec3_t extent = mul3(sub3(bounds.max, bounds.min), vec3_scalar(0.5f));
+	impostor.center = add3(bounds.min, extent);
+	impostor.radius = MAX(sqrtf(dot3(extent, extent)), 0.0001f);
+	
+	framebuffer_desc_t desc = { 0 };
+	desc.width = impostor.columns * params.resolution;
+	desc.height = impostor.rows * params.resolution;
+	desc.colors[0] = FRAMEBUFFER_FORMAT_RGBA8;
+	desc.colors[1] = FRAMEBUFFER_FORMAT_RGBA8;
+	desc.depth = FRAMEBUFFER_FORMAT_DEPTH24;
+	desc.renderbuffers = FRAMEBUFFER_RENDERBUFFER_DEPTH;
+	desc.params = (texture_params_t){ TEXTURE_FILTER_LINEAR, TEXTURE_FILTER_LINEAR, TEXTURE_WRAP_CLAMP_TO_EDGE, TEXTURE_WRAP_CLAMP_TO_EDGE, false };
+	impostor.atlas = framebuffer_create_desc(desc);
+	
+	int32_t old_program = 0, old_vao = 0, old_buffer = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &old_program);
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &old_buffer);
+	render_state_t old_state = render_state_get();
+	render_state_set((render_state_t){ .depth_testing = true, .blending = false, .face_culling = false, .wireframe = false });
+	
+	// empty texels hold no coverage and a zero normal at the center depth
+	framebuffer_bind(&impostor.atlas);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glClearBufferfv(GL_COLOR, 1, (float32_t[]){ 0.5f, 0.5f, 0.5f, 0.5f });
+	
+	uint32_t white = 0xFFFFFFFF;
+	texture_t blank = { 0 };
+	if (!texture) {
+		blank = texture_create((uint8_t *)&white, 1, 1, 4, ZERO_STRUCT(texture_params_t));
+		texture = &blank;
+	}
+	
+	_impostor_bake(&impostor, mesh, texture);
+	
+	if (blank.id) {
+		texture_delete(&blank);
+	}
+	
+	framebuffer_unbind();
+	glUseProgram(old_program);
+	glBindVertexArray(old_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, old_buffer);
+	render_state_set(old_state);
+	
+	// a quad of corners and the per instance transforms, which take locations 4 to 7
+	float32_t corners[8] = { -1.0f, -1.0f, 1.0f, -1.0f, 1.0f, 1.0f, -1.0f, 1.0f };
+	glGenVertexArrays(1, &impostor.vao);
+	glGenBuffers(1, &impostor.quad_vbo);
+	glGenBuffers(1, &impostor.instance_vbo);
+	
+	glBindVertexArray(impostor.vao);
+	glBindBuffer(GL_ARRAY_BUFFER, impostor.quad_vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float32_t), NULL);
+	glEnableVertexAttribArray(0);
+	
+	glBindBuffer(GL_ARRAY_BUFFER, impostor.instance_vbo);
+	for (uint32_t column = 0; column < 4; ++column) {
+		glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(matrix_t), (void *)(column * sizeof(vec4_t)));
+		glVertexAttribDivisor(4 + column, 1);
+		glEnableVertexAttribArray(4 + column);
+	}
+	
+	glBindVertexArray(old_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, old_buffer);
+	return impostor;
+}
+
+void impostor_delete(impostor_t *impostor) {
+	framebuffer_delete(&impostor->atlas);
+	glDeleteVertexArrays(1, &impostor->vao);
+	glDeleteBuffers(1, &impostor->quad_vbo);
+	glDeleteBuffers(1, &impostor->instance_vbo);
+	ZERO_MEMORY(impostor);
+}
+
+//
+// drawing
+//
+
+uint32_t impostor_partition(impostor_t *impostor, matrix_t *xforms, uint32_t count, vec3_t camera_pos) {
+	float32_t distance_sq = impostor->params.distance * impostor->params.distance;
+	uint32_t near = 0;
+	
+	for (uint32_t i = 0; i < count; ++i) {
+		vec3_t d = { xforms[i].elements[3][0] - camera_pos.x, xforms[i].elements[3][1] - camera_pos.y, xforms[i].elements[3][2] - camera_pos.z };
+		if (dot3(d, d) < distance_sq) {
+			matrix_t swap = xforms[near];
+			xforms[near++] = xforms[i];
+			xforms[i] = swap;
+		}
+	}
+	
+	return near;
+}
+
+void impostor_draw(impostor_t *impostor, matrix_t *xforms, uint32_t count, matrix_t view_projection, vec3_t camera_pos, vec3_t light_dir) {
+	if (!count) {
+		return;
+	}
+	
+	int32_t old_program = 0, old_vao = 0, old_buffer = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &old_program);
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &old_buffer);
+	
+	glBindBuffer(GL_ARRAY_BUFFER, impostor->instance_vbo);
+	if (count > impostor->instance_capacity) {
+		impostor->instance_capacity = MAX(count, impostor->instance_capacity * 2);
+		glBufferData(GL_ARRAY_BUFFER, impostor->instance_capacity * sizeof(matrix_t), NULL, GL_DYNAMIC_DRAW);
+	}
+	glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(matrix_t), xforms);
+	
+	render_state_t old_state = render_state_get();
+	render_state_set((render_state_t){ .depth_testing = true, .blending = false, .face_culling = false, .wireframe = false });
+	
+	shader_t shader = _impostor.draw_shader;
+	shader_bind(shader);
+	texture_bind(&impostor->atlas.colors[0], 0);
+	texture_bind(&impostor->atlas.colors[1], 1);
+	shader_uniform_texture(shader, "color_atlas", 0);
+	shader_uniform_texture(shader, "normal_atlas", 1);
+	shader_uniform_matrix(shader, "view_projection", view_projection);
+	shader_uniform_vec3(shader, "camera_pos", camera_pos);
+	shader_uniform_vec3(shader, "light_dir", light_dir);
+	shader_uniform_vec4(shader, "sphere", (vec4_t){ impostor->center.x, impostor->center.y, impostor->center.z, impostor->radius });
+	shader_uniform_int(shader, "views", (int32_t)impostor->params.views);
+	shader_uniform_vec2(shader, "grid", (vec2_t){ (float32_t)impostor->columns, (float32_t)impostor->rows });
+	
+	glBindVertexArray(impostor->vao);
+	glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, count);
+	render_statistics_add((render_statistics_t){ .draw_calls = 1, .vertices = 4 * count, .uploaded = count * sizeof(matrix_t) });
+	
+	glBindVertexArray(old_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, old_buffer);
+	glUseProgram(old_program);
+	render_state_set(old_state);
+}
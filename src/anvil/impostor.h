@@ -0,0 +1,47 @@
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+#include "base.h"
+#include "math.h"
+#include "render.h"
+
+//
+// impostors
+//
+
+// views are baked around the up axis of the mesh, which suits upright objects such as trees
+// seen from close to the horizon
+typedef struct impostor_params {
+	uint32_t views;                     // 0 picks 8
+	uint32_t resolution;                // pixels of each square view, 0 picks 128
+	float32_t distance;                 // instances at least this far from the camera become impostors
+} impostor_params_t;
+
+// the atlas holds one tile per view in rows from the bottom left. colors[0] is the color with
+// coverage in alpha, colors[1] the mesh space normal with the depth in front of the center in alpha
+typedef struct impostor {
+	impostor_params_t params;
+	uint32_t columns, rows;
+	vec3_t center;                      // bounding sphere of the mesh
+	float32_t radius;
+	framebuffer_t atlas;
+	uint32_t vao, quad_vbo, instance_vbo, instance_capacity;
+} impostor_t;
+
+void impostor_init();
+void impostor_close();
+
+// renders the mesh from every view into a new atlas, texture may be NULL for vertex colors only.
+// binds the window framebuffer again when done
+impostor_t impostor_create(mesh_t *mesh, texture_t *texture, impostor_params_t params);
+void impostor_delete(impostor_t *impostor);
+
+// moves the transforms closer than params.distance to the front and returns their count,
+// those are drawn as meshes and the rest with impostor_draw
+uint32_t impostor_partition(impostor_t *impostor, matrix_t *xforms, uint32_t count, vec3_t camera_pos);
+
+// one camera facing quad per transform that blends the two closest views. transforms may
+// rotate around the up axis and scale uniformly
+void impostor_draw(impostor_t *impostor, matrix_t *xforms, uint32_t count, matrix_t view_projection, vec3_t camera_pos, vec3_t light_dir);
+
+#endif // IMPOSTOR_H
@@ -0,0 +1,145 @@
+#include "base.h"
+#include "core.h"
+#include "job.h"
+
+//
+// jobs
+//
+
+// one call of job_parallel_for, it lives on the caller's stack until its items are done
+typedef struct job_dispatch {
+	job_func_t func;
+	void *data;
+	uint32_t count, batch, next, pending;
+	struct job_dispatch *link;
+} job_dispatch_t;
+
+global struct {
+	os_thread_o *threads[JOB_MAX_THREADS];
+	uint32_t thread_count;
+	os_mutex_o *mutex;
+	os_condition_o *wake, *done;
+	bool8_t quit;
+	
+	// parallel fors of every calling thread, newest first
+	job_dispatch_t *dispatches;
+} _jobs;
+
+// grabs the next batch, expects the mutex to be held
+internal bool8_t _job_take(job_dispatch_t *dispatch, uint32_t *start, uint32_t *end) {
+	if (dispatch->next >= dispatch->count) {
+		return false;
+	}
+	
+	*start = dispatch->next;
+	*end = MIN(dispatch->next + dispatch->batch, dispatch->count);
+	dispatch->next = *end;
+	return true;
+}
+
+internal void _job_run(job_dispatch_t *dispatch, uint32_t start, uint32_t end) {
+	os_mutex_unlock(_jobs.mutex);
+	dispatch->func(dispatch->data, start, end);
+	os_mutex_lock(_jobs.mutex);
+	
+	dispatch->pending -= end - start;
+	if (!dispatch->pending) {
+		os_condition_broadcast(_jobs.done);
+	}
+}
+
+internal void _job_worker(void *param) {
+	UNUSED(param);
+	uint32_t start, end;
+	
+	os_mutex_lock(_jobs.mutex);
+	while (!_jobs.quit) {
+		job_dispatch_t *dispatch = _jobs.dispatches;
+		while (dispatch && !_job_take(dispatch, &start, &end)) {
+			dispatch = dispatch->link;
+		}
+		
+		if (dispatch) {
+			_job_run(dispatch, start, end);
+		} else {
+			os_condition_wait(_jobs.wake, _jobs.mutex);
+		}
+	}
+	os_mutex_unlock(_jobs.mutex);
+}
+
+void job_init(uint32_t thread_count) {
+	if (!thread_count) {
+		thread_count = os_thread_hardware_count() - 1;
+	}
+	
+	_jobs.thread_count = MIN(thread_count, JOB_MAX_THREADS);
+	_jobs.mutex = os_mutex_create();
+	_jobs.wake = os_condition_create();
+	_jobs.done = os_condition_create();
+	_jobs.quit = false;
+	
+	for (uint32_t i = 0; i < _jobs.thread_count; ++i) {
+		_jobs.threads[i] = os_thread_create(_job_worker, NULL);
+	}
+}
+
+void job_close() {
+	if (!_jobs.mutex) {
+		return;
+	}
+	
+	os_mutex_lock(_jobs.mutex);
+	_jobs.quit = true;
+	os_condition_broadcast(_jobs.wake);
+	os_mutex_unlock(_jobs.mutex);
+	
+	for (uint32_t i = 0; i < _jobs.thread_count; ++i) {
+		os_thread_join(_jobs.threads[i]);
+	}
+	
+	os_condition_delete(_jobs.wake);
+	os_condition_delete(_jobs.done);
+	os_mutex_delete(_jobs.mutex);
+	ZERO_MEMORY(&_jobs);
+}
+
+uint32_t job_thread_count() {
+	return _jobs.thread_count;
+}
+
+void job_parallel_for(uint32_t count, uint32_t batch, job_func_t func, void *data) {
+	if (!count) {
+		return;
+	}
+	
+	if (!_jobs.thread_count || count <= batch) {
+		func(data, 0, count);
+		return;
+	}
+	
+	uint32_t start, end;
+	job_dispatch_t dispatch = { func, data, count, MAX(batch, 1), 0, count, NULL };
+	
+	os_mutex_lock(_jobs.mutex);
+	dispatch.link = _jobs.dispatches;
+	_jobs.dispatches = &dispatch;
+	os_condition_broadcast(_jobs.wake);
+	
+	// help out with our own items only, then wait for the batches still running on workers
+	while (_job_take(&dispatch, &start, &end)) {
+		_job_run(&dispatch, start, end);
+	}
+	
+	while (dispatch.pending) {
+		os_condition_wait(_jobs.done, _jobs.mutex);
+	}
+	
+	job_dispatch_t **link = &_jobs.dispatches;
+	while (*link != &dispatch) {
+		link = &(*link)->link;
+	}
+	
+	*link = dispatch.link;
+	os_mutex_unlock(_jobs.mutex);
+}
@@ -0,0 +1,25 @@
+#ifndef JOB_H
+#define JOB_H
+
+#include "base.h"
+
+//
+// jobs
+//
+
+#define JOB_MAX_THREADS 64
+
+// processes items [start, end) of a parallel for
+typedef void (*job_func_t)(void *data, uint32_t start, uint32_t end);
+
+// thread_count workers besides the calling thread, 0 picks hardware threads - 1
+void job_init(uint32_t thread_count);
+void job_close();
+uint32_t job_thread_count();
+
+// splits count items into batches and blocks until all of them ran, the caller works too.
+// runs inline when job_init was not called. several threads may dispatch at once, and jobs may
+// dispatch their own, every call only waits for its own items
+void job_parallel_for(uint32_t count, uint32_t batch, job_func_t func, void *data);
+
+#endif // JOB_H
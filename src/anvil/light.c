@@ -0,0 +1,353 @@
+#include "base.h"
+#include "core.h"
+#include "math.h"
+#include "render.h"
+#include "job.h"
+#include "light.h"
+#include <glad.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LIGHT_SIMD 1
+#endif
+
+//
+// lights
+//
+
+#define LIGHT_TEXELS 4 // rgba32f texels per light
+
+global struct {
+	light_t lights[LIGHT_MAX_LIGHTS];
+	uint32_t count;
+	vec3_t ambient;
+	
+	// texture buffers
+	uint32_t data_buffer, grid_buffer, index_buffer;
+	uint32_t data_texture, grid_texture, index_texture;
+	
+	// staging
+	float32_t *data;
+	uint32_t *grid;
+	uint16_t *indices;
+	uint16_t *cluster_lights;
+	uint32_t cluster_counts[LIGHT_CLUSTER_COUNT];
+	uint32_t directional_count, index_count;
+	
+	// view space bounding spheres of point and spot lights, padded to 4 for SIMD
+	float32_t *sphere_x, *sphere_y, *sphere_z, *sphere_r;
+	uint32_t sphere_count;
+	
+	// per slice candidate lists, slices are binned in parallel
+	float32_t *slice_x, *slice_y, *slice_z, *slice_r2;
+	uint16_t *slice_id;
+	
+	// cluster bounds, rebuilt when the projection changes
+	range3_t bounds[LIGHT_CLUSTER_COUNT];
+	float32_t slice_depth[LIGHT_CLUSTER_Z + 1];
+	float32_t fov, aspect, znear, zfar;
+	
+	light_statistics_t stats;
+} _light;
+
+internal uint32_t _light_texture_buffer(uint32_t *buffer, uint64_t size, uint32_t format) {
+	uint32_t texture = 0;
+	
+	glGenBuffers(1, buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, *buffer);
+	glBufferData(GL_TEXTURE_BUFFER, size, NULL, GL_STREAM_DRAW);
+	
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_BUFFER, texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, format, *buffer);
+	
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	return texture;
+}
+
+void light_init() {
+	_light.ambient = vec3_scalar(0.09f);
+	
+	_light.data_texture = _light_texture_buffer(&_light.data_buffer, LIGHT_MAX_LIGHTS * LIGHT_TEXELS * sizeof(vec4_t), GL_RGBA32F);
+	_light.grid_texture = _light_texture_buffer(&_light.grid_buffer, LIGHT_CLUSTER_COUNT * 2 * sizeof(uint32_t), GL_RG32UI);
+	_light.index_texture = _light_texture_buffer(&_light.index_buffer, LIGHT_CLUSTER_COUNT * LIGHT_MAX_PER_CLUSTER * sizeof(uint16_t), GL_R16UI);
+	
+	_light.data = malloc(LIGHT_MAX_LIGHTS * LIGHT_TEXELS * sizeof(vec4_t));
+	_light.grid = malloc(LIGHT_CLUSTER_COUNT * 2 * sizeof(uint32_t));
+	_light.indices = malloc(LIGHT_CLUSTER_COUNT * LIGHT_MAX_PER_CLUSTER * sizeof(uint16_t));
+	_light.cluster_lights = malloc(LIGHT_CLUSTER_COUNT * LIGHT_MAX_PER_CLUSTER * sizeof(uint16_t));
+	
+	uint32_t padded = LIGHT_MAX_LIGHTS + 4;
+	_light.sphere_x = malloc(padded * sizeof(float32_t) * 4);
+	_light.sphere_y = _light.sphere_x + padded;
+	_light.sphere_z = _light.sphere_y + padded;
+	_light.sphere_r = _light.sphere_z + padded;
+	
+	_light.slice_x = malloc(LIGHT_CLUSTER_Z * padded * sizeof(float32_t) * 4);
+	_light.slice_y = _light.slice_x + LIGHT_CLUSTER_Z * padded;
+	_light.slice_z = _light.slice_y + LIGHT_CLUSTER_Z * padded;
+	_light.slice_r2 = _light.slice_z + LIGHT_CLUSTER_Z * padded;
+	_light.slice_id = malloc(LIGHT_CLUSTER_Z * padded * sizeof(uint16_t));
+}
+
+void light_close() {
+	glDeleteTextures(1, &_light.data_texture);
+	glDeleteTextures(1, &_light.grid_texture);
+	glDeleteTextures(1, &_light.index_texture);
+	glDeleteBuffers(1, &_light.data_buffer);
+	glDeleteBuffers(1, &_light.grid_buffer);
+	glDeleteBuffers(1, &_light.index_buffer);
+	
+	free(_light.data);
+	free(_light.grid);
+	free(_light.indices);
+	free(_light.cluster_lights);
+	free(_light.sphere_x);
+	free(_light.slice_x);
+	free(_light.slice_id);
+	ZERO_MEMORY(&_light);
+}
+
+void light_ambient(vec3_t color) {
+	_light.ambient = color;
+}
+
+void light_clear() {
+	_light.count = 0;
+}
+
+void light_push(light_t light) {
+	if (_light.count >= LIGHT_MAX_LIGHTS) {
+		return;
+	}
+	
+	_light.lights[_light.count++] = light;
+}
+
+internal void _light_bounds_build(float32_t fov, float32_t aspect, float32_t znear, float32_t zfar) {
+	float32_t tan_y = tanf(DEG_TO_RAD(fov) / 2);
+	float32_t tan_x = tan_y * aspect;
+	
+	for (uint32_t k = 0; k <= LIGHT_CLUSTER_Z; ++k) {
+		_light.slice_depth[k] = znear * powf(zfar / znear, (float32_t)k / LIGHT_CLUSTER_Z);
+	}
+	
+	for (uint32_t k = 0; k < LIGHT_CLUSTER_Z; ++k) {
+		float32_t dn = _light.slice_depth[k], df = _light.slice_depth[k + 1];
+		
+		for (uint32_t j = 0; j < LIGHT_CLUSTER_Y; ++j) {
+			float32_t y0 = -1.0f + 2.0f * j / LIGHT_CLUSTER_Y, y1 = -1.0f + 2.0f * (j + 1) / LIGHT_CLUSTER_Y;
+			
+			for (uint32_t i = 0; i < LIGHT_CLUSTER_X; ++i) {
+				float32_t x0 = -1.0f + 2.0f * i / LIGHT_CLUSTER_X, x1 = -1.0f + 2.0f * (i + 1) / LIGHT_CLUSTER_X;
+				range3_t *b = &_light.bounds[(k * LIGHT_CLUSTER_Y + j) * LIGHT_CLUSTER_X + i];
+				
+				// the tile edges spread with depth, take both ends of the slice
+				b->min.x = MIN(x0 * tan_x * dn, x0 * tan_x * df);
+				b->max.x = MAX(x1 * tan_x * dn, x1 * tan_x * df);
+				b->min.y = MIN(y0 * tan_y * dn, y0 * tan_y * df);
+				b->max.y = MAX(y1 * tan_y * dn, y1 * tan_y * df);
+				b->min.z = -df;
+				b->max.z = -dn;
+			}
+		}
+	}
+	
+	_light.fov = fov;
+	_light.aspect = aspect;
+	_light.znear = znear;
+	_light.zfar = zfar;
+}
+
+internal void _light_bin_slices(void *data, uint32_t start, uint32_t end) {
+	UNUSED(data);
+	uint32_t padded = LIGHT_MAX_LIGHTS + 4;
+	
+	for (uint32_t k = start; k < end; ++k) {
+		float32_t dn = _light.slice_depth[k], df = _light.slice_depth[k + 1];
+		float32_t *cx = _light.slice_x + k * padded;
+		float32_t *cy = _light.slice_y + k * padded;
+		float32_t *cz = _light.slice_z + k * padded;
+		float32_t *cr2 = _light.slice_r2 + k * padded;
+		uint16_t *id = _light.slice_id + k * padded;
+		uint32_t n = 0;
+		
+		// lights touching this depth slice
+		for (uint32_t l = 0; l < _light.sphere_count; ++l) {
+			float32_t depth = -_light.sphere_z[l], r = _light.sphere_r[l];
+			if (depth + r > dn && depth - r < df) {
+				cx[n] = _light.sphere_x[l];
+				cy[n] = _light.sphere_y[l];
+				cz[n] = _light.sphere_z[l];
+				cr2[n] = r * r;
+				id[n] = (uint16_t)(_light.directional_count + l);
+				++n;
+			}
+		}
+		
+		// pad so the SIMD loop never matches garbage
+		for (uint32_t p = n; p < ((n + 3) & ~3u); ++p) {
+			cx[p] = cy[p] = cz[p] = 0.0f;
+			cr2[p] = -1.0f;
+		}
+		
+		for (uint32_t t = 0; t < LIGHT_CLUSTER_X * LIGHT_CLUSTER_Y; ++t) {
+			uint32_t cluster = k * LIGHT_CLUSTER_X * LIGHT_CLUSTER_Y + t;
+			uint16_t *out = _light.cluster_lights + cluster * LIGHT_MAX_PER_CLUSTER;
+			range3_t b = _light.bounds[cluster];
+			uint32_t count = 0;
+
+#if LIGHT_SIMD
+			// sphere vs aabb for 4 lights at a time
+			__m128 min_x = _mm_set1_ps(b.min.x), max_x = _mm_set1_ps(b.max.x);
+			__m128 min_y = _mm_set1_ps(b.min.y), max_y = _mm_set1_ps(b.max.y);
+			__m128 min_z = _mm_set1_ps(b.min.z), max_z = _mm_set1_ps(b.max.z);
+			__m128 zero = _mm_setzero_ps();
+			
+			for (uint32_t l = 0; l < n; l += 4) {
+				__m128 x = _mm_loadu_ps(cx + l), y = _mm_loadu_ps(cy + l), z = _mm_loadu_ps(cz + l);
+				__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(min_x, x), _mm_sub_ps(x, max_x)), zero);
+				__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(min_y, y), _mm_sub_ps(y, max_y)), zero);
+				__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(min_z, z), _mm_sub_ps(z, max_z)), zero);
+				__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+				int32_t mask = _mm_movemask_ps(_mm_cmple_ps(d2, _mm_loadu_ps(cr2 + l)));
+				
+				for (uint32_t bit = 0; mask && bit < 4 && count < LIGHT_MAX_PER_CLUSTER; ++bit) {
+					if (mask & BIT(bit)) {
+						out[count++] = id[l + bit];
+					}
+				}
+			}
+#else
+			for (uint32_t l = 0; l < n && count < LIGHT_MAX_PER_CLUSTER; ++l) {
+				float32_t dx = MAX(MAX(b.min.x - cx[l], cx[l] - b.max.x), 0.0f);
+				float32_t dy = MAX(MAX(b.min.y - cy[l], cy[l] - b.max.y), 0.0f);
+				float32_t dz = MAX(MAX(b.min.z - cz[l], cz[l] - b.max.z), 0.0f);
+				if (dx * dx + dy * dy + dz * dz <= cr2[l]) {
+					out[count++] = id[l];
+				}
+			}
+#endif
+			
+			_light.cluster_counts[cluster] = count;
+		}
+	}
+}
+
+void light_update(matrix_t view, float32_t fov, float32_t aspect, float32_t znear, float32_t zfar) {
+	float64_t start_time = os_time();
+	
+	if (fov != _light.fov || aspect != _light.aspect || znear != _light.znear || zfar != _light.zfar) {
+		_light_bounds_build(fov, aspect, znear, zfar);
+	}
+	
+	// directional lights go first and are applied everywhere
+	_light.directional_count = 0;
+	for (uint32_t pass = 0; pass < 2; ++pass) {
+		for (uint32_t i = 0; i < _light.count; ++i) {
+			light_t *light = &_light.lights[i];
+			if ((light->type == LIGHT_DIRECTIONAL) != (pass == 0)) {
+				continue;
+			}
+			
+			uint32_t index = (pass == 0) ? _light.directional_count++ : _light.directional_count + _light.sphere_count;
+			vec3_t dir = normalize3(light->dir);
+			float32_t *t = &_light.data[index * LIGHT_TEXELS * 4];
+			
+			t[0]  = light->pos.x; t[1]  = light->pos.y; t[2]  = light->pos.z; t[3]  = light->range;
+			t[4]  = light->color.x * light->intensity;
+			t[5]  = light->color.y * light->intensity;
+			t[6]  = light->color.z * light->intensity;
+			t[7]  = (float32_t)light->type;
+			t[8]  = dir.x; t[9]  = dir.y; t[10] = dir.z; t[11] = cosf(DEG_TO_RAD(light->outer_angle));
+			t[12] = cosf(DEG_TO_RAD(light->inner_angle)); t[13] = t[14] = t[15] = 0.0f;
+			
+			if (pass == 1) {
+				// bounding sphere of the light volume, a cone for spot lights
+				vec3_t center = light->pos;
+				float32_t radius = light->range;
+				
+				if (light->type == LIGHT_SPOT) {
+					float32_t angle = DEG_TO_RAD(light->outer_angle);
+					if (angle > PI / 4) {
+						center = add3(center, mul3(dir, vec3_scalar(light->range * cosf(angle))));
+						radius = light->range * sinf(angle);
+					} else {
+						radius = light->range / (2.0f * cosf(angle));
+						center = add3(center, mul3(dir, vec3_scalar(radius)));
+					}
+				}
+				
+				vec4_t v = matrix_transform(view, (vec4_t){ center.x, center.y, center.z, 1.0f });
+				_light.sphere_x[_light.sphere_count] = v.x;
+				_light.sphere_y[_light.sphere_count] = v.y;
+				_light.sphere_z[_light.sphere_count] = v.z;
+				_light.sphere_r[_light.sphere_count] = radius;
+				++_light.sphere_count;
+			}
+		}
+		
+		if (pass == 0) {
+			_light.sphere_count = 0;
+		}
+	}
+	
+	// one depth slice per job
+	job_parallel_for(LIGHT_CLUSTER_Z, 1, _light_bin_slices, NULL);
+	
+	// compact the per cluster lists into one index list
+	_light.index_count = 0;
+	for (uint32_t c = 0; c < LIGHT_CLUSTER_COUNT; ++c) {
+		uint32_t count = _light.cluster_counts[c];
+		_light.grid[c * 2 + 0] = _light.index_count;
+		_light.grid[c * 2 + 1] = count;
+		memcpy(&_light.indices[_light.index_count], &_light.cluster_lights[c * LIGHT_MAX_PER_CLUSTER], count * sizeof(uint16_t));
+		_light.index_count += count;
+	}
+	
+	uint32_t light_count = _light.directional_count + _light.sphere_count;
+	
+	glBindBuffer(GL_TEXTURE_BUFFER, _light.data_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, LIGHT_MAX_LIGHTS * LIGHT_TEXELS * sizeof(vec4_t), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, light_count * LIGHT_TEXELS * sizeof(vec4_t), _light.data);
+	
+	glBindBuffer(GL_TEXTURE_BUFFER, _light.grid_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, LIGHT_CLUSTER_COUNT * 2 * sizeof(uint32_t), _light.grid, GL_STREAM_DRAW);
+	
+	glBindBuffer(GL_TEXTURE_BUFFER, _light.index_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, LIGHT_CLUSTER_COUNT * LIGHT_MAX_PER_CLUSTER * sizeof(uint16_t), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, _light.index_count * sizeof(uint16_t), _light.indices);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	
+	_light.stats = (light_statistics_t){ light_count, _light.directional_count, _light.index_count, os_time() - start_time };
+}
+
+void light_bind(shader_t shader, uint32_t slot) {
+	if (!_light.znear) {
+		return;
+	}
+	
+	glActiveTexture(GL_TEXTURE0 + slot);
+	glBindTexture(GL_TEXTURE_BUFFER, _light.data_texture);
+	glActiveTexture(GL_TEXTURE0 + slot + 1);
+	glBindTexture(GL_TEXTURE_BUFFER, _light.grid_texture);
+	glActiveTexture(GL_TEXTURE0 + slot + 2);
+	glBindTexture(GL_TEXTURE_BUFFER, _light.index_texture);
+	
+	// slice = log(depth) * scale + bias
+	float32_t scale = LIGHT_CLUSTER_Z / logf(_light.zfar / _light.znear);
+	float32_t bias = -logf(_light.znear) * scale;
+	
+	shader_uniform_texture(shader, "light_data", slot);
+	shader_uniform_texture(shader, "light_grid", slot + 1);
+	shader_uniform_texture(shader, "light_indices", slot + 2);
+	shader_uniform_int(shader, "light_directional_count", _light.directional_count);
+	shader_uniform_vec3(shader, "light_cluster_dims", (vec3_t){ LIGHT_CLUSTER_X, LIGHT_CLUSTER_Y, LIGHT_CLUSTER_Z });
+	shader_uniform_vec2(shader, "light_cluster_scale_bias", (vec2_t){ scale, bias });
+	shader_uniform_vec3(shader, "light_ambient", _light.ambient);
+}
+
+light_statistics_t light_statistics_get() {
+	return _light.stats;
+}
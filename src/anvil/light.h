@@ -0,0 +1,57 @@
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#include "base.h"
+#include "math.h"
+#include "render.h"
+
+//
+// lights
+//
+
+#define LIGHT_MAX_LIGHTS 1024
+#define LIGHT_MAX_PER_CLUSTER 128
+
+// view frustum grid, x/y are screen tiles, z are exponential depth slices
+#define LIGHT_CLUSTER_X 16
+#define LIGHT_CLUSTER_Y 9
+#define LIGHT_CLUSTER_Z 24
+#define LIGHT_CLUSTER_COUNT (LIGHT_CLUSTER_X * LIGHT_CLUSTER_Y * LIGHT_CLUSTER_Z)
+
+typedef enum light_type {
+	LIGHT_POINT,
+	LIGHT_SPOT,
+	LIGHT_DIRECTIONAL
+} light_type_e;
+
+typedef struct light {
+	light_type_e type;
+	vec3_t pos, dir, color;
+	float32_t intensity;
+	float32_t range;                    // point/spot, light is zero past this distance
+	float32_t inner_angle, outer_angle; // spot cone half angles in degrees
+} light_t;
+
+typedef struct light_statistics {
+	uint32_t lights, directional_lights, indices;
+	float64_t bin_time;
+} light_statistics_t;
+
+void light_init();
+void light_close();
+
+void light_ambient(vec3_t color);
+
+// lights are pushed every frame, the first directional light receives the cascaded shadow
+void light_clear();
+void light_push(light_t light);
+
+// bins the lights into the clusters of this camera and uploads them
+void light_update(matrix_t view, float32_t fov, float32_t aspect, float32_t znear, float32_t zfar);
+
+// binds light_data, light_grid and light_indices to slot, slot + 1 and slot + 2
+void light_bind(shader_t shader, uint32_t slot);
+
+light_statistics_t light_statistics_get();
+
+#endif // LIGHT_H
@@ -221,6 +221,68 @@ matrix_t matrix_mul(matrix_t a, matrix_t b) {
 	return m;
 }
 
+matrix_t matrix_inverse(matrix_t matrix) {
+	float32_t *m = matrix.values;
+	matrix_t inv;
+	float32_t *r = inv.values;
+	
+	r[0]  =  m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+	r[4]  = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+	r[8]  =  m[4] * m[9]  * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+	r[12] = -m[4] * m[9]  * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+	r[1]  = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+	r[5]  =  m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+	r[9]  = -m[0] * m[9]  * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+	r[13] =  m[0] * m[9]  * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+	r[2]  =  m[1] * m[6]  * m[15] - m[1] * m[7]  * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7]  - m[13] * m[3] * m[6];
+	r[6]  = -m[0] * m[6]  * m[15] + m[0] * m[7]  * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7]  + m[12] * m[3] * m[6];
+	r[10] =  m[0] * m[5]  * m[15] - m[0] * m[7]  * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7]  - m[12] * m[3] * m[5];
+	r[14] = -m[0] * m[5]  * m[14] + m[0] * m[6]  * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6]  + m[12] * m[2] * m[5];
+	r[3]  = -m[1] * m[6]  * m[11] + m[1] * m[7]  * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9]  * m[2] * m[7]  + m[9]  * m[3] * m[6];
+	r[7]  =  m[0] * m[6]  * m[11] - m[0] * m[7]  * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8]  * m[2] * m[7]  - m[8]  * m[3] * m[6];
+	r[11] = -m[0] * m[5]  * m[11] + m[0] * m[7]  * m[9]  + m[4] * m[1] * m[11] - m[4] * m[3] * m[9]  - m[8]  * m[1] * m[7]  + m[8]  * m[3] * m[5];
+	r[15] =  m[0] * m[5]  * m[10] - m[0] * m[6]  * m[9]  - m[4] * m[1] * m[10] + m[4] * m[2] * m[9]  + m[8]  * m[1] * m[6]  - m[8]  * m[2] * m[5];
+	
+	float32_t det = m[0] * r[0] + m[1] * r[4] + m[2] * r[8] + m[3] * r[12];
+	if (det == 0.0f) {
+		return IDENTITY_MATRIX;
+	}
+	
+	det = 1.0f / det;
+	for (int i = 0; i < 16; ++i) {
+		r[i] *= det;
+	}
+	
+	return inv;
+}
+
+// row vector times matrix, same convention as matrix_mul
+vec4_t matrix_transform(matrix_t matrix, vec4_t vec) {
+	return (vec4_t) {
+		vec.x * matrix.elements[0][0] + vec.y * matrix.elements[1][0] + vec.z * matrix.elements[2][0] + vec.w * matrix.elements[3][0],
+		vec.x * matrix.elements[0][1] + vec.y * matrix.elements[1][1] + vec.z * matrix.elements[2][1] + vec.w * matrix.elements[3][1],
+		vec.x * matrix.elements[0][2] + vec.y * matrix.elements[1][2] + vec.z * matrix.elements[2][2] + vec.w * matrix.elements[3][2],
+		vec.x * matrix.elements[0][3] + vec.y * matrix.elements[1][3] + vec.z * matrix.elements[2][3] + vec.w * matrix.elements[3][3]
+	};
+}
+
+// the w column plus and minus each of the others, a point is inside where all six are positive
+void matrix_frustum(matrix_t matrix, vec4_t planes[6]) {
+	vec4_t w = { matrix.elements[0][3], matrix.elements[1][3], matrix.elements[2][3], matrix.elements[3][3] };
+	
+	for (uint32_t i = 0; i < 3; ++i) {
+		vec4_t column = { matrix.elements[0][i], matrix.elements[1][i], matrix.elements[2][i], matrix.elements[3][i] };
+		planes[i * 2 + 0] = (vec4_t){ w.x + column.x, w.y + column.y, w.z + column.z, w.w + column.w };
+		planes[i * 2 + 1] = (vec4_t){ w.x - column.x, w.y - column.y, w.z - column.z, w.w - column.w };
+	}
+	
+	for (uint32_t i = 0; i < 6; ++i) {
+		vec4_t p = planes[i];
+		float32_t length = sqrtf(p.x * p.x + p.y * p.y + p.z * p.z);
+		planes[i] = (vec4_t){ p.x / length, p.y / length, p.z / length, p.w / length };
+	}
+}
+
 // xform transformations
 matrix_t xform_translate(matrix_t matrix, vec3_t translation) {
 	matrix_t m = IDENTITY_MATRIX;
@@ -310,3 +372,63 @@ matrix_t xform_camera(vec3_t pos, vec3_t rot) {
 	
 	return m;
 }
+
+matrix_t xform_trs(vec3_t pos, vec4_t rot, vec3_t scale) {
+	matrix_t m = IDENTITY_MATRIX;
+	float32_t x = rot.x, y = rot.y, z = rot.z, w = rot.w;
+	
+	m.elements[0][0] = (1.0f - 2.0f * (y * y + z * z)) * scale.x;
+	m.elements[0][1] = (2.0f * (x * y + z * w)) * scale.x;
+	m.elements[0][2] = (2.0f * (x * z - y * w)) * scale.x;
+	
+	m.elements[1][0] = (2.0f * (x * y - z * w)) * scale.y;
+	m.elements[1][1] = (1.0f - 2.0f * (x * x + z * z)) * scale.y;
+	m.elements[1][2] = (2.0f * (y * z + x * w)) * scale.y;
+	
+	m.elements[2][0] = (2.0f * (x * z + y * w)) * scale.z;
+	m.elements[2][1] = (2.0f * (y * z - x * w)) * scale.z;
+	m.elements[2][2] = (1.0f - 2.0f * (x * x + y * y)) * scale.z;
+	
+	m.elements[3][0] = pos.x;
+	m.elements[3][1] = pos.y;
+	m.elements[3][2] = pos.z;
+	
+	return m;
+}
+
+//
+// quaternions
+//
+
+vec4_t quat_axis_angle(vec3_t axis, float32_t radians) {
+	vec3_t n = normalize3(axis);
+	float32_t s = sinf(radians * 0.5f);
+	return (vec4_t){ n.x * s, n.y * s, n.z * s, cosf(radians * 0.5f) };
+}
+
+vec4_t quat_mul(vec4_t a, vec4_t b) {
+	return (vec4_t) {
+		a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+		a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+		a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+		a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z
+	};
+}
+
+vec4_t quat_nlerp(vec4_t a, vec4_t b, float32_t t) {
+	// q and -q are the same rotation, flip b onto a's hemisphere
+	float32_t sign = dot4(a, b) < 0.0f ? -1.0f : 1.0f;
+	vec4_t q = {
+		a.x + (b.x * sign - a.x) * t,
+		a.y + (b.y * sign - a.y) * t,
+		a.z + (b.z * sign - a.z) * t,
+		a.w + (b.w * sign - a.w) * t
+	};
+	
+	float32_t length = sqrtf(dot4(q, q));
+	if (length > 0.0f) {
+		q = (vec4_t){ q.x / length, q.y / length, q.z / length, q.w / length };
+	}
+	
+	return q;
+}
@@ -93,6 +93,12 @@ matrix_t matrix_projection_ortho(float32_t left, float32_t right, float32_t bott
 matrix_t matrix_projection_perspective(float32_t fov, float32_t aspect, float32_t znear, float32_t zfar);
 
 matrix_t matrix_mul(matrix_t a, matrix_t b);
+matrix_t matrix_inverse(matrix_t matrix);
+vec4_t matrix_transform(matrix_t matrix, vec4_t vec);
+
+// normalized planes of a view projection, inwards facing, left right bottom top near far.
+// world space for a view projection, object space when a model matrix goes in front
+void matrix_frustum(matrix_t matrix, vec4_t planes[6]);
 
 // xform transformations
 matrix_t xform_translate(matrix_t matrix, vec3_t translation);
@@ -102,4 +108,19 @@ matrix_t xform_lookat(vec3_t eye, vec3_t target, vec3_t up);
 matrix_t xform_transform(transform_t transform);
 matrix_t xform_camera(vec3_t pos, vec3_t rot);
 
+// scale, then rotate by a unit quaternion, then translate
+matrix_t xform_trs(vec3_t pos, vec4_t rot, vec3_t scale);
+
+
+//
+// quaternions
+//
+
+// stored in a vec4_t as (x, y, z, w)
+vec4_t quat_axis_angle(vec3_t axis, float32_t radians);
+vec4_t quat_mul(vec4_t a, vec4_t b);
+
+// normalized lerp along the shorter arc, good enough between animation keys
+vec4_t quat_nlerp(vec4_t a, vec4_t b, float32_t t);
+
 #endif // MATH_H
@@ -0,0 +1,386 @@
+#include "base.h"
+#include "core.h"
+#include "math.h"
+#include "render.h"
+#include "meshlet.h"
+#include <glad.h>
+
+//
+// clustering
+//
+
+// triangles touching each vertex, packed by vertex
+typedef struct meshlet_adjacency {
+	uint32_t *offsets;
+	uint32_t *triangles;
+} meshlet_adjacency_t;
+
+internal meshlet_adjacency_t _meshlet_adjacency(uint32_t *indices, uint32_t triangle_count, uint32_t vertex_count) {
+	meshlet_adjacency_t adjacency;
+	adjacency.offsets = calloc(vertex_count + 1, sizeof(uint32_t));
+	adjacency.triangles = malloc(triangle_count * 3 * sizeof(uint32_t));
+	
+	for (uint32_t i = 0; i < triangle_count * 3; ++i) {
+		++adjacency.offsets[indices[i] + 1];
+	}
+	for (uint32_t i = 0; i < vertex_count; ++i) {
+		adjacency.offsets[i + 1] += adjacency.offsets[i];
+	}
+	
+	uint32_t *fill = malloc(vertex_count * sizeof(uint32_t));
+	memcpy(fill, adjacency.offsets, vertex_count * sizeof(uint32_t));
+	for (uint32_t i = 0; i < triangle_count * 3; ++i) {
+		adjacency.triangles[fill[indices[i]]++] = i / 3;
+	}
+	
+	free(fill);
+	return adjacency;
+}
+
+// computes the bounding sphere and normal cone of a finished meshlet
+internal void _meshlet_bounds(meshlet_mesh_t *m, meshlet_t *meshlet) {
+	vertex_t *vertices = m->mesh.vertices;
+	uint32_t *local = m->vertices + meshlet->vertex_offset;
+	uint8_t *triangles = m->triangles + meshlet->triangle_offset * 3;
+	
+	range3_t box = { vec3_scalar(FLT_MAX), vec3_scalar(-FLT_MAX) };
+	for (uint32_t i = 0; i < meshlet->vertex_count; ++i) {
+		vec3_t p = vertices[local[i]].pos;
+		box.min = (vec3_t){ MIN(box.min.x, p.x), MIN(box.min.y, p.y), MIN(box.min.z, p.z) };
+		box.max = (vec3_t){ MAX(box.max.x, p.x), MAX(box.max.y, p.y), MAX(box.max.z, p.z) };
+	}
+	
+	meshlet->center = mul3(add3(box.min, box.max), vec3_scalar(0.5f));
+	meshlet->radius = 0.0f;
+	for (uint32_t i = 0; i < meshlet->vertex_count; ++i) {
+		meshlet->radius = MAX(meshlet->radius, distance3(meshlet->center, vertices[local[i]].pos));
+	}
+	
+	// the axis is the average face normal, the cone has to hold the normal furthest from it
+	vec3_t normals[MESHLET_MAX_TRIANGLES];
+	vec3_t axis = vec3_scalar(0.0f);
+	for (uint32_t i = 0; i < meshlet->triangle_count; ++i) {
+		vec3_t a = vertices[local[triangles[i * 3 + 0]]].pos;
+		vec3_t b = vertices[local[triangles[i * 3 + 1]]].pos;
+		vec3_t c = vertices[local[triangles[i * 3 + 2]]].pos;
+		vec3_t n = cross3(sub3(b, a), sub3(c, a));
+		float32_t length = sqrtf(dot3(n, n));
+		
+		normals[i] = length > 0.0f ? mul3(n, vec3_scalar(1.0f / length)) : vec3_scalar(0.0f);
+		axis = add3(axis, normals[i]);
+	}
+	
+	float32_t axis_length = sqrtf(dot3(axis, axis));
+	axis = axis_length > 0.0f ? mul3(axis, vec3_scalar(1.0f / axis_length)) : (vec3_t){ 1.0f, 0.0f, 0.0f };
+	
+	float32_t min_dp = 1.0f;
+	for (uint32_t i = 0; i < meshlet->triangle_count; ++i) {
+		min_dp = MIN(min_dp, dot3(normals[i], axis));
+	}
+	
+	meshlet->cone_axis = axis;
+	meshlet->cone_apex = meshlet->center;
+	meshlet->cone_cutoff = 1.0f;
+	
+	// wider than about 84 degrees, the apex would sit too far back to be useful
+	if (axis_length <= 0.0f || min_dp <= 0.1f) {
+		return;
+	}
+	
+	// moves the apex back along the axis until every triangle plane is in front of it
+	float32_t max_t = 0.0f;
+	for (uint32_t i = 0; i < meshlet->triangle_count; ++i) {
+		vec3_t a = vertices[local[triangles[i * 3 + 0]]].pos;
+		float32_t dc = dot3(sub3(meshlet->center, a), normals[i]);
+		float32_t dn = dot3(axis, normals[i]);
+		max_t = MAX(max_t, dc / dn);
+	}
+	
+	meshlet->cone_apex = sub3(meshlet->center, mul3(axis, vec3_scalar(max_t)));
+	meshlet->cone_cutoff = sqrtf(1.0f - min_dp * min_dp);
+}
+
+internal void _meshlet_upload(meshlet_mesh_t *m, uint32_t *indices, uint32_t index_count) {
+	int32_t old_vao = 0, old_buffer = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &old_buffer);
+	
+	glGenVertexArrays(1, &m->vao);
+	glGenBuffers(1, &m->vbo);
+	glGenBuffers(1, &m->ebo);
+	
+	glBindVertexArray(m->vao);
+	glBindBuffer(GL_ARRAY_BUFFER, m->vbo);
+	glBufferData(GL_ARRAY_BUFFER, m->mesh.curr_vertex * sizeof(vertex_t), m->mesh.vertices, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, pos));
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, uv));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, color));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, normal));
+	glEnableVertexAttribArray(3);
+	
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m->ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_count * sizeof(uint32_t), indices, GL_STATIC_DRAW);
+	
+	glBindVertexArray(old_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, old_buffer);
+}
+
+meshlet_mesh_t meshlet_mesh_build(mesh_t mesh) {
+	meshlet_mesh_t m = ZERO_STRUCT(meshlet_mesh_t);
+	m.mesh = mesh;
+	
+	uint32_t vertex_count = mesh.curr_vertex;
+	uint32_t triangle_count = mesh.curr_index / 3;
+	if (!triangle_count) {
+		return m;
+	}
+	
+	// every meshlet holds at least one triangle, so that is the worst case
+	m.meshlets = malloc(triangle_count * sizeof(meshlet_t));
+	m.vertices = malloc(triangle_count * 3 * sizeof(uint32_t));
+	m.triangles = malloc(triangle_count * 3 * sizeof(uint8_t));
+	
+	meshlet_adjacency_t adjacency = _meshlet_adjacency(mesh.indices, triangle_count, vertex_count);
+	bool8_t *emitted = calloc(triangle_count, sizeof(bool8_t));
+	uint32_t *owner = malloc(vertex_count * sizeof(uint32_t));   // meshlet that last took the vertex
+	uint8_t *slot = malloc(vertex_count * sizeof(uint8_t));      // its index inside that meshlet
+	memset(owner, 0xff, vertex_count * sizeof(uint32_t));
+	
+	uint32_t vertex_offset = 0, triangle_offset = 0, scan = 0;
+	while (triangle_offset < triangle_count) {
+		meshlet_t *meshlet = &m.meshlets[m.meshlet_count];
+		*meshlet = ZERO_STRUCT(meshlet_t);
+		meshlet->vertex_offset = vertex_offset;
+		meshlet->triangle_offset = triangle_offset;
+		meshlet->index_offset = triangle_offset * 3;
+		
+		while (emitted[scan]) {
+			++scan;
+		}
+		
+		uint32_t triangle = scan;
+		while (triangle != UINT32_MAX) {
+			uint32_t *t = mesh.indices + triangle * 3;
+			for (uint32_t i = 0; i < 3; ++i) {
+				if (owner[t[i]] != m.meshlet_count) {
+					owner[t[i]] = m.meshlet_count;
+					slot[t[i]] = (uint8_t)meshlet->vertex_count;
+					m.vertices[vertex_offset + meshlet->vertex_count++] = t[i];
+				}
+				m.triangles[(triangle_offset + meshlet->triangle_count) * 3 + i] = slot[t[i]];
+			}
+			
+			emitted[triangle] = true;
+			++meshlet->triangle_count;
+			if (meshlet->triangle_count == MESHLET_MAX_TRIANGLES) {
+				break;
+			}
+			
+			// the neighbour adding the fewest new vertices, a full meshlet ends once none fit
+			triangle = UINT32_MAX;
+			uint32_t best = 3;
+			for (uint32_t v = 0; v < meshlet->vertex_count && best; ++v) {
+				uint32_t vertex = m.vertices[vertex_offset + v];
+				for (uint32_t a = adjacency.offsets[vertex]; a < adjacency.offsets[vertex + 1]; ++a) {
+					uint32_t candidate = adjacency.triangles[a];
+					if (emitted[candidate]) {
+						continue;
+					}
+					
+					uint32_t *c = mesh.indices + candidate * 3;
+					uint32_t added = (owner[c[0]] != m.meshlet_count) + (owner[c[1]] != m.meshlet_count) + (owner[c[2]] != m.meshlet_count);
+					if (added < best && meshlet->vertex_count + added <= MESHLET_MAX_VERTICES) {
+						best = added;
+						triangle = candidate;
+					}
+				}
+			}
+			
+			// disconnected islands continue in scan order rather than each starting a meshlet
+			if (triangle == UINT32_MAX) {
+				while (scan < triangle_count && emitted[scan]) {
+					++scan;
+				}
+				
+				if (scan < triangle_count) {
+					uint32_t *c = mesh.indices + scan * 3;
+					uint32_t added = (owner[c[0]] != m.meshlet_count) + (owner[c[1]] != m.meshlet_count) + (owner[c[2]] != m.meshlet_count);
+					if (meshlet->vertex_count + added <= MESHLET_MAX_VERTICES) {
+						triangle = scan;
+					}
+				}
+			}
+		}
+		
+		vertex_offset += meshlet->vertex_count;
+		triangle_offset += meshlet->triangle_count;
+		++m.meshlet_count;
+	}
+	
+	free(emitted);
+	free(owner);
+	free(slot);
+	free(adjacency.offsets);
+	free(adjacency.triangles);
+	
+	m.meshlets = realloc(m.meshlets, m.meshlet_count * sizeof(meshlet_t));
+	m.vertices = realloc(m.vertices, vertex_offset * sizeof(uint32_t));
+	
+	// the draw indices follow the meshlet order, so neighbouring visible meshlets share one range
+	uint32_t *indices = malloc(triangle_count * 3 * sizeof(uint32_t));
+	for (uint32_t i = 0; i < m.meshlet_count; ++i) {
+		meshlet_t *meshlet = &m.meshlets[i];
+		for (uint32_t j = 0; j < meshlet->triangle_count * 3; ++j) {
+			indices[meshlet->index_offset + j] = m.vertices[meshlet->vertex_offset + m.triangles[meshlet->triangle_offset * 3 + j]];
+		}
+		
+		_meshlet_bounds(&m, meshlet);
+	}
+	
+	_meshlet_upload(&m, indices, triangle_count * 3);
+	free(indices);
+	return m;
+}
+
+meshlet_mesh_t meshlet_mesh_load(string_t path) {
+	mesh_t mesh = mesh_load(path);
+	if (!mesh.vertices) {
+		return ZERO_STRUCT(meshlet_mesh_t);
+	}
+	
+	return meshlet_mesh_build(mesh);
+}
+
+void meshlet_mesh_delete(meshlet_mesh_t *mesh) {
+	if (mesh->vao) {
+		glDeleteVertexArrays(1, &mesh->vao);
+		glDeleteBuffers(1, &mesh->vbo);
+		glDeleteBuffers(1, &mesh->ebo);
+	}
+	
+	mesh_delete(&mesh->mesh);
+	free(mesh->meshlets);
+	free(mesh->vertices);
+	free(mesh->triangles);
+	ZERO_MEMORY(mesh);
+}
+
+//
+// culling
+//
+
+internal void _meshlet_list_push(meshlet_draw_list_t *list, meshlet_t *meshlet) {
+	uint32_t count = meshlet->triangle_count * 3;
+	uintptr_t offset = meshlet->index_offset * sizeof(uint32_t);
+	
+	if (list->range_count) {
+		uint32_t last = list->range_count - 1;
+		if ((uintptr_t)list->offsets[last] + list->counts[last] * sizeof(uint32_t) == offset) {
+			list->counts[last] += (int32_t)count;
+			return;
+		}
+	}
+	
+	if (list->range_count == list->capacity) {
+		list->capacity = MAX(list->capacity * 2, 64);
+		list->counts = realloc(list->counts, list->capacity * sizeof(int32_t));
+		list->offsets = realloc(list->offsets, list->capacity * sizeof(void *));
+	}
+	
+	list->counts[list->range_count] = (int32_t)count;
+	list->offsets[list->range_count] = (void *)offset;
+	++list->range_count;
+}
+
+void meshlet_cull(meshlet_mesh_t *mesh, matrix_t xform, matrix_t view_projection, vec3_t camera_pos, meshlet_draw_list_t *list) {
+	list->range_count = 0;
+	list->visible = 0;
+	list->frustum_culled = 0;
+	list->backface_culled = 0;
+	list->vertices = 0;
+	list->indices = 0;
+	
+	vec4_t planes[6];
+	matrix_frustum(view_projection, planes);
+	
+	// rows are the basis vectors, the longest one bounds the scale of the radius
+	float32_t scale = 0.0f;
+	for (uint32_t i = 0; i < 3; ++i) {
+		vec3_t row = { xform.elements[i][0], xform.elements[i][1], xform.elements[i][2] };
+		scale = MAX(scale, sqrtf(dot3(row, row)));
+	}
+	
+	for (uint32_t i = 0; i < mesh->meshlet_count; ++i) {
+		meshlet_t *meshlet = &mesh->meshlets[i];
+		
+		vec4_t center = matrix_transform(xform, (vec4_t){ meshlet->center.x, meshlet->center.y, meshlet->center.z, 1.0f });
+		float32_t radius = meshlet->radius * scale;
+		
+		bool8_t outside = false;
+		for (uint32_t p = 0; p < 6 && !outside; ++p) {
+			outside = planes[p].x * center.x + planes[p].y * center.y + planes[p].z * center.z + planes[p].w < -radius;
+		}
+		
+		if (outside) {
+			++list->frustum_culled;
+			continue;
+		}
+		
+		// the camera sees only back faces from inside the cone
+		if (meshlet->cone_cutoff < 1.0f) {
+			vec4_t apex = matrix_transform(xform, (vec4_t){ meshlet->cone_apex.x, meshlet->cone_apex.y, meshlet->cone_apex.z, 1.0f });
+			vec4_t axis = matrix_transform(xform, (vec4_t){ meshlet->cone_axis.x, meshlet->cone_axis.y, meshlet->cone_axis.z, 0.0f });
+			vec3_t view = sub3((vec3_t){ apex.x, apex.y, apex.z }, camera_pos);
+			
+			float32_t length = sqrtf(dot3(view, view)) * sqrtf(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
+			if (length > 0.0f && dot3(view, (vec3_t){ axis.x, axis.y, axis.z }) >= meshlet->cone_cutoff * length) {
+				++list->backface_culled;
+				continue;
+			}
+		}
+		
+		++list->visible;
+		list->vertices += meshlet->vertex_count;
+		list->indices += meshlet->triangle_count * 3;
+		_meshlet_list_push(list, meshlet);
+	}
+}
+
+void meshlet_draw(meshlet_mesh_t *mesh, meshlet_draw_list_t *list) {
+	if (!list->range_count) {
+		return;
+	}
+	
+	int32_t old_vao = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+	
+	glBindVertexArray(mesh->vao);
+	glMultiDrawElements(GL_TRIANGLES, list->counts, GL_UNSIGNED_INT, (const void *const *)list->offsets, (int32_t)list->range_count);
+	glBindVertexArray(old_vao);
+	
+	render_statistics_add((render_statistics_t){ .draw_calls = 1, .vertices = list->vertices, .indices = list->indices });
+}
+
+void meshlet_draw_all(meshlet_mesh_t *mesh) {
+	if (!mesh->meshlet_count) {
+		return;
+	}
+	
+	int32_t old_vao = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+	
+	glBindVertexArray(mesh->vao);
+	glDrawElements(GL_TRIANGLES, (int32_t)mesh->mesh.curr_index, GL_UNSIGNED_INT, NULL);
+	glBindVertexArray(old_vao);
+	
+	render_statistics_add((render_statistics_t){ .draw_calls = 1, .vertices = mesh->mesh.curr_vertex, .indices = mesh->mesh.curr_index });
+}
+
+void meshlet_draw_list_delete(meshlet_draw_list_t *list) {
+	free(list->counts);
+	free(list->offsets);
+	ZERO_MEMORY(list);
+}
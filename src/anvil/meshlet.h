@@ -0,0 +1,59 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include "base.h"
+#include "math.h"
+#include "render.h"
+
+//
+// meshlets
+//
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+typedef struct meshlet {
+	uint32_t vertex_offset, triangle_offset, index_offset;
+	uint32_t vertex_count, triangle_count;
+	vec3_t center;                      // bounding sphere
+	float32_t radius;
+	vec3_t cone_apex, cone_axis;        // normal cone, every triangle faces away from a camera inside it
+	float32_t cone_cutoff;              // 1 when the cone is too wide to ever cull
+} meshlet_t;
+
+// the source mesh keeps its vertices, clusters index into them through vertices and
+// then through their local byte triangles. the element buffer holds the same triangles flattened
+typedef struct meshlet_mesh {
+	mesh_t mesh;
+	uint32_t meshlet_count;
+	meshlet_t *meshlets;
+	uint32_t *vertices;
+	uint8_t *triangles;
+	uint32_t vao, vbo, ebo;
+} meshlet_mesh_t;
+
+// contiguous visible clusters are merged into a single range
+typedef struct meshlet_draw_list {
+	int32_t *counts;
+	void **offsets;
+	uint32_t range_count, capacity;
+	uint32_t visible, frustum_culled, backface_culled;
+	uint32_t vertices, indices;         // of the visible clusters
+} meshlet_draw_list_t;
+
+// greedy clustering that grows each meshlet through triangles sharing its vertices
+meshlet_mesh_t meshlet_mesh_build(mesh_t mesh);
+meshlet_mesh_t meshlet_mesh_load(string_t path);
+void meshlet_mesh_delete(meshlet_mesh_t *mesh);
+
+// xform may scale, but uniformly. camera_pos is in world space
+void meshlet_cull(meshlet_mesh_t *mesh, matrix_t xform, matrix_t view_projection, vec3_t camera_pos, meshlet_draw_list_t *list);
+
+// one multi draw of the list, the shader binds its own uniforms
+void meshlet_draw(meshlet_mesh_t *mesh, meshlet_draw_list_t *list);
+
+// every cluster in a single draw, to compare against culling
+void meshlet_draw_all(meshlet_mesh_t *mesh);
+void meshlet_draw_list_delete(meshlet_draw_list_t *list);
+
+#endif // MESHLET_H
@@ -0,0 +1,409 @@
+#include "base.h"
+#include "core.h"
+#include "math.h"
+#include "render.h"
+#include "job.h"
+#include "occlusion.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OCCLUSION_SIMD 1
+#endif
+
+//
+// software occlusion culling
+//
+
+#define OCCLUSION_TILES_X (OCCLUSION_WIDTH / OCCLUSION_TILE)
+#define OCCLUSION_TILES_Y (OCCLUSION_HEIGHT / OCCLUSION_TILE)
+
+typedef enum occlusion_result {
+	OCCLUSION_VISIBLE,
+	OCCLUSION_FRUSTUM,
+	OCCLUSION_OCCLUDED
+} occlusion_result_e;
+
+typedef struct occlusion_occluder {
+	mesh_t *mesh;
+	matrix_t mvp;
+	uint32_t first_vertex, first_triangle;
+} occlusion_occluder_t;
+
+// edge functions E = a * x + b * y + c are positive inside, depth is a plane in screen space
+typedef struct occlusion_triangle {
+	float32_t edge[3][3];
+	float32_t depth[3];
+	int32_t min_x, min_y, max_x, max_y;
+	bool8_t valid;
+} occlusion_triangle_t;
+
+global struct {
+	float32_t *depth;
+	float32_t hiz[OCCLUSION_TILES_X * OCCLUSION_TILES_Y];
+	matrix_t view_projection;
+	
+	occlusion_occluder_t occluders[OCCLUSION_MAX_OCCLUDERS];
+	uint32_t occluder_count, vertex_count, triangle_count;
+	
+	vec4_t *vertices;
+	occlusion_triangle_t *triangles;
+	uint32_t vertex_capacity, triangle_capacity;
+	
+	uint8_t *results;
+	uint32_t result_capacity;
+	
+	occlusion_statistics_t stats;
+} _occlusion;
+
+void occlusion_init() {
+	_occlusion.depth = malloc(OCCLUSION_WIDTH * OCCLUSION_HEIGHT * sizeof(float32_t));
+}
+
+void occlusion_close() {
+	free(_occlusion.depth);
+	free(_occlusion.vertices);
+	free(_occlusion.triangles);
+	free(_occlusion.results);
+	ZERO_MEMORY(&_occlusion);
+}
+
+void occlusion_begin(matrix_t view, matrix_t projection) {
+	_occlusion.view_projection = matrix_mul(view, projection);
+	_occlusion.occluder_count = 0;
+	_occlusion.vertex_count = 0;
+	_occlusion.triangle_count = 0;
+	ZERO_MEMORY(&_occlusion.stats);
+}
+
+void occlusion_occluder(mesh_t *mesh, matrix_t xform) {
+	if (_occlusion.occluder_count >= OCCLUSION_MAX_OCCLUDERS) {
+		return;
+	}
+	
+	_occlusion.occluders[_occlusion.occluder_count++] = (occlusion_occluder_t){
+		mesh, matrix_mul(xform, _occlusion.view_projection), _occlusion.vertex_count, _occlusion.triangle_count
+	};
+	
+	_occlusion.vertex_count += mesh->curr_vertex;
+	_occlusion.triangle_count += mesh->curr_index / 3;
+}
+
+// transform and triangle setup, one job per occluder
+internal void _occlusion_setup(void *data, uint32_t start, uint32_t end) {
+	UNUSED(data);
+	
+	for (uint32_t o = start; o < end; ++o) {
+		occlusion_occluder_t *occluder = &_occlusion.occluders[o];
+		mesh_t *mesh = occluder->mesh;
+		vec4_t *v = &_occlusion.vertices[occluder->first_vertex];
+		
+		// screen space x/y, depth in [0, 1], w < 0 marks vertices in front of the near plane
+		for (uint32_t i = 0; i < mesh->curr_vertex; ++i) {
+			vec3_t p = mesh->vertices[i].pos;
+			vec4_t clip = matrix_transform(occluder->mvp, (vec4_t){ p.x, p.y, p.z, 1.0f });
+			
+			if (clip.w <= 0.0f || clip.z < -clip.w) {
+				v[i] = (vec4_t){ 0.0f, 0.0f, 0.0f, -1.0f };
+				continue;
+			}
+			
+			float32_t inv_w = 1.0f / clip.w;
+			v[i] = (vec4_t){
+				(clip.x * inv_w * 0.5f + 0.5f) * OCCLUSION_WIDTH,
+				(clip.y * inv_w * 0.5f + 0.5f) * OCCLUSION_HEIGHT,
+				clip.z * inv_w * 0.5f + 0.5f,
+				1.0f
+			};
+		}
+		
+		for (uint32_t t = 0; t < mesh->curr_index / 3; ++t) {
+			occlusion_triangle_t *tri = &_occlusion.triangles[occluder->first_triangle + t];
+			vec4_t a = v[mesh->indices[t * 3 + 0]];
+			vec4_t b = v[mesh->indices[t * 3 + 1]];
+			vec4_t c = v[mesh->indices[t * 3 + 2]];
+			
+			// near plane crossing triangles are skipped, an occluder may only ever hide less
+			tri->valid = false;
+			if (a.w < 0.0f || b.w < 0.0f || c.w < 0.0f) {
+				continue;
+			}
+			
+			// both windings are occluders
+			float32_t area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+			if (area < 0.0f) {
+				vec4_t swap = b;
+				b = c;
+				c = swap;
+				area = -area;
+			}
+			
+			if (area < 1e-6f) {
+				continue;
+			}
+			
+			tri->min_x = MAX((int32_t)floorf(MIN(MIN(a.x, b.x), c.x)), 0);
+			tri->min_y = MAX((int32_t)floorf(MIN(MIN(a.y, b.y), c.y)), 0);
+			tri->max_x = MIN((int32_t)ceilf(MAX(MAX(a.x, b.x), c.x)), OCCLUSION_WIDTH - 1);
+			tri->max_y = MIN((int32_t)ceilf(MAX(MAX(a.y, b.y), c.y)), OCCLUSION_HEIGHT - 1);
+			
+			if (tri->min_x > tri->max_x || tri->min_y > tri->max_y) {
+				continue;
+			}
+			
+			vec4_t verts[3] = { a, b, c };
+			float32_t inv_area = 1.0f / area;
+			tri->depth[0] = tri->depth[1] = tri->depth[2] = 0.0f;
+			
+			for (uint32_t e = 0; e < 3; ++e) {
+				vec4_t p0 = verts[e], p1 = verts[(e + 1) % 3];
+				float32_t ea = -(p1.y - p0.y);
+				float32_t eb = p1.x - p0.x;
+				float32_t ec = -ea * p0.x - eb * p0.y;
+				
+				tri->edge[e][0] = ea;
+				tri->edge[e][1] = eb;
+				tri->edge[e][2] = ec;
+				
+				// the edge opposite a vertex is its barycentric weight
+				float32_t z = verts[(e + 2) % 3].z * inv_area;
+				tri->depth[0] += ea * z;
+				tri->depth[1] += eb * z;
+				tri->depth[2] += ec * z;
+			}
+			
+			tri->valid = true;
+		}
+	}
+}
+
+// rasterizes every triangle into one horizontal band and builds its hi-z tiles
+internal void _occlusion_raster(void *data, uint32_t start, uint32_t end) {
+	UNUSED(data);
+	
+	for (uint32_t band = start; band < end; ++band) {
+		int32_t band_min = band * (OCCLUSION_HEIGHT / OCCLUSION_BANDS);
+		int32_t band_max = band_min + (OCCLUSION_HEIGHT / OCCLUSION_BANDS) - 1;
+		
+		for (int32_t i = band_min * OCCLUSION_WIDTH; i < (band_max + 1) * OCCLUSION_WIDTH; ++i) {
+			_occlusion.depth[i] = 1.0f;
+		}
+		
+		for (uint32_t t = 0; t < _occlusion.triangle_count; ++t) {
+			occlusion_triangle_t *tri = &_occlusion.triangles[t];
+			if (!tri->valid || tri->max_y < band_min || tri->min_y > band_max) {
+				continue;
+			}
+			
+			int32_t y0 = MAX(tri->min_y, band_min), y1 = MIN(tri->max_y, band_max);
+			int32_t x0 = tri->min_x & ~3, x1 = tri->max_x;
+
+#if OCCLUSION_SIMD
+			__m128 e_a[3], e_b[3], e_c[3];
+			for (uint32_t e = 0; e < 3; ++e) {
+				e_a[e] = _mm_set1_ps(tri->edge[e][0]);
+				e_b[e] = _mm_set1_ps(tri->edge[e][1]);
+				e_c[e] = _mm_set1_ps(tri->edge[e][2]);
+			}
+			
+			__m128 z_a = _mm_set1_ps(tri->depth[0]), z_b = _mm_set1_ps(tri->depth[1]), z_c = _mm_set1_ps(tri->depth[2]);
+			__m128 zero = _mm_setzero_ps();
+			
+			for (int32_t y = y0; y <= y1; ++y) {
+				__m128 py = _mm_set1_ps(y + 0.5f);
+				float32_t *row = &_occlusion.depth[y * OCCLUSION_WIDTH];
+				
+				for (int32_t x = x0; x <= x1; x += 4) {
+					__m128 px = _mm_add_ps(_mm_set1_ps((float32_t)x), _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f));
+					__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e_a[0], px), _mm_mul_ps(e_b[0], py)), e_c[0]), zero);
+					inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e_a[1], px), _mm_mul_ps(e_b[1], py)), e_c[1]), zero));
+					inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e_a[2], px), _mm_mul_ps(e_b[2], py)), e_c[2]), zero));
+					
+					if (!_mm_movemask_ps(inside)) {
+						continue;
+					}
+					
+					__m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(z_a, px), _mm_mul_ps(z_b, py)), z_c);
+					__m128 old = _mm_loadu_ps(row + x);
+					__m128 closest = _mm_min_ps(old, z);
+					_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closest), _mm_andnot_ps(inside, old)));
+				}
+			}
+#else
+			for (int32_t y = y0; y <= y1; ++y) {
+				float32_t py = y + 0.5f;
+				float32_t *row = &_occlusion.depth[y * OCCLUSION_WIDTH];
+				
+				for (int32_t x = x0; x <= x1; ++x) {
+					float32_t px = x + 0.5f;
+					bool8_t inside = true;
+					for (uint32_t e = 0; e < 3; ++e) {
+						inside &= tri->edge[e][0] * px + tri->edge[e][1] * py + tri->edge[e][2] >= 0.0f;
+					}
+					
+					if (inside) {
+						float32_t z = tri->depth[0] * px + tri->depth[1] * py + tri->depth[2];
+						row[x] = MIN(row[x], z);
+					}
+				}
+			}
+#endif
+		}
+		
+		// farthest depth of every tile in this band
+		for (int32_t ty = band_min / OCCLUSION_TILE; ty <= band_max / OCCLUSION_TILE; ++ty) {
+			for (int32_t tx = 0; tx < OCCLUSION_TILES_X; ++tx) {
+				float32_t farthest = 0.0f;
+				for (int32_t y = ty * OCCLUSION_TILE; y < (ty + 1) * OCCLUSION_TILE; ++y) {
+					for (int32_t x = tx * OCCLUSION_TILE; x < (tx + 1) * OCCLUSION_TILE; ++x) {
+						farthest = MAX(farthest, _occlusion.depth[y * OCCLUSION_WIDTH + x]);
+					}
+				}
+				
+				_occlusion.hiz[ty * OCCLUSION_TILES_X + tx] = farthest;
+			}
+		}
+	}
+}
+
+void occlusion_end() {
+	float64_t start_time = os_time();
+	
+	if (_occlusion.vertex_count > _occlusion.vertex_capacity) {
+		_occlusion.vertex_capacity = _occlusion.vertex_count * 2;
+		_occlusion.vertices = realloc(_occlusion.vertices, _occlusion.vertex_capacity * sizeof(vec4_t));
+	}
+	
+	if (_occlusion.triangle_count > _occlusion.triangle_capacity) {
+		_occlusion.triangle_capacity = _occlusion.triangle_count * 2;
+		_occlusion.triangles = realloc(_occlusion.triangles, _occlusion.triangle_capacity * sizeof(occlusion_triangle_t));
+	}
+	
+	job_parallel_for(_occlusion.occluder_count, 4, _occlusion_setup, NULL);
+	job_parallel_for(OCCLUSION_BANDS, 1, _occlusion_raster, NULL);
+	
+	_occlusion.stats.occluders = _occlusion.occluder_count;
+	_occlusion.stats.triangles = _occlusion.triangle_count;
+	_occlusion.stats.raster_time = os_time() - start_time;
+}
+
+internal occlusion_result_e _occlusion_test(range3_t bounds, matrix_t xform) {
+	matrix_t mvp = matrix_mul(xform, _occlusion.view_projection);
+	uint32_t outside[6] = { 0 };
+	float32_t min_x = FLT_MAX, min_y = FLT_MAX, max_x = -FLT_MAX, max_y = -FLT_MAX, min_z = FLT_MAX;
+	bool8_t crosses_near = false;
+	
+	for (uint32_t i = 0; i < 8; ++i) {
+		vec4_t corner = {
+			(i & 1) ? bounds.max.x : bounds.min.x,
+			(i & 2) ? bounds.max.y : bounds.min.y,
+			(i & 4) ? bounds.max.z : bounds.min.z,
+			1.0f
+		};
+		
+		vec4_t clip = matrix_transform(mvp, corner);
+		outside[0] += clip.x < -clip.w;
+		outside[1] += clip.x > clip.w;
+		outside[2] += clip.y < -clip.w;
+		outside[3] += clip.y > clip.w;
+		outside[4] += clip.z < -clip.w;
+		outside[5] += clip.z > clip.w;
+		
+		if (clip.w <= 0.0f || clip.z < -clip.w) {
+			crosses_near = true;
+			continue;
+		}
+		
+		float32_t inv_w = 1.0f / clip.w;
+		min_x = MIN(min_x, clip.x * inv_w);
+		max_x = MAX(max_x, clip.x * inv_w);
+		min_y = MIN(min_y, clip.y * inv_w);
+		max_y = MAX(max_y, clip.y * inv_w);
+		min_z = MIN(min_z, clip.z * inv_w * 0.5f + 0.5f);
+	}
+	
+	for (uint32_t p = 0; p < 6; ++p) {
+		if (outside[p] == 8) {
+			return OCCLUSION_FRUSTUM;
+		}
+	}
+	
+	// boxes touching the camera are always visible
+	if (crosses_near) {
+		return OCCLUSION_VISIBLE;
+	}
+	
+	int32_t tx0 = (int32_t)((min_x * 0.5f + 0.5f) * OCCLUSION_WIDTH) / OCCLUSION_TILE;
+	int32_t tx1 = (int32_t)((max_x * 0.5f + 0.5f) * OCCLUSION_WIDTH) / OCCLUSION_TILE;
+	int32_t ty0 = (int32_t)((min_y * 0.5f + 0.5f) * OCCLUSION_HEIGHT) / OCCLUSION_TILE;
+	int32_t ty1 = (int32_t)((max_y * 0.5f + 0.5f) * OCCLUSION_HEIGHT) / OCCLUSION_TILE;
+	
+	tx0 = MAX(tx0, 0);
+	ty0 = MAX(ty0, 0);
+	tx1 = MIN(tx1, OCCLUSION_TILES_X - 1);
+	ty1 = MIN(ty1, OCCLUSION_TILES_Y - 1);
+	
+	// occluded only if every covered tile is closer than the nearest point of the box
+	for (int32_t ty = ty0; ty <= ty1; ++ty) {
+		for (int32_t tx = tx0; tx <= tx1; ++tx) {
+			if (_occlusion.hiz[ty * OCCLUSION_TILES_X + tx] >= min_z) {
+				return OCCLUSION_VISIBLE;
+			}
+		}
+	}
+	
+	return OCCLUSION_OCCLUDED;
+}
+
+internal void _occlusion_count(occlusion_result_e result) {
+	++_occlusion.stats.tested;
+	_occlusion.stats.frustum_culled += (result == OCCLUSION_FRUSTUM);
+	_occlusion.stats.occluded += (result == OCCLUSION_OCCLUDED);
+}
+
+bool8_t occlusion_test(range3_t bounds, matrix_t xform) {
+	float64_t start_time = os_time();
+	occlusion_result_e result = _occlusion_test(bounds, xform);
+	
+	_occlusion_count(result);
+	_occlusion.stats.test_time += os_time() - start_time;
+	return result == OCCLUSION_VISIBLE;
+}
+
+typedef struct occlusion_batch {
+	range3_t *bounds;
+	matrix_t *xforms;
+} occlusion_batch_t;
+
+internal void _occlusion_test_batch(void *data, uint32_t start, uint32_t end) {
+	occlusion_batch_t *batch = (occlusion_batch_t *)data;
+	for (uint32_t i = start; i < end; ++i) {
+		_occlusion.results[i] = (uint8_t)_occlusion_test(batch->bounds[i], batch->xforms[i]);
+	}
+}
+
+void occlusion_test_batch(range3_t *bounds, matrix_t *xforms, uint32_t count, bool8_t *visible) {
+	float64_t start_time = os_time();
+	
+	if (count > _occlusion.result_capacity) {
+		_occlusion.result_capacity = count * 2;
+		_occlusion.results = realloc(_occlusion.results, _occlusion.result_capacity);
+	}
+	
+	occlusion_batch_t batch = { bounds, xforms };
+	job_parallel_for(count, 64, _occlusion_test_batch, &batch);
+	
+	for (uint32_t i = 0; i < count; ++i) {
+		_occlusion_count((occlusion_result_e)_occlusion.results[i]);
+		visible[i] = _occlusion.results[i] == OCCLUSION_VISIBLE;
+	}
+	
+	_occlusion.stats.test_time += os_time() - start_time;
+}
+
+occlusion_statistics_t occlusion_statistics_get() {
+	return _occlusion.stats;
+}
+
+float32_t *occlusion_depth_buffer() {
+	return _occlusion.depth;
+}
@@ -0,0 +1,45 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include "base.h"
+#include "math.h"
+#include "render.h"
+
+//
+// software occlusion culling
+//
+
+// small depth buffer, width a multiple of 4 and both a multiple of the hi-z tile
+#define OCCLUSION_WIDTH  320
+#define OCCLUSION_HEIGHT 192
+#define OCCLUSION_TILE   8
+#define OCCLUSION_BANDS  8
+
+#define OCCLUSION_MAX_OCCLUDERS 256
+
+typedef struct occlusion_statistics {
+	uint32_t occluders, triangles;
+	uint32_t tested, frustum_culled, occluded;
+	float64_t raster_time, test_time;
+} occlusion_statistics_t;
+
+void occlusion_init();
+void occlusion_close();
+
+// clears the depth buffer and the occluder list for this camera
+void occlusion_begin(matrix_t view, matrix_t projection);
+
+// low poly occluder, only the vertex positions are used, must stay alive until occlusion_end
+void occlusion_occluder(mesh_t *mesh, matrix_t xform);
+
+// rasterizes the occluders on the job threads and builds the hi-z buffer
+void occlusion_end();
+
+// false when the box is outside the frustum or behind the occluders
+bool8_t occlusion_test(range3_t bounds, matrix_t xform);
+void occlusion_test_batch(range3_t *bounds, matrix_t *xforms, uint32_t count, bool8_t *visible);
+
+occlusion_statistics_t occlusion_statistics_get();
+float32_t *occlusion_depth_buffer();
+
+#endif // OCCLUSION_H
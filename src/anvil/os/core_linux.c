@@ -5,10 +5,14 @@
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/Xatom.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
 #define GLAD_GL_IMPLEMENTATION
 #include "../extern/glad.h"
 #include <GL/glx.h>
 #include <time.h>
+#include <pthread.h>
+#include <unistd.h>
 
 //
 // OS
@@ -16,6 +20,7 @@
 
 // globals
 global Atom _wm_delete_message;
+global bool8_t _gl_headless;
 
 
 // glx extensions
@@ -78,17 +83,193 @@ void os_message(os_message_icon_e icon, string_t format, ...) {
 }
 
 
+// threads
+struct os_thread {
+	pthread_t handle;
+	os_thread_proc_t proc;
+	void *data;
+};
+
+struct os_mutex {
+	pthread_mutex_t handle;
+};
+
+struct os_condition {
+	pthread_cond_t handle;
+};
+
+internal void *_os_thread_entry(void *param) {
+	os_thread_o *thread = (os_thread_o *)param;
+	thread->proc(thread->data);
+	return NULL;
+}
+
+os_thread_o *os_thread_create(os_thread_proc_t proc, void *data) {
+	os_thread_o *thread = malloc(sizeof(os_thread_o));
+	thread->proc = proc;
+	thread->data = data;
+	
+	if (pthread_create(&thread->handle, NULL, _os_thread_entry, thread) != 0) {
+		os_message(OS_MESSAGE_ERROR, "Failed to create thread");
+		free(thread);
+		return NULL;
+	}
+	
+	return thread;
+}
+
+void os_thread_join(os_thread_o *thread) {
+	if (thread) {
+		pthread_join(thread->handle, NULL);
+		free(thread);
+	}
+}
+
+uint32_t os_thread_hardware_count() {
+	int64_t count = sysconf(_SC_NPROCESSORS_ONLN);
+	return (count > 0) ? (uint32_t)count : 1;
+}
+
+os_mutex_o *os_mutex_create() {
+	os_mutex_o *mutex = malloc(sizeof(os_mutex_o));
+	pthread_mutex_init(&mutex->handle, NULL);
+	return mutex;
+}
+
+void os_mutex_delete(os_mutex_o *mutex) {
+	if (mutex) {
+		pthread_mutex_destroy(&mutex->handle);
+		free(mutex);
+	}
+}
+
+void os_mutex_lock(os_mutex_o *mutex) {
+	pthread_mutex_lock(&mutex->handle);
+}
+
+void os_mutex_unlock(os_mutex_o *mutex) {
+	pthread_mutex_unlock(&mutex->handle);
+}
+
+os_condition_o *os_condition_create() {
+	os_condition_o *condition = malloc(sizeof(os_condition_o));
+	pthread_cond_init(&condition->handle, NULL);
+	return condition;
+}
+
+void os_condition_delete(os_condition_o *condition) {
+	if (condition) {
+		pthread_cond_destroy(&condition->handle);
+		free(condition);
+	}
+}
+
+void os_condition_wait(os_condition_o *condition, os_mutex_o *mutex) {
+	pthread_cond_wait(&condition->handle, &mutex->handle);
+}
+
+void os_condition_signal(os_condition_o *condition) {
+	pthread_cond_signal(&condition->handle);
+}
+
+void os_condition_broadcast(os_condition_o *condition) {
+	pthread_cond_broadcast(&condition->handle);
+}
+
+
 // window
 struct os_window {
     Display *display;
     Window root;
     Window handle;
     GLXContext context;
+	
+	// headless, pbuffer of the window size on a surfaceless egl display
+	bool8_t headless;
+	uint16_t width, height;
+	EGLDisplay egl_display;
+	EGLSurface egl_surface;
+	EGLContext egl_context;
 };
 
+internal os_window_o *_os_window_create_headless(os_window_o *window, uint16_t width, uint16_t height) {
+	window->headless = true;
+	_gl_headless = true;
+	window->width = width;
+	window->height = height;
+	
+	// surfaceless needs no display server or gpu, mesa falls back to llvmpipe
+	PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (eglGetPlatformDisplayEXT) {
+		window->egl_display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	
+	if (!window->egl_display) {
+		window->egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	
+	if (!window->egl_display || !eglInitialize(window->egl_display, NULL, NULL)) {
+		os_message(OS_MESSAGE_ERROR, "Failed to initialize EGL");
+		exit(EXIT_FAILURE);
+	}
+	
+	EGLConfig config;
+	EGLint config_count = 0;
+	eglChooseConfig(window->egl_display, (EGLint[]){
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_ALPHA_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE
+	}, &config, 1, &config_count);
+	
+	if (!config_count) {
+		os_message(OS_MESSAGE_ERROR, "Failed to choose EGL config");
+		exit(EXIT_FAILURE);
+	}
+	
+	window->egl_surface = eglCreatePbufferSurface(window->egl_display, config, (EGLint[]){
+		EGL_WIDTH, width,
+		EGL_HEIGHT, height,
+		EGL_NONE
+	});
+	
+	eglBindAPI(EGL_OPENGL_API);
+	window->egl_context = eglCreateContext(window->egl_display, config, EGL_NO_CONTEXT, (EGLint[]){
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	});
+	
+	if (window->egl_surface == EGL_NO_SURFACE || window->egl_context == EGL_NO_CONTEXT) {
+		os_message(OS_MESSAGE_ERROR, "Unable to create headless GL context");
+		exit(EXIT_FAILURE);
+	}
+	
+	eglMakeCurrent(window->egl_display, window->egl_surface, window->egl_surface, window->egl_context);
+	
+	if (!gladLoadGL((GLADloadfunc)eglGetProcAddress)) {
+		os_message(OS_MESSAGE_ERROR, "Failed to load OpenGL");
+		exit(EXIT_FAILURE);
+	}
+	
+	return window;
+}
+
 os_window_o *os_window_create(const string_t title, uint16_t width, uint16_t height, int32_t x, int32_t y, uint32_t flags) {
     os_window_o *window = (os_window_o *)malloc(sizeof(os_window_o));
+    ZERO_MEMORY(window);
+    
+    if (flags & OS_WINDOW_HEADLESS) {
+		return _os_window_create_headless(window, width, height);
+	}
     
+    // the display is shared with a render thread that swaps buffers
+    XInitThreads();
     window->display = XOpenDisplay(NULL);
     window->root = XDefaultRootWindow(window->display);
     
@@ -160,21 +341,57 @@ os_window_o *os_window_create(const string_t title, uint16_t width, uint16_t hei
 }
 
 void os_window_delete(os_window_o *window) {
+	if (window->headless) {
+		eglMakeCurrent(window->egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(window->egl_display, window->egl_context);
+		eglDestroySurface(window->egl_display, window->egl_surface);
+		eglTerminate(window->egl_display);
+		free(window);
+		return;
+	}
+    
     glXDestroyContext(window->display, window->context);
     XCloseDisplay(window->display);
     free(window);
 }
 
 void os_window_swap_buffers(os_window_o *window) {
+	if (window->headless) {
+		eglSwapBuffers(window->egl_display, window->egl_surface);
+		return;
+	}
+    
     glXSwapBuffers(window->display, window->handle);
 }
 
 void os_window_vsync(os_window_o *window, bool8_t enabled) {
-	if (window) {
+	if (window && !window->headless) {
 		glXSwapIntervalSGI(enabled);
 	}
 }
 
+void os_window_make_current(os_window_o *window, bool8_t current) {
+	if (window->headless) {
+		if (current) {
+			eglMakeCurrent(window->egl_display, window->egl_surface, window->egl_surface, window->egl_context);
+		} else {
+			eglMakeCurrent(window->egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		}
+	} else if (current) {
+		glXMakeCurrent(window->display, window->handle, window->context);
+	} else {
+		glXMakeCurrent(window->display, None, NULL);
+	}
+}
+
+void *os_gl_proc(string_t name) {
+	if (_gl_headless) {
+		return (void *)eglGetProcAddress(name);
+	}
+	
+	return (void *)glXGetProcAddressARB((const GLubyte *)name);
+}
+
 
 // event
 internal void _os_event_process(os_window_o *window, os_event_t *event, XEvent *xev) {
@@ -258,6 +475,13 @@ internal void _os_event_process(os_window_o *window, os_event_t *event, XEvent *
 void os_event_pull(os_window_o *window, os_event_t *event) {
     memcpy(_last_keyboard, _curr_keyboard, KEY_COUNT);
 	
+	// no events without a window, the size never changes
+	if (window->headless) {
+		event->width = window->width;
+		event->height = window->height;
+		return;
+	}
+    
     XEvent xev = { 0 };
 	while (XPending(window->display) > 0) {
 		XNextEvent(window->display, &xev);
@@ -70,6 +70,97 @@ void os_message(os_message_icon_e icon, string_t format, ...) {
 }
 
 
+// threads
+struct os_thread {
+	HANDLE handle;
+	os_thread_proc_t proc;
+	void *data;
+};
+
+struct os_mutex {
+	SRWLOCK handle;
+};
+
+struct os_condition {
+	CONDITION_VARIABLE handle;
+};
+
+internal DWORD WINAPI _os_thread_entry(LPVOID param) {
+	os_thread_o *thread = (os_thread_o *)param;
+	thread->proc(thread->data);
+	return 0;
+}
+
+os_thread_o *os_thread_create(os_thread_proc_t proc, void *data) {
+	os_thread_o *thread = malloc(sizeof(os_thread_o));
+	thread->proc = proc;
+	thread->data = data;
+	thread->handle = CreateThread(NULL, 0, _os_thread_entry, thread, 0, NULL);
+	
+	if (!thread->handle) {
+		os_message(OS_MESSAGE_ERROR, "Failed to create thread");
+		free(thread);
+		return NULL;
+	}
+	
+	return thread;
+}
+
+void os_thread_join(os_thread_o *thread) {
+	if (thread) {
+		WaitForSingleObject(thread->handle, INFINITE);
+		CloseHandle(thread->handle);
+		free(thread);
+	}
+}
+
+uint32_t os_thread_hardware_count() {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return MAX(info.dwNumberOfProcessors, 1);
+}
+
+os_mutex_o *os_mutex_create() {
+	os_mutex_o *mutex = malloc(sizeof(os_mutex_o));
+	InitializeSRWLock(&mutex->handle);
+	return mutex;
+}
+
+void os_mutex_delete(os_mutex_o *mutex) {
+	free(mutex);
+}
+
+void os_mutex_lock(os_mutex_o *mutex) {
+	AcquireSRWLockExclusive(&mutex->handle);
+}
+
+void os_mutex_unlock(os_mutex_o *mutex) {
+	ReleaseSRWLockExclusive(&mutex->handle);
+}
+
+os_condition_o *os_condition_create() {
+	os_condition_o *condition = malloc(sizeof(os_condition_o));
+	InitializeConditionVariable(&condition->handle);
+	return condition;
+}
+
+void os_condition_delete(os_condition_o *condition) {
+	free(condition);
+}
+
+void os_condition_wait(os_condition_o *condition, os_mutex_o *mutex) {
+	SleepConditionVariableSRW(&condition->handle, &mutex->handle, INFINITE, 0);
+}
+
+void os_condition_signal(os_condition_o *condition) {
+	WakeConditionVariable(&condition->handle);
+}
+
+void os_condition_broadcast(os_condition_o *condition) {
+	WakeAllConditionVariable(&condition->handle);
+}
+
+
 // window
 struct os_window {
     WNDCLASSEXA wc;
@@ -302,6 +393,11 @@ os_window_o * os_window_create(const string_t title, uint16_t width, uint16_t he
 		glViewport(viewport.min.x, viewport.min.y, viewport.max.x, viewport.max.y);
 	}
 	
+	// headless keeps the window hidden, the context still renders into its back buffer
+	if (flags & OS_WINDOW_HEADLESS) {
+		return window;
+	}
+	
 	ShowWindow(window->handle, SW_SHOW);
 	SetForegroundWindow(window->handle);
 	return window;
@@ -329,6 +425,18 @@ void os_window_vsync(os_window_o *window, bool8_t enabled) {
 	}
 }
 
+void os_window_make_current(os_window_o *window, bool8_t current) {
+	if (current) {
+		wglMakeCurrent(window->device, window->context);
+	} else {
+		wglMakeCurrent(NULL, NULL);
+	}
+}
+
+void *os_gl_proc(string_t name) {
+	return (void *)wglGetProcAddress(name);
+}
+
 
 // event
 void os_event_pull(os_window_o *window, os_event_t *event) {
@@ -0,0 +1,403 @@
+#include "base.h"
+#include "core.h"
+#include "math.h"
+#include "render.h"
+#include "job.h"
+#include "particle.h"
+#include <glad.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PARTICLE_SIMD 1
+#endif
+
+//
+// particles
+//
+
+global struct {
+	shader_t shader, feedback_shader;
+	uint32_t vao, quad_buffer;
+	uint32_t feedback_vao;
+	
+	// current update, read by the job batches
+	float32_t dt;
+	uint32_t *dead;
+	uint32_t dead_capacity;
+} _particle;
+
+const string_t _particle_source = "#ifdef VERTEX_SHADER\n\nlayout (location = 0) in vec2 corner;\nlayout (location = 4) in vec4 particle;\n\nuniform mat4 projection;\nuniform mat4 view;\nuniform vec4 color_start;\nuniform vec4 color_end;\nuniform vec2 size;\n\nout vec4 color;\nout vec2 uv;\n\nvoid main() {\n	float age = particle.w;\n	if (age < 0.0 || age >= 1.0) {\n		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n		return;\n	}\n	\n	vec3 right = vec3(view[0][0], view[1][0], view[2][0]);\n	vec3 up = vec3(view[0][1], view[1][1], view[2][1]);\n	vec3 pos = particle.xyz + (right * corner.x + up * corner.y) * mix(size.x, size.y, age);\n	\n	gl_Position = projection * view * vec4(pos, 1.0);\n	color = mix(color_start, color_end, age);\n	uv = corner + 0.5;\n}\n\n#else\n\nin vec4 color;\nin vec2 uv;\n\nout vec4 frag_color;\n\nvoid main() {\n	float falloff = 1.0 - smoothstep(0.3, 0.5, length(uv - 0.5));\n	frag_color = vec4(color.rgb, color.a * falloff);\n}\n\n#endif";
+
+const string_t _particle_feedback_source = "#ifdef VERTEX_SHADER\n\nlayout (location = 0) in vec4 pos_age;\nlayout (location = 1) in vec4 vel_life;\n\nuniform float dt;\nuniform vec3 gravity;\nuniform float drag;\nuniform uint spawn_start;\nuniform uint spawn_count;\nuniform uint capacity;\nuniform uint seed;\nuniform vec3 emitter_pos;\nuniform vec3 spread;\nuniform vec3 velocity;\nuniform vec3 velocity_spread;\nuniform vec2 life;\n\nout vec4 out_pos_age;\nout vec4 out_vel_life;\n\nuint hash(uint x) {\n	x ^= x >> 16u; x *= 0x7feb352du;\n	x ^= x >> 15u; x *= 0x846ca68bu;\n	x ^= x >> 16u;\n	return x;\n}\n\nfloat random(inout uint state) {\n	state = hash(state);\n	return float(state & 0xffffffu) / 16777216.0 * 2.0 - 1.0;\n}\n\nvoid main() {\n	uint id = uint(gl_VertexID);\n	vec3 pos = pos_age.xyz;\n	float age = pos_age.w;\n	vec3 vel = vel_life.xyz;\n	float max_life = vel_life.w;\n	\n	if (age >= 1.0) {\n		// dead particles inside this frame's spawn window come back\n		if ((id + capacity - spawn_start) % capacity < spawn_count) {\n			uint state = id * 1973u + seed * 9277u;\n			pos = emitter_pos + spread * vec3(random(state), random(state), random(state));\n			vel = velocity + velocity_spread * vec3(random(state), random(state), random(state));\n			max_life = mix(life.x, life.y, random(state) * 0.5 + 0.5);\n			age = 0.0;\n		}\n	} else {\n		vel = (vel + gravity * dt) * max(1.0 - drag * dt, 0.0);\n		pos += vel * dt;\n		age += dt / max_life;\n	}\n	\n	out_pos_age = vec4(pos, age);\n	out_vel_life = vec4(vel, max_life);\n}\n\n#else\n\nvoid main() {\n}\n\n#endif";
+
+// xorshift, the emitters keep their own state so updates never share one
+internal float32_t _particle_random(uint32_t *state) {
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return (float32_t)(x & 0xffffff) / 16777216.0f * 2.0f - 1.0f;
+}
+
+internal void _particle_spawn(particle_emitter_t *emitter, uint32_t count) {
+	particle_emitter_params_t *p = &emitter->params;
+	count = MIN(count, p->capacity - emitter->count);
+	
+	for (uint32_t i = emitter->count; i < emitter->count + count; ++i) {
+		emitter->pos_x[i] = p->pos.x + p->spread.x * _particle_random(&emitter->seed);
+		emitter->pos_y[i] = p->pos.y + p->spread.y * _particle_random(&emitter->seed);
+		emitter->pos_z[i] = p->pos.z + p->spread.z * _particle_random(&emitter->seed);
+		emitter->vel_x[i] = p->velocity.x + p->velocity_spread.x * _particle_random(&emitter->seed);
+		emitter->vel_y[i] = p->velocity.y + p->velocity_spread.y * _particle_random(&emitter->seed);
+		emitter->vel_z[i] = p->velocity.z + p->velocity_spread.z * _particle_random(&emitter->seed);
+		
+		float32_t life = p->life.min + (p->life.max - p->life.min) * (_particle_random(&emitter->seed) * 0.5f + 0.5f);
+		emitter->life[i] = MAX(life, 0.001f);
+		emitter->inv_life[i] = 1.0f / emitter->life[i];
+	}
+	
+	emitter->count += count;
+}
+
+// integrates a batch and writes its (pos, age) instances, counts the dead for the compaction
+internal void _particle_simulate(void *data, uint32_t start, uint32_t end) {
+	particle_emitter_t *e = data;
+	particle_emitter_params_t *p = &e->params;
+	float32_t dt = _particle.dt;
+	float32_t damping = MAX(1.0f - p->drag * dt, 0.0f);
+	
+	for (uint32_t batch = start; batch < end; ++batch) {
+		uint32_t first = batch * PARTICLE_BATCH;
+		uint32_t last = MIN(first + PARTICLE_BATCH, e->count);
+		uint32_t dead = 0;
+		uint32_t i = first;
+
+#if PARTICLE_SIMD
+		__m128 dt4 = _mm_set1_ps(dt), damping4 = _mm_set1_ps(damping);
+		__m128 gx = _mm_set1_ps(p->gravity.x * dt), gy = _mm_set1_ps(p->gravity.y * dt), gz = _mm_set1_ps(p->gravity.z * dt);
+		__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+		
+		for (; i + 4 <= last; i += 4) {
+			__m128 vx = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(e->vel_x + i), gx), damping4);
+			__m128 vy = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(e->vel_y + i), gy), damping4);
+			__m128 vz = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(e->vel_z + i), gz), damping4);
+			__m128 px = _mm_add_ps(_mm_loadu_ps(e->pos_x + i), _mm_mul_ps(vx, dt4));
+			__m128 py = _mm_add_ps(_mm_loadu_ps(e->pos_y + i), _mm_mul_ps(vy, dt4));
+			__m128 pz = _mm_add_ps(_mm_loadu_ps(e->pos_z + i), _mm_mul_ps(vz, dt4));
+			__m128 life = _mm_sub_ps(_mm_loadu_ps(e->life + i), dt4);
+			__m128 age = _mm_sub_ps(one, _mm_mul_ps(life, _mm_loadu_ps(e->inv_life + i)));
+			
+			_mm_storeu_ps(e->vel_x + i, vx);
+			_mm_storeu_ps(e->vel_y + i, vy);
+			_mm_storeu_ps(e->vel_z + i, vz);
+			_mm_storeu_ps(e->pos_x + i, px);
+			_mm_storeu_ps(e->pos_y + i, py);
+			_mm_storeu_ps(e->pos_z + i, pz);
+			_mm_storeu_ps(e->life + i, life);
+			
+			int32_t mask = _mm_movemask_ps(_mm_cmple_ps(life, zero));
+			dead += (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+			
+			// soa to the interleaved instance stream
+			_MM_TRANSPOSE4_PS(px, py, pz, age);
+			_mm_storeu_ps(e->instances + i * 4, px);
+			_mm_storeu_ps(e->instances + i * 4 + 4, py);
+			_mm_storeu_ps(e->instances + i * 4 + 8, pz);
+			_mm_storeu_ps(e->instances + i * 4 + 12, age);
+		}
+#endif
+		
+		for (; i < last; ++i) {
+			e->vel_x[i] = (e->vel_x[i] + p->gravity.x * dt) * damping;
+			e->vel_y[i] = (e->vel_y[i] + p->gravity.y * dt) * damping;
+			e->vel_z[i] = (e->vel_z[i] + p->gravity.z * dt) * damping;
+			e->pos_x[i] += e->vel_x[i] * dt;
+			e->pos_y[i] += e->vel_y[i] * dt;
+			e->pos_z[i] += e->vel_z[i] * dt;
+			e->life[i] -= dt;
+			dead += e->life[i] <= 0.0f;
+			
+			float32_t *instance = e->instances + i * 4;
+			instance[0] = e->pos_x[i];
+			instance[1] = e->pos_y[i];
+			instance[2] = e->pos_z[i];
+			instance[3] = 1.0f - e->life[i] * e->inv_life[i];
+		}
+		
+		_particle.dead[batch] = dead;
+	}
+}
+
+// moves the last alive particle into every dead slot, only batches that lost particles are scanned
+internal void _particle_compact(particle_emitter_t *e, uint32_t batches) {
+	for (uint32_t batch = batches; batch-- > 0;) {
+		if (!_particle.dead[batch]) {
+			continue;
+		}
+		
+		uint32_t first = batch * PARTICLE_BATCH;
+		uint32_t last = MIN(first + PARTICLE_BATCH, e->count);
+		
+		for (uint32_t i = last; i-- > first;) {
+			if (e->life[i] > 0.0f) {
+				continue;
+			}
+			
+			uint32_t end = --e->count;
+			e->pos_x[i] = e->pos_x[end];
+			e->pos_y[i] = e->pos_y[end];
+			e->pos_z[i] = e->pos_z[end];
+			e->vel_x[i] = e->vel_x[end];
+			e->vel_y[i] = e->vel_y[end];
+			e->vel_z[i] = e->vel_z[end];
+			e->life[i] = e->life[end];
+			e->inv_life[i] = e->inv_life[end];
+			memcpy(e->instances + i * 4, e->instances + end * 4, 4 * sizeof(float32_t));
+		}
+	}
+}
+
+internal void _particle_update_gpu(particle_emitter_t *emitter, float32_t dt, uint32_t spawn_count) {
+	particle_emitter_params_t *p = &emitter->params;
+	shader_t shader = _particle.feedback_shader;
+	int32_t old_program = 0, old_vao = 0, old_buffer = 0;
+	
+	glGetIntegerv(GL_CURRENT_PROGRAM, &old_program);
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &old_buffer);
+	
+	shader_bind(shader);
+	shader_uniform_float(shader, "dt", dt);
+	shader_uniform_vec3(shader, "gravity", p->gravity);
+	shader_uniform_float(shader, "drag", p->drag);
+	shader_uniform_vec3(shader, "emitter_pos", p->pos);
+	shader_uniform_vec3(shader, "spread", p->spread);
+	shader_uniform_vec3(shader, "velocity", p->velocity);
+	shader_uniform_vec3(shader, "velocity_spread", p->velocity_spread);
+	shader_uniform_vec2(shader, "life", (vec2_t){ p->life.min, MAX(p->life.max, 0.001f) });
+	glUniform1ui(glGetUniformLocation(shader, "spawn_start"), emitter->spawn_start);
+	glUniform1ui(glGetUniformLocation(shader, "spawn_count"), spawn_count);
+	glUniform1ui(glGetUniformLocation(shader, "capacity"), p->capacity);
+	glUniform1ui(glGetUniformLocation(shader, "seed"), emitter->seed++);
+	
+	uint32_t source = emitter->feedback_buffers[emitter->current];
+	uint32_t target = emitter->feedback_buffers[emitter->current ^ 1];
+	
+	glBindVertexArray(_particle.feedback_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, source);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(float32_t), (void *)0);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(float32_t), (void *)(4 * sizeof(float32_t)));
+	
+	glEnable(GL_RASTERIZER_DISCARD);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, target);
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, 0, p->capacity);
+	glEndTransformFeedback();
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	glDisable(GL_RASTERIZER_DISCARD);
+	render_statistics_add((render_statistics_t){ .draw_calls = 1, .vertices = p->capacity });
+	
+	emitter->current ^= 1;
+	emitter->spawn_start = (emitter->spawn_start + spawn_count) % p->capacity;
+	
+	glBindVertexArray(old_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, old_buffer);
+	glUseProgram(old_program);
+}
+
+void particle_init() {
+	string_t varyings[2] = { "out_pos_age", "out_vel_life" };
+	_particle.shader = shader_create(_particle_source);
+	_particle.feedback_shader = shader_create_feedback(_particle_feedback_source, varyings, 2);
+	
+	int32_t old_vao = 0, old_buffer = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &old_buffer);
+	
+	// shared quad, the per particle stream is attached to location 4 at draw time
+	float32_t corners[8] = { -0.5f, -0.5f, 0.5f, -0.5f, -0.5f, 0.5f, 0.5f, 0.5f };
+	glGenVertexArrays(1, &_particle.vao);
+	glBindVertexArray(_particle.vao);
+	glGenBuffers(1, &_particle.quad_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, _particle.quad_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float32_t), (void *)0);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(4);
+	glVertexAttribDivisor(4, 1);
+	
+	glGenVertexArrays(1, &_particle.feedback_vao);
+	glBindVertexArray(_particle.feedback_vao);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	
+	glBindVertexArray(old_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, old_buffer);
+}
+
+void particle_close() {
+	shader_delete(_particle.shader);
+	shader_delete(_particle.feedback_shader);
+	glDeleteVertexArrays(1, &_particle.vao);
+	glDeleteVertexArrays(1, &_particle.feedback_vao);
+	glDeleteBuffers(1, &_particle.quad_buffer);
+	free(_particle.dead);
+	ZERO_MEMORY(&_particle);
+}
+
+particle_emitter_t particle_emitter_create(particle_emitter_params_t params) {
+	particle_emitter_t emitter = { 0 };
+	int32_t old_buffer = 0;
+	
+	if (!params.capacity) {
+		os_message(OS_MESSAGE_ERROR, "Particle emitter needs a capacity");
+		return ZERO_STRUCT(particle_emitter_t);
+	}
+	
+	emitter.params = params;
+	emitter.seed = 0x9e3779b9u;
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &old_buffer);
+	
+	if (params.gpu) {
+		// every particle starts dead and is respawned through the spawn window
+		float32_t *pool = malloc(params.capacity * 8 * sizeof(float32_t));
+		for (uint32_t i = 0; i < params.capacity; ++i) {
+			float32_t *particle = pool + i * 8;
+			memset(particle, 0, 8 * sizeof(float32_t));
+			particle[3] = 1.0f;
+			particle[7] = 1.0f;
+		}
+		
+		glGenBuffers(2, emitter.feedback_buffers);
+		for (uint32_t i = 0; i < 2; ++i) {
+			glBindBuffer(GL_ARRAY_BUFFER, emitter.feedback_buffers[i]);
+			glBufferData(GL_ARRAY_BUFFER, params.capacity * 8 * sizeof(float32_t), pool, GL_DYNAMIC_COPY);
+		}
+		
+		free(pool);
+	} else {
+		// one block for every stream, instances takes the last four
+		uint32_t stride = params.capacity;
+		float32_t *block = calloc(stride * 12, sizeof(float32_t));
+		emitter.pos_x = block;
+		emitter.pos_y = block + stride;
+		emitter.pos_z = block + stride * 2;
+		emitter.vel_x = block + stride * 3;
+		emitter.vel_y = block + stride * 4;
+		emitter.vel_z = block + stride * 5;
+		emitter.life = block + stride * 6;
+		emitter.inv_life = block + stride * 7;
+		emitter.instances = block + stride * 8;
+		
+		glGenBuffers(1, &emitter.instance_buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, emitter.instance_buffer);
+		glBufferData(GL_ARRAY_BUFFER, params.capacity * 4 * sizeof(float32_t), NULL, GL_STREAM_DRAW);
+	}
+	
+	glBindBuffer(GL_ARRAY_BUFFER, old_buffer);
+	return emitter;
+}
+
+void particle_emitter_delete(particle_emitter_t *emitter) {
+	free(emitter->pos_x);
+	
+	if (emitter->instance_buffer) {
+		glDeleteBuffers(1, &emitter->instance_buffer);
+	}
+	
+	if (emitter->feedback_buffers[0]) {
+		glDeleteBuffers(2, emitter->feedback_buffers);
+	}
+	
+	ZERO_MEMORY(emitter);
+}
+
+void particle_emitter_update(particle_emitter_t *emitter, float32_t dt) {
+	particle_emitter_params_t *p = &emitter->params;
+	if (!p->capacity) {
+		return;
+	}
+	
+	emitter->spawn_accumulator += p->rate * dt;
+	uint32_t spawn_count = (uint32_t)emitter->spawn_accumulator;
+	emitter->spawn_accumulator -= spawn_count;
+	
+	if (p->gpu) {
+		_particle_update_gpu(emitter, dt, MIN(spawn_count, p->capacity));
+		return;
+	}
+	
+	uint32_t batches = (emitter->count + PARTICLE_BATCH - 1) / PARTICLE_BATCH;
+	if (batches > _particle.dead_capacity) {
+		_particle.dead_capacity = batches;
+		_particle.dead = realloc(_particle.dead, batches * sizeof(uint32_t));
+	}
+	
+	_particle.dt = dt;
+	job_parallel_for(batches, 1, _particle_simulate, emitter);
+	_particle_compact(emitter, batches);
+	
+	// new particles are drawn at age 0 and simulated from the next update on
+	uint32_t first = emitter->count;
+	_particle_spawn(emitter, spawn_count);
+	for (uint32_t i = first; i < emitter->count; ++i) {
+		float32_t *instance = emitter->instances + i * 4;
+		instance[0] = emitter->pos_x[i];
+		instance[1] = emitter->pos_y[i];
+		instance[2] = emitter->pos_z[i];
+		instance[3] = 0.0f;
+	}
+}
+
+void particle_emitter_draw(particle_emitter_t *emitter, matrix_t view, matrix_t projection) {
+	particle_emitter_params_t *p = &emitter->params;
+	uint32_t count = p->gpu ? p->capacity : emitter->count;
+	if (!count) {
+		return;
+	}
+	
+	int32_t old_program = 0, old_vao = 0, old_buffer = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &old_program);
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &old_buffer);
+	
+	render_state_t old_state = render_state_get();
+	render_state_set((render_state_t){ .depth_testing = true, .blending = true, .face_culling = false, .wireframe = false });
+	glDepthMask(GL_FALSE);
+	glBlendFunc(GL_SRC_ALPHA, p->additive ? GL_ONE : GL_ONE_MINUS_SRC_ALPHA);
+	
+	shader_bind(_particle.shader);
+	shader_uniform_matrix(_particle.shader, "view", view);
+	shader_uniform_matrix(_particle.shader, "projection", projection);
+	shader_uniform_vec4(_particle.shader, "color_start", p->color_start);
+	shader_uniform_vec4(_particle.shader, "color_end", p->color_end);
+	shader_uniform_vec2(_particle.shader, "size", (vec2_t){ p->size.min, p->size.max });
+	
+	glBindVertexArray(_particle.vao);
+	if (p->gpu) {
+		glBindBuffer(GL_ARRAY_BUFFER, emitter->feedback_buffers[emitter->current]);
+		glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(float32_t), (void *)0);
+	} else {
+		// orphan the stream so the driver never waits on last frame's draw
+		uint32_t size = count * 4 * sizeof(float32_t);
+		glBindBuffer(GL_ARRAY_BUFFER, emitter->instance_buffer);
+		glBufferData(GL_ARRAY_BUFFER, p->capacity * 4 * sizeof(float32_t), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, size, emitter->instances);
+		glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float32_t), (void *)0);
+	}
+	
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+	render_statistics_add((render_statistics_t){
+		.draw_calls = 1,
+		.vertices = 4 * count,
+		.uploaded = p->gpu ? 0 : count * 4 * sizeof(float32_t)
+	});
+	
+	glBindVertexArray(old_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, old_buffer);
+	glUseProgram(old_program);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDepthMask(GL_TRUE);
+	render_state_set(old_state);
+}
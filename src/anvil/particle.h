@@ -0,0 +1,58 @@
+#ifndef PARTICLE_H
+#define PARTICLE_H
+
+#include "base.h"
+#include "math.h"
+#include "render.h"
+
+//
+// particles
+//
+
+// particles per job batch, a multiple of 4
+#define PARTICLE_BATCH 16384
+
+typedef struct particle_emitter_params {
+	uint32_t capacity;              // pool size, fixed at create
+	float32_t rate;                 // spawned particles per second
+	rangef_t life;                  // seconds
+	vec3_t pos, spread;             // spawn box center and half extents
+	vec3_t velocity, velocity_spread;
+	vec3_t gravity;
+	float32_t drag;
+	vec4_t color_start, color_end;  // blended over the lifetime
+	rangef_t size;                  // start and end size
+	bool8_t additive;
+	bool8_t gpu;                    // simulate with transform feedback, particles never touch the cpu
+} particle_emitter_params_t;
+
+typedef struct particle_emitter {
+	particle_emitter_params_t params;
+	uint32_t count;                 // alive particles on the cpu path
+	float32_t spawn_accumulator;
+	uint32_t seed;
+	
+	// structure of arrays, instances holds the packed (pos, age) stream for drawing
+	float32_t *pos_x, *pos_y, *pos_z;
+	float32_t *vel_x, *vel_y, *vel_z;
+	float32_t *life, *inv_life;
+	float32_t *instances;
+	uint32_t instance_buffer;
+	
+	// gpu path, ping ponged (pos, age) (vel, life) pools
+	uint32_t feedback_buffers[2], current, spawn_start;
+} particle_emitter_t;
+
+void particle_init();
+void particle_close();
+
+particle_emitter_t particle_emitter_create(particle_emitter_params_t params);
+void particle_emitter_delete(particle_emitter_t *emitter);
+
+// spawns and simulates, the cpu path is split across the job threads
+void particle_emitter_update(particle_emitter_t *emitter, float32_t dt);
+
+// camera facing instanced quads, blended without depth writes
+void particle_emitter_draw(particle_emitter_t *emitter, matrix_t view, matrix_t projection);
+
+#endif // PARTICLE_H
@@ -0,0 +1,312 @@
+#include "base.h"
+#include "core.h"
+#include "math.h"
+#include "render.h"
+#include "command.h"
+#include "portal.h"
+
+//
+// portals
+//
+
+portal_world_t portal_world_create() {
+	return ZERO_STRUCT(portal_world_t);
+}
+
+void portal_world_delete(portal_world_t *world) {
+	free(world->cells);
+	free(world->portals);
+	free(world->objects);
+	free(world->visits);
+	free(world->planes);
+	free(world->first_visit);
+	ZERO_MEMORY(world);
+}
+
+uint32_t portal_cell_add(portal_world_t *world, range3_t bounds) {
+	if (world->cell_count == world->cell_capacity) {
+		world->cell_capacity = MAX(world->cell_capacity * 2, 16);
+		world->cells = realloc(world->cells, world->cell_capacity * sizeof(portal_cell_t));
+		world->first_visit = realloc(world->first_visit, world->cell_capacity * sizeof(uint32_t));
+	}
+	
+	world->cells[world->cell_count] = (portal_cell_t){ .bounds = bounds };
+	world->first_visit[world->cell_count] = 0;
+	return world->cell_count++;
+}
+
+uint32_t portal_add(portal_world_t *world, uint32_t a, uint32_t b, vec3_t *points, uint32_t count) {
+	if (a >= world->cell_count || b >= world->cell_count || count < 3 || count > PORTAL_MAX_POINTS) {
+		os_message(OS_MESSAGE_WARNING, "Portal between cells %u and %u dropped", a, b);
+		return UINT32_MAX;
+	}
+	
+	portal_cell_t *cell_a = &world->cells[a], *cell_b = &world->cells[b];
+	if (cell_a->link_count == PORTAL_MAX_LINKS || cell_b->link_count == PORTAL_MAX_LINKS) {
+		os_message(OS_MESSAGE_WARNING, "Portal between cells %u and %u dropped", a, b);
+		return UINT32_MAX;
+	}
+	
+	if (world->portal_count == world->portal_capacity) {
+		world->portal_capacity = MAX(world->portal_capacity * 2, 16);
+		world->portals = realloc(world->portals, world->portal_capacity * sizeof(portal_t));
+	}
+	
+	portal_t portal = { .cells = { a, b }, .point_count = count };
+	memcpy(portal.points, points, portal.point_count * sizeof(vec3_t));
+	
+	// newell's normal holds up for slightly bent polygons
+	vec3_t normal = { 0 }, center = { 0 };
+	for (uint32_t i = 0; i < portal.point_count; ++i) {
+		vec3_t p = portal.points[i], q = portal.points[(i + 1) % portal.point_count];
+		normal.x += (p.y - q.y) * (p.z + q.z);
+		normal.y += (p.z - q.z) * (p.x + q.x);
+		normal.z += (p.x - q.x) * (p.y + q.y);
+		center = add3(center, p);
+	}
+	
+	normal = normalize3(normal);
+	center = mul3(center, vec3_scalar(1.0f / portal.point_count));
+	portal.plane = (vec4_t){ normal.x, normal.y, normal.z, -dot3(normal, center) };
+	
+	world->portals[world->portal_count] = portal;
+	cell_a->links[cell_a->link_count++] = world->portal_count;
+	cell_b->links[cell_b->link_count++] = world->portal_count;
+	return world->portal_count++;
+}
+
+uint32_t portal_object_add(portal_world_t *world, uint32_t cell, mesh_t *mesh, texture_t *texture, matrix_t xform) {
+	if (world->object_count == world->object_capacity) {
+		world->object_capacity = MAX(world->object_capacity * 2, 64);
+		world->objects = realloc(world->objects, world->object_capacity * sizeof(portal_object_t));
+	}
+	
+	range3_t local = mesh_bounds(mesh);
+	range3_t bounds = { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+	for (uint32_t i = 0; i < 8; ++i) {
+		vec4_t corner = { (i & 1) ? local.max.x : local.min.x, (i & 2) ? local.max.y : local.min.y, (i & 4) ? local.max.z : local.min.z, 1.0f };
+		vec4_t p = matrix_transform(xform, corner);
+		bounds.min = (vec3_t){ MIN(bounds.min.x, p.x), MIN(bounds.min.y, p.y), MIN(bounds.min.z, p.z) };
+		bounds.max = (vec3_t){ MAX(bounds.max.x, p.x), MAX(bounds.max.y, p.y), MAX(bounds.max.z, p.z) };
+	}
+	
+	world->objects[world->object_count] = (portal_object_t){ mesh, texture, xform, bounds, cell };
+	return world->object_count++;
+}
+
+int32_t portal_cell_find(portal_world_t *world, vec3_t point) {
+	for (uint32_t i = 0; i < world->cell_count; ++i) {
+		range3_t b = world->cells[i].bounds;
+		if (point.x >= b.min.x && point.x <= b.max.x && point.y >= b.min.y && point.y <= b.max.y && point.z >= b.min.z && point.z <= b.max.z) {
+			return (int32_t)i;
+		}
+	}
+	
+	return -1;
+}
+
+//
+// visibility
+//
+
+typedef struct portal_frustum {
+	vec4_t planes[PORTAL_MAX_PLANES];
+	uint32_t side_count, plane_count;
+} portal_frustum_t;
+
+typedef struct portal_walk {
+	portal_world_t *world;
+	vec3_t camera_pos;
+	vec4_t near_plane, far_plane;
+	uint32_t path[PORTAL_MAX_DEPTH];
+} portal_walk_t;
+
+internal float32_t _portal_distance(vec4_t plane, vec3_t p) {
+	return plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w;
+}
+
+internal bool8_t _portal_box_visible(range3_t b, vec4_t *planes, uint32_t count) {
+	for (uint32_t i = 0; i < count; ++i) {
+		vec3_t p = { planes[i].x > 0.0f ? b.max.x : b.min.x, planes[i].y > 0.0f ? b.max.y : b.min.y, planes[i].z > 0.0f ? b.max.z : b.min.z };
+		if (_portal_distance(planes[i], p) < 0.0f) {
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+// sutherland hodgman against one plane, out has room for count + 1 points
+internal uint32_t _portal_clip(vec3_t *in, uint32_t count, vec4_t plane, vec3_t *out) {
+	uint32_t result = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		vec3_t a = in[i], b = in[(i + 1) % count];
+		float32_t da = _portal_distance(plane, a), db = _portal_distance(plane, b);
+		
+		if (da >= 0.0f) {
+			out[result++] = a;
+		}
+		if ((da >= 0.0f) != (db >= 0.0f)) {
+			float32_t t = da / (da - db);
+			out[result++] = add3(a, mul3(sub3(b, a), vec3_scalar(t)));
+		}
+	}
+	
+	return result;
+}
+
+internal void _portal_visit(portal_walk_t *walk, uint32_t cell, portal_frustum_t *frustum, uint32_t depth) {
+	portal_world_t *world = walk->world;
+	
+	if (world->visit_count == world->visit_capacity) {
+		world->visit_capacity = MAX(world->visit_capacity * 2, 64);
+		world->visits = realloc(world->visits, world->visit_capacity * sizeof(portal_visit_t));
+	}
+	if (world->plane_count + frustum->plane_count > world->plane_capacity) {
+		world->plane_capacity = MAX(world->plane_capacity * 2, world->plane_count + frustum->plane_count + 256);
+		world->planes = realloc(world->planes, world->plane_capacity * sizeof(vec4_t));
+	}
+	
+	world->stats.cells += !world->first_visit[cell];
+	world->visits[world->visit_count] = (portal_visit_t){ cell, world->plane_count, frustum->side_count, frustum->plane_count, world->first_visit[cell] };
+	world->first_visit[cell] = ++world->visit_count;
+	memcpy(world->planes + world->plane_count, frustum->planes, frustum->plane_count * sizeof(vec4_t));
+	world->plane_count += frustum->plane_count;
+	
+	walk->path[depth] = cell;
+	if (depth + 1 == PORTAL_MAX_DEPTH) {
+		return;
+	}
+	
+	portal_cell_t *c = &world->cells[cell];
+	for (uint32_t l = 0; l < c->link_count; ++l) {
+		portal_t *portal = &world->portals[c->links[l]];
+		uint32_t next = portal->cells[0] == cell ? portal->cells[1] : portal->cells[0];
+		
+		bool8_t on_path = false;
+		for (uint32_t d = 0; d <= depth; ++d) {
+			on_path |= walk->path[d] == next;
+		}
+		if (on_path) {
+			continue;
+		}
+		
+		++world->stats.portals_tested;
+		
+		// only the planes through the camera clip, anything seen through the part of a portal
+		// closer than the near plane is still behind it
+		vec3_t buffers[2][PORTAL_MAX_POINTS + PORTAL_MAX_SIDES];
+		uint32_t count = portal->point_count, b = 0;
+		memcpy(buffers[0], portal->points, count * sizeof(vec3_t));
+		for (uint32_t s = 0; s < frustum->side_count && count >= 3; ++s, b ^= 1) {
+			count = _portal_clip(buffers[b], count, frustum->planes[s], buffers[b ^ 1]);
+		}
+		if (count < 3) {
+			continue;
+		}
+		
+		vec3_t *points = buffers[b], center = { 0 };
+		for (uint32_t i = 0; i < count; ++i) {
+			center = add3(center, points[i]);
+		}
+		center = mul3(center, vec3_scalar(1.0f / count));
+		
+		// standing in the doorway leaves no cone to narrow to, the frustum goes through as is
+		portal_frustum_t narrow = *frustum;
+		float32_t side = _portal_distance(portal->plane, walk->camera_pos);
+		if (fabsf(side) > 0.001f && count <= PORTAL_MAX_SIDES) {
+			narrow.side_count = 0;
+			for (uint32_t i = 0; i < count; ++i) {
+				vec3_t normal = cross3(sub3(points[i], walk->camera_pos), sub3(points[(i + 1) % count], walk->camera_pos));
+				float32_t length = sqrtf(dot3(normal, normal));
+				if (length < 1e-6f) {
+					continue;
+				}
+				
+				normal = mul3(normal, vec3_scalar(1.0f / length));
+				vec4_t plane = { normal.x, normal.y, normal.z, -dot3(normal, walk->camera_pos) };
+				if (_portal_distance(plane, center) < 0.0f) {
+					plane = (vec4_t){ -plane.x, -plane.y, -plane.z, -plane.w };
+				}
+				narrow.planes[narrow.side_count++] = plane;
+			}
+			
+			vec4_t behind = side > 0.0f ? (vec4_t){ -portal->plane.x, -portal->plane.y, -portal->plane.z, -portal->plane.w } : portal->plane;
+			narrow.planes[narrow.side_count + 0] = walk->near_plane;
+			narrow.planes[narrow.side_count + 1] = walk->far_plane;
+			narrow.planes[narrow.side_count + 2] = behind;
+			narrow.plane_count = narrow.side_count + 3;
+		}
+		
+		++world->stats.portals_passed;
+		_portal_visit(walk, next, &narrow, depth + 1);
+	}
+}
+
+void portal_visibility(portal_world_t *world, matrix_t view_projection, vec3_t camera_pos) {
+	world->visit_count = 0;
+	world->plane_count = 0;
+	world->stats = ZERO_STRUCT(portal_statistics_t);
+	memset(world->first_visit, 0, world->cell_count * sizeof(uint32_t));
+	
+	portal_walk_t walk = { .world = world, .camera_pos = camera_pos };
+	portal_frustum_t frustum = { .side_count = 4, .plane_count = 6 };
+	// left, right, bottom and top pass through the camera, near and far come last
+	matrix_frustum(view_projection, frustum.planes);
+	walk.near_plane = frustum.planes[4];
+	walk.far_plane = frustum.planes[5];
+	
+	int32_t start = portal_cell_find(world, camera_pos);
+	if (start >= 0) {
+		_portal_visit(&walk, (uint32_t)start, &frustum, 0);
+	} else {
+		for (uint32_t i = 0; i < world->cell_count; ++i) {
+			_portal_visit(&walk, i, &frustum, PORTAL_MAX_DEPTH - 1);
+		}
+	}
+	
+	world->stats.visits = world->visit_count;
+}
+
+bool8_t portal_cell_visible(portal_world_t *world, uint32_t cell) {
+	return world->first_visit[cell] != 0;
+}
+
+//
+// recording
+//
+
+void portal_record(portal_world_t *world, command_buffer_t *buffer) {
+	texture_t *texture = NULL;
+	
+	for (uint32_t i = 0; i < world->object_count; ++i) {
+		portal_object_t *object = &world->objects[i];
+		uint32_t visit = world->first_visit[object->cell];
+		if (!visit) {
+			continue;
+		}
+		
+		++world->stats.objects_tested;
+		bool8_t visible = false;
+		for (; visit && !visible; visit = world->visits[visit - 1].next) {
+			portal_visit_t *v = &world->visits[visit - 1];
+			visible = _portal_box_visible(object->bounds, world->planes + v->first_plane, v->plane_count);
+		}
+		if (!visible) {
+			continue;
+		}
+		
+		if (object->texture && object->texture != texture) {
+			texture = object->texture;
+			command_texture(buffer, texture, 0);
+		}
+		
+		command_uniform_matrix(buffer, "xform", object->xform);
+		command_draw(buffer, object->mesh);
+		++world->stats.objects_drawn;
+	}
+}
+
+portal_statistics_t portal_statistics_get(portal_world_t *world) {
+	return world->stats;
+}
@@ -0,0 +1,104 @@
+#ifndef PORTAL_H
+#define PORTAL_H
+
+#include "base.h"
+#include "math.h"
+#include "render.h"
+#include "command.h"
+
+//
+// portals
+//
+
+#define PORTAL_MAX_POINTS 8                 // of a portal polygon
+#define PORTAL_MAX_LINKS  16                // portals of one cell
+#define PORTAL_MAX_DEPTH  32                // cells on one path from the camera
+
+// frustums are side planes through the camera, one per edge of the clipped portal, capped by
+// the near and far planes of the view and the portal itself. a portal clipped to more edges
+// than PORTAL_MAX_SIDES keeps the frustum it was seen through
+#define PORTAL_MAX_SIDES  16
+#define PORTAL_MAX_PLANES (PORTAL_MAX_SIDES + 3)
+
+// rooms are boxes, the first one containing the camera is where the traversal starts
+typedef struct portal_cell {
+	range3_t bounds;
+	uint32_t links[PORTAL_MAX_LINKS];
+	uint32_t link_count;
+} portal_cell_t;
+
+// convex planar polygon joining two cells, it is seen through from both sides
+typedef struct portal {
+	uint32_t cells[2];
+	vec3_t points[PORTAL_MAX_POINTS];
+	uint32_t point_count;
+	vec4_t plane;
+} portal_t;
+
+typedef struct portal_object {
+	mesh_t *mesh;
+	texture_t *texture;                     // bound to slot 0, NULL keeps the current one
+	matrix_t xform;
+	range3_t bounds;                        // world space, from the mesh bounds
+	uint32_t cell;
+} portal_object_t;
+
+// a cell reached through a chain of portals, with the frustum narrowed to the last of them.
+// cells seen through several chains are visited once per chain
+typedef struct portal_visit {
+	uint32_t cell;
+	uint32_t first_plane, side_count, plane_count;
+	uint32_t next;                          // next visit of the same cell, 0 ends the chain
+} portal_visit_t;
+
+typedef struct portal_statistics {
+	uint32_t cells, visits;
+	uint32_t portals_tested, portals_passed;
+	uint32_t objects_tested, objects_drawn;
+} portal_statistics_t;
+
+// nothing in here touches gl, portal_record can run on any thread owning the command buffer
+typedef struct portal_world {
+	portal_cell_t *cells;
+	uint32_t cell_count, cell_capacity;
+	portal_t *portals;
+	uint32_t portal_count, portal_capacity;
+	portal_object_t *objects;
+	uint32_t object_count, object_capacity;
+	
+	// result of the last portal_visibility, first_visit is 1 based with 0 for unseen cells
+	portal_visit_t *visits;
+	uint32_t visit_count, visit_capacity;
+	vec4_t *planes;
+	uint32_t plane_count, plane_capacity;
+	uint32_t *first_visit;
+	portal_statistics_t stats;
+} portal_world_t;
+
+portal_world_t portal_world_create();
+void portal_world_delete(portal_world_t *world);
+
+uint32_t portal_cell_add(portal_world_t *world, range3_t bounds);
+
+// points wind either way, 3 to PORTAL_MAX_POINTS of them. the portal is dropped when a cell
+// does not exist or already has PORTAL_MAX_LINKS
+uint32_t portal_add(portal_world_t *world, uint32_t a, uint32_t b, vec3_t *points, uint32_t count);
+
+// the mesh has to stay alive until the recorded commands are submitted
+uint32_t portal_object_add(portal_world_t *world, uint32_t cell, mesh_t *mesh, texture_t *texture, matrix_t xform);
+
+// -1 when no cell contains the point
+int32_t portal_cell_find(portal_world_t *world, vec3_t point);
+
+// walks from the camera cell through every portal that stays visible after clipping it to the
+// frustum so far. outside of every cell all cells are visited with the full frustum
+void portal_visibility(portal_world_t *world, matrix_t view_projection, vec3_t camera_pos);
+
+// draws of the objects in visited cells passing one of their cell's frustums, each as a texture,
+// an "xform" uniform and a draw, so runs of one mesh merge into instanced draws at submit
+void portal_record(portal_world_t *world, command_buffer_t *buffer);
+
+bool8_t portal_cell_visible(portal_world_t *world, uint32_t cell);
+portal_statistics_t portal_statistics_get(portal_world_t *world);
+
+#endif // PORTAL_H
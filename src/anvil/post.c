@@ -0,0 +1,286 @@
+#include "base.h"
+#include "core.h"
+#include "math.h"
+#include "render.h"
+#include "post.h"
+#include <glad.h>
+
+//
+// post processing
+//
+
+enum {
+	POST_PREFILTER,                     // threshold merged into the first downsample
+	POST_DOWNSAMPLE,
+	POST_BLUR,
+	POST_UPSAMPLE,
+	POST_COMPOSITE,                     // bloom, exposure, tonemapping and grading in one draw
+	POST_FXAA,
+	POST_SHADER_COUNT
+};
+
+global struct {
+	shader_t shaders[POST_SHADER_COUNT];
+	uint32_t vao;
+	post_statistics_t stats;
+} _post;
+
+const string_t _post_defines[POST_SHADER_COUNT] = {
+	"#define POST_PREFILTER 1\n",
+	"#define POST_DOWNSAMPLE 1\n",
+	"#define POST_BLUR 1\n",
+	"#define POST_UPSAMPLE 1\n",
+	"#define POST_COMPOSITE 1\n",
+	"#define POST_FXAA 1\n"
+};
+
+const string_t _post_source =
+	"#ifdef VERTEX_SHADER\n"
+	"\n"
+	"out vec2 uv;\n"
+	"\n"
+	"void main() {\n"
+	"	vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+	"	uv = p;\n"
+	"	gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);\n"
+	"}\n"
+	"\n"
+	"#else\n"
+	"\n"
+	"in vec2 uv;\n"
+	"\n"
+	"uniform sampler2D source;\n"
+	"uniform sampler2D bloom;\n"
+	"uniform vec2 texel;\n"
+	"uniform vec2 direction;\n"
+	"uniform vec4 threshold;\n"
+	"uniform vec4 grading;\n"
+	"uniform vec3 color_filter;\n"
+	"\n"
+	"out vec4 frag_color;\n"
+	"\n"
+	"// four bilinear taps cover a 4x4 box of source texels\n"
+	"vec3 box(vec2 coord) {\n"
+	"	vec4 o = texel.xyxy * vec4(-1.0, -1.0, 1.0, 1.0);\n"
+	"	return (texture(source, coord + o.xy).rgb + texture(source, coord + o.zy).rgb +\n"
+	"	        texture(source, coord + o.xw).rgb + texture(source, coord + o.zw).rgb) * 0.25;\n"
+	"}\n"
+	"\n"
+	"float luma(vec3 c) {\n"
+	"	return dot(c, vec3(0.299, 0.587, 0.114));\n"
+	"}\n"
+	"\n"
+	"void main() {\n"
+	"#if defined(POST_PREFILTER)\n"
+	"	vec3 c = box(uv);\n"
+	"	float brightness = max(c.r, max(c.g, c.b));\n"
+	"	float soft = clamp(brightness - threshold.y, 0.0, threshold.z);\n"
+	"	soft = soft * soft * threshold.w;\n"
+	"	frag_color = vec4(c * max(soft, brightness - threshold.x) / max(brightness, 0.0001), 1.0);\n"
+	"#elif defined(POST_DOWNSAMPLE)\n"
+	"	frag_color = vec4(box(uv), 1.0);\n"
+	"#elif defined(POST_BLUR)\n"
+	"	// nine tap gaussian from five bilinear taps\n"
+	"	vec2 o1 = direction * texel * 1.3846153846;\n"
+	"	vec2 o2 = direction * texel * 3.2307692308;\n"
+	"	vec3 c = texture(source, uv).rgb * 0.2270270270;\n"
+	"	c += (texture(source, uv + o1).rgb + texture(source, uv - o1).rgb) * 0.3162162162;\n"
+	"	c += (texture(source, uv + o2).rgb + texture(source, uv - o2).rgb) * 0.0702702703;\n"
+	"	frag_color = vec4(c, 1.0);\n"
+	"#elif defined(POST_UPSAMPLE)\n"
+	"	frag_color = vec4(box(uv), 1.0);\n"
+	"#elif defined(POST_COMPOSITE)\n"
+	"	vec3 c = texture(source, uv).rgb + texture(bloom, uv).rgb * threshold.x;\n"
+	"	c *= color_filter * grading.x;\n"
+	"	c = clamp((c * (2.51 * c + 0.03)) / (c * (2.43 * c + 0.59) + 0.14), 0.0, 1.0);\n"
+	"	c = mix(vec3(luma(c)), c, grading.z);\n"
+	"	c = clamp((c - 0.5) * grading.y + 0.5, 0.0, 1.0);\n"
+	"	c = pow(c, vec3(grading.w));\n"
+	"	frag_color = vec4(c, luma(c));\n"
+	"#elif defined(POST_FXAA)\n"
+	"	// lumas come from the alpha written by the composite\n"
+	"	vec4 m = texture(source, uv);\n"
+	"	float nw = texture(source, uv + vec2(-1.0, -1.0) * texel).a;\n"
+	"	float ne = texture(source, uv + vec2(1.0, -1.0) * texel).a;\n"
+	"	float sw = texture(source, uv + vec2(-1.0, 1.0) * texel).a;\n"
+	"	float se = texture(source, uv + vec2(1.0, 1.0) * texel).a;\n"
+	"	float lo = min(m.a, min(min(nw, ne), min(sw, se)));\n"
+	"	float hi = max(m.a, max(max(nw, ne), max(sw, se)));\n"
+	"	if (hi - lo < max(0.0312, hi * 0.125)) {\n"
+	"		frag_color = vec4(m.rgb, 1.0);\n"
+	"		return;\n"
+	"	}\n"
+	"	vec2 dir = vec2(-((nw + ne) - (sw + se)), (nw + sw) - (ne + se));\n"
+	"	float reduce = max((nw + ne + sw + se) * 0.03125, 0.0078125);\n"
+	"	dir = clamp(dir / (min(abs(dir.x), abs(dir.y)) + reduce), -8.0, 8.0) * texel;\n"
+	"	vec3 a = (texture(source, uv - dir / 6.0).rgb + texture(source, uv + dir / 6.0).rgb) * 0.5;\n"
+	"	vec3 b = a * 0.5 + (texture(source, uv - dir * 0.5).rgb + texture(source, uv + dir * 0.5).rgb) * 0.25;\n"
+	"	float lb = luma(b);\n"
+	"	frag_color = vec4((lb < lo || lb > hi) ? a : b, 1.0);\n"
+	"#endif\n"
+	"}\n"
+	"\n"
+	"#endif";
+
+void post_init() {
+	uint64_t length = strlen(_post_source);
+	char *source = malloc(length + 64);
+	
+	for (uint32_t i = 0; i < POST_SHADER_COUNT; ++i) {
+		snprintf(source, length + 64, "%s%s", _post_defines[i], _post_source);
+		_post.shaders[i] = shader_create(source);
+	}
+	
+	free(source);
+	glGenVertexArrays(1, &_post.vao);
+}
+
+void post_close() {
+	for (uint32_t i = 0; i < POST_SHADER_COUNT; ++i) {
+		shader_delete(_post.shaders[i]);
+	}
+	
+	glDeleteVertexArrays(1, &_post.vao);
+	ZERO_MEMORY(&_post);
+}
+
+post_statistics_t post_statistics_get() {
+	return _post.stats;
+}
+
+internal void _post_draw(shader_t shader, texture_t *source, framebuffer_t *target) {
+	if (target) {
+		framebuffer_bind(target);
+	} else {
+		framebuffer_unbind();
+	}
+	
+	int32_t viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	
+	shader_bind(shader);
+	texture_bind(source, 0);
+	shader_uniform_texture(shader, "source", 0);
+	shader_uniform_vec2(shader, "texel", (vec2_t){ 1.0f / source->width, 1.0f / source->height });
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	
+	++_post.stats.draws;
+	_post.stats.pixels += (uint64_t)viewport[2] * viewport[3];
+}
+
+internal framebuffer_t *_post_target(int32_t width, int32_t height, framebuffer_format_e format) {
+	framebuffer_desc_t desc = { 0 };
+	desc.width = MAX(width, 1);
+	desc.height = MAX(height, 1);
+	desc.colors[0] = format;
+	desc.params = (texture_params_t){ TEXTURE_FILTER_LINEAR, TEXTURE_FILTER_LINEAR, TEXTURE_WRAP_CLAMP_TO_EDGE, TEXTURE_WRAP_CLAMP_TO_EDGE, false };
+	return framebuffer_pool_acquire(desc);
+}
+
+// downsamples into the pyramid, blurs every level in ping pong targets and adds each level into
+// the one above it. returns the largest level, which holds the whole bloom
+internal framebuffer_t *_post_bloom(texture_t *scene, post_params_t *params, framebuffer_t **levels, framebuffer_t **pings, uint32_t *level_count) {
+	uint32_t divisor = params->bloom_divisor ? params->bloom_divisor : 2;
+	int32_t width = scene->width / divisor, height = scene->height / divisor;
+	
+	*level_count = 0;
+	for (uint32_t i = 0; i < MIN(params->bloom_levels, POST_MAX_LEVELS) && width > 1 && height > 1; ++i) {
+		levels[i] = _post_target(width, height, FRAMEBUFFER_FORMAT_R11G11B10F);
+		pings[i] = _post_target(width, height, FRAMEBUFFER_FORMAT_R11G11B10F);
+		if (!levels[i] || !pings[i]) {
+			framebuffer_pool_release(levels[i]);
+			framebuffer_pool_release(pings[i]);
+			break;
+		}
+		
+		++*level_count;
+		width /= 2;
+		height /= 2;
+	}
+	
+	if (!*level_count) {
+		return NULL;
+	}
+	
+	float32_t knee = MAX(params->bloom_threshold * params->bloom_knee, 0.0001f);
+	shader_t prefilter = _post.shaders[POST_PREFILTER];
+	shader_bind(prefilter);
+	shader_uniform_vec4(prefilter, "threshold", (vec4_t){ params->bloom_threshold, params->bloom_threshold - knee, knee * 2.0f, 0.25f / knee });
+	_post_draw(prefilter, scene, levels[0]);
+	
+	for (uint32_t i = 1; i < *level_count; ++i) {
+		_post_draw(_post.shaders[POST_DOWNSAMPLE], &levels[i - 1]->texture, levels[i]);
+	}
+	
+	shader_t blur = _post.shaders[POST_BLUR];
+	for (uint32_t i = 0; i < *level_count; ++i) {
+		shader_bind(blur);
+		shader_uniform_vec2(blur, "direction", (vec2_t){ 1.0f, 0.0f });
+		_post_draw(blur, &levels[i]->texture, pings[i]);
+		shader_uniform_vec2(blur, "direction", (vec2_t){ 0.0f, 1.0f });
+		_post_draw(blur, &pings[i]->texture, levels[i]);
+	}
+	
+	// each level keeps half of itself and gets half of the one below, the sum stays normalized
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+	glBlendColor(0.0f, 0.0f, 0.0f, 0.5f);
+	for (int32_t i = (int32_t)*level_count - 2; i >= 0; --i) {
+		_post_draw(_post.shaders[POST_UPSAMPLE], &levels[i + 1]->texture, levels[i]);
+	}
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	
+	return levels[0];
+}
+
+void post_process(texture_t *scene, framebuffer_t *output, post_params_t params) {
+	_post.stats = ZERO_STRUCT(post_statistics_t);
+	
+	render_state_t old_state = render_state_get();
+	render_state_set((render_state_t){ .depth_testing = false, .blending = false, .face_culling = false, .wireframe = false });
+	
+	int32_t old_vao = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+	glBindVertexArray(_post.vao);
+	
+	framebuffer_t *levels[POST_MAX_LEVELS] = { 0 }, *pings[POST_MAX_LEVELS] = { 0 };
+	uint32_t level_count = 0;
+	framebuffer_t *bloom = _post_bloom(scene, &params, levels, pings, &level_count);
+	glDisable(GL_BLEND);
+	
+	// fxaa needs the neighbours of the tonemapped color, so it is the one pass that cannot merge
+	framebuffer_t *ldr = params.fxaa ? _post_target(scene->width, scene->height, FRAMEBUFFER_FORMAT_RGBA8) : NULL;
+	
+	shader_t composite = _post.shaders[POST_COMPOSITE];
+	vec3_t color_filter = (params.color_filter.x || params.color_filter.y || params.color_filter.z) ? params.color_filter : vec3_scalar(1.0f);
+	shader_bind(composite);
+	texture_bind(bloom ? &bloom->texture : scene, 1);
+	shader_uniform_texture(composite, "bloom", 1);
+	shader_uniform_vec4(composite, "threshold", (vec4_t){ bloom ? params.bloom_intensity : 0.0f, 0.0f, 0.0f, 0.0f });
+	shader_uniform_vec4(composite, "grading", (vec4_t){
+		params.exposure > 0.0f ? params.exposure : 1.0f,
+		params.contrast > 0.0f ? params.contrast : 1.0f,
+		params.saturation > 0.0f ? params.saturation : 1.0f,
+		params.gamma > 0.0f ? 1.0f / params.gamma : 1.0f
+	});
+	shader_uniform_vec3(composite, "color_filter", color_filter);
+	_post_draw(composite, scene, ldr ? ldr : output);
+	_post.stats.full_pixels += (uint64_t)scene->width * scene->height;
+	
+	if (ldr) {
+		_post_draw(_post.shaders[POST_FXAA], &ldr->texture, output);
+		_post.stats.full_pixels += (uint64_t)scene->width * scene->height;
+	}
+	
+	for (uint32_t i = 0; i < level_count; ++i) {
+		framebuffer_pool_release(levels[i]);
+		framebuffer_pool_release(pings[i]);
+	}
+	framebuffer_pool_release(ldr);
+	
+	glBindVertexArray(old_vao);
+	render_state_set(old_state);
+	if (output) {
+		framebuffer_unbind();
+	}
+}
@@ -0,0 +1,46 @@
+#ifndef POST_H
+#define POST_H
+
+#include "base.h"
+#include "math.h"
+#include "render.h"
+
+//
+// post processing
+//
+
+#define POST_MAX_LEVELS 6
+
+typedef struct post_params {
+	float32_t exposure;                 // 0 picks 1
+	float32_t gamma;                    // 0 leaves the tonemapped color linear
+	
+	// bloom runs on a pyramid starting at the scene size divided by bloom_divisor, 2 or 4
+	uint32_t bloom_levels;              // 0 turns bloom off
+	uint32_t bloom_divisor;             // 0 picks 2
+	float32_t bloom_threshold, bloom_knee, bloom_intensity;
+	
+	// grading, applied after tonemapping
+	float32_t contrast, saturation;     // 0 picks 1
+	vec3_t color_filter;                // multiplies the hdr color, 0 picks white
+	
+	bool8_t fxaa;
+} post_params_t;
+
+typedef struct post_statistics {
+	uint32_t draws;
+	uint64_t pixels;                    // fragments shaded by every pass together
+	uint64_t full_pixels;               // of those, the ones shaded at the scene size
+} post_statistics_t;
+
+void post_init();
+void post_close();
+
+// scene is the hdr color, the result is drawn to output or to the window when output is NULL.
+// bloom targets come from the framebuffer pool and are released again before returning. the pool
+// is left for the caller, or graph_execute, to trim once per frame
+void post_process(texture_t *scene, framebuffer_t *output, post_params_t params);
+
+post_statistics_t post_statistics_get();
+
+#endif // POST_H
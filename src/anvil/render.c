@@ -17,12 +17,42 @@
 
 #define MAX_VERTEX_COUNT 4096
 #define MAX_INDEX_COUNT  4096
+#define MAX_INSTANCE_COUNT 1024
+
+// glad only loads the 3.3 core profile
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
 
 global uint32_t vao, vbo, ebo;
+global uint32_t depth_vao, depth_vbo;
+global uint32_t instance_vbo;
 global render_statistics_t *_statistics;
 global render_state_t _state;
 global os_event_t *_event;
 
+global struct {
+	render_depth_mode_e mode;
+	shader_t shader;
+	vec3_t *positions;
+} _depth;
+
+global struct {
+	uint32_t *free;
+	uint32_t free_count, free_capacity;
+	uint32_t frame;
+	shader_t shader;
+	mesh_t box;
+	matrix_t view_projection;
+	render_state_t old_state;
+} _queries;
+
+global struct {
+	framebuffer_t framebuffers[FRAMEBUFFER_POOL_SIZE];
+	bool8_t used[FRAMEBUFFER_POOL_SIZE];
+	uint32_t idle[FRAMEBUFFER_POOL_SIZE];   // trims spent released
+} _framebuffer_pool;
+
 void render_init(os_event_t *event) {
     _event = event;
 	
@@ -47,18 +77,96 @@ void render_init(os_event_t *event) {
 	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, normal));
 	glEnableVertexAttribArray(3);
 	
+	// position only stream of the depth pre-pass, it shares the element buffer
+	glGenVertexArrays(1, &depth_vao);
+	glBindVertexArray(depth_vao);
+	
+	glGenBuffers(1, &depth_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, depth_vbo);
+	glBufferData(GL_ARRAY_BUFFER, MAX_VERTEX_COUNT * sizeof(vec3_t), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), NULL);
+	glEnableVertexAttribArray(0);
+	
+	// per instance transforms of mesh_draw_xforms, a mat4 takes locations 4 to 7. the arrays
+	// are only enabled while drawing instances
+	glGenBuffers(1, &instance_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+	glBufferData(GL_ARRAY_BUFFER, MAX_INSTANCE_COUNT * sizeof(matrix_t), NULL, GL_DYNAMIC_DRAW);
+	
+	uint32_t vaos[2] = { vao, depth_vao };
+	for (uint32_t v = 0; v < 2; ++v) {
+		glBindVertexArray(vaos[v]);
+		for (uint32_t column = 0; column < 4; ++column) {
+			glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(matrix_t), (void *)(column * sizeof(vec4_t)));
+			glVertexAttribDivisor(4 + column, 1);
+		}
+	}
+	
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	
+	// the same expressions as default.glsl, invariant keeps the depth of both bit exact
+	const string_t depth_source = "#ifdef VERTEX_SHADER\n\nlayout (location = 0) in vec3 position;\n\nuniform mat4 projection;\nuniform mat4 view;\nuniform mat4 xform;\nuniform bool instanced;\n\nlayout (location = 4) in mat4 instance_xform;\n\ninvariant gl_Position;\n\nvoid main() {\n	mat4 model = instanced ? instance_xform : xform;\n	vec3 frag_pos = vec3(model * vec4(position, 1.0));\n	vec4 view_pos = view * vec4(frag_pos, 1.0);\n	gl_Position = projection * view_pos;\n}\n\n#else\n\nvoid main() {\n}\n\n#endif";
+	_depth.shader = shader_create(depth_source);
+	_depth.positions = malloc(MAX_VERTEX_COUNT * sizeof(vec3_t));
+	
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	
+	// unit cube for bounding box queries
+	{
+		const string_t query_source = "#ifdef VERTEX_SHADER\n\nlayout (location = 0) in vec3 position;\n\nuniform mat4 mvp;\n\nvoid main() {\n	gl_Position = mvp * vec4(position, 1.0);\n}\n\n#else\n\nvoid main() {\n}\n\n#endif";
+		_queries.shader = shader_create(query_source);
+		_queries.box = mesh_create(8, 36);
+		
+		for (uint32_t i = 0; i < 8; ++i) {
+			mesh_push_vertex(&_queries.box, (vertex_t){ (vec3_t){ (float32_t)(i & 1), (float32_t)((i >> 1) & 1), (float32_t)((i >> 2) & 1) }, ZERO_STRUCT(vec2_t), vec4_scalar(1.0f), ZERO_STRUCT(vec3_t) });
+		}
+		
+		uint32_t indices[36] = {
+			0, 2, 1, 1, 2, 3,  4, 5, 6, 5, 7, 6,
+			0, 1, 4, 1, 5, 4,  2, 6, 3, 3, 6, 7,
+			0, 4, 2, 2, 4, 6,  1, 3, 5, 3, 7, 5
+		};
+		
+		mesh_push_indices(&_queries.box, indices, 36);
+	}
 }
 
 void render_close() {
     glDeleteVertexArrays(1, &vao);
 	glDeleteBuffers(1, &vbo);
 	glDeleteBuffers(1, &ebo);
+	glDeleteVertexArrays(1, &depth_vao);
+	glDeleteBuffers(1, &depth_vbo);
+	glDeleteBuffers(1, &instance_vbo);
+	
+	shader_delete(_depth.shader);
+	free(_depth.positions);
+	ZERO_MEMORY(&_depth);
+	
+	if (_queries.free_count) {
+		glDeleteQueries(_queries.free_count, _queries.free);
+	}
+	
+	free(_queries.free);
+	shader_delete(_queries.shader);
+	mesh_delete(&_queries.box);
+	ZERO_MEMORY(&_queries);
+	
+	for (uint32_t i = 0; i < FRAMEBUFFER_POOL_SIZE; ++i) {
+		framebuffer_delete(&_framebuffer_pool.framebuffers[i]);
+	}
+	ZERO_MEMORY(&_framebuffer_pool);
 }
 
 void render_clear(vec3_t color) {
+    // the write masks of the depth modes would mask the clear as well
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(GL_TRUE);
     glClearColor(color.x, color.y, color.z, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    render_depth_mode(_depth.mode);
     if (_statistics) {
         ZERO_MEMORY(_statistics);
     }
@@ -76,6 +184,22 @@ render_state_t render_state_get() {
     return _state;
 }
 
+void render_depth_mode(render_depth_mode_e mode) {
+	bool8_t prepass = mode == RENDER_DEPTH_PREPASS;
+	glColorMask(!prepass, !prepass, !prepass, !prepass);
+	glDepthMask(mode != RENDER_DEPTH_EQUAL);
+	glDepthFunc(mode == RENDER_DEPTH_EQUAL ? GL_EQUAL : GL_LESS);
+	_depth.mode = mode;
+}
+
+render_depth_mode_e render_depth_mode_get() {
+	return _depth.mode;
+}
+
+shader_t render_depth_shader() {
+	return _depth.shader;
+}
+
 void render_statistics_monitor(render_statistics_t *stats) {
     _statistics = stats;
 }
@@ -84,6 +208,16 @@ void render_statistics_stop() {
     _statistics = NULL;
 }
 
+void render_statistics_add(render_statistics_t stats) {
+    if (_statistics) {
+        _statistics->draw_calls += stats.draw_calls;
+        _statistics->vertices += stats.vertices;
+        _statistics->indices += stats.indices;
+        _statistics->queries += stats.queries;
+        _statistics->uploaded += stats.uploaded;
+    }
+}
+
 void render_point_size(float32_t size) {
 	glPointSize(size);
 }
@@ -92,6 +226,67 @@ void render_line_width(float32_t width) {
 	glLineWidth(width);
 }
 
+void render_read_pixels(int32_t x, int32_t y, int32_t width, int32_t height, uint8_t *pixels) {
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	
+	// gl reads bottom up
+	uint32_t stride = width * 4;
+	uint8_t *row = malloc(stride);
+	for (int32_t i = 0; i < height / 2; ++i) {
+		uint8_t *top = pixels + i * stride;
+		uint8_t *bottom = pixels + (height - 1 - i) * stride;
+		memcpy(row, top, stride);
+		memcpy(top, bottom, stride);
+		memcpy(bottom, row, stride);
+	}
+	free(row);
+}
+
+bool8_t render_pixels_save(string_t path, uint8_t *pixels, int32_t width, int32_t height) {
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		os_message(OS_MESSAGE_ERROR, "Failed to write image %s", path);
+		return false;
+	}
+	
+	// ppm has no alpha
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	for (int32_t i = 0; i < width * height; ++i) {
+		fwrite(pixels + i * 4, 1, 3, file);
+	}
+	
+	fclose(file);
+	return true;
+}
+
+uint8_t *render_pixels_load(string_t path, int32_t *width, int32_t *height) {
+	int32_t channels;
+	stbi_set_flip_vertically_on_load(false);
+	uint8_t *pixels = stbi_load(path, width, height, &channels, 4);
+	if (!pixels) {
+		os_message(OS_MESSAGE_ERROR, "Failed to load image %s", path);
+	}
+	
+	return pixels;
+}
+
+uint32_t render_pixels_compare(uint8_t *a, uint8_t *b, uint32_t pixel_count, uint8_t tolerance) {
+	uint32_t different = 0;
+	
+	// alpha is ignored, ppm goldens don't store it
+	for (uint32_t i = 0; i < pixel_count; ++i) {
+		for (uint32_t c = 0; c < 3; ++c) {
+			if (abs((int32_t)a[i * 4 + c] - (int32_t)b[i * 4 + c]) > tolerance) {
+				++different;
+				break;
+			}
+		}
+	}
+	
+	return different;
+}
+
 
 //
 // texture
@@ -262,11 +457,44 @@ void mesh_delete(mesh_t *mesh) {
 	free(mesh->indices);
 }
 
+range3_t mesh_bounds(mesh_t *mesh) {
+	range3_t bounds = { vec3_scalar(FLT_MAX), vec3_scalar(-FLT_MAX) };
+	
+	for (uint32_t i = 0; i < mesh->curr_vertex; ++i) {
+		vec3_t p = mesh->vertices[i].pos;
+		bounds.min = (vec3_t){ MIN(bounds.min.x, p.x), MIN(bounds.min.y, p.y), MIN(bounds.min.z, p.z) };
+		bounds.max = (vec3_t){ MAX(bounds.max.x, p.x), MAX(bounds.max.y, p.y), MAX(bounds.max.z, p.z) };
+	}
+	
+	return bounds;
+}
+
 void mesh_clear(mesh_t *mesh) {
 	mesh->curr_index = 0;
 	mesh->curr_vertex = 0;
 }
 
+// streams the vertices and indices of a mesh and returns the bytes sent. the pre-pass needs
+// nothing but positions, a quarter of the bytes of full vertices, and leaves depth_vao bound
+internal uint64_t _mesh_upload(mesh_t *mesh) {
+	uint32_t vertex_size = sizeof(vertex_t);
+	if (_depth.mode == RENDER_DEPTH_PREPASS) {
+		for (uint32_t i = 0; i < mesh->curr_vertex; ++i) {
+			_depth.positions[i] = mesh->vertices[i].pos;
+		}
+		
+		vertex_size = sizeof(vec3_t);
+		glBindVertexArray(depth_vao);
+		glBindBuffer(GL_ARRAY_BUFFER, depth_vbo);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, mesh->curr_vertex * sizeof(vec3_t), (void *)_depth.positions);
+	} else {
+		glBufferSubData(GL_ARRAY_BUFFER, 0, mesh->curr_vertex * sizeof(vertex_t), (void *)mesh->vertices);
+	}
+	
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, mesh->curr_index * sizeof(uint32_t), (void *)mesh->indices);
+	return mesh->curr_vertex * vertex_size + mesh->curr_index * sizeof(uint32_t);
+}
+
 void mesh_draw(mesh_t *mesh) {
 	uint32_t mode = (uint32_t)mesh->mode;
 	if (!mode) {
@@ -275,14 +503,79 @@ void mesh_draw(mesh_t *mesh) {
 		mode += GL_POINTS - 1;
 	}
 	
-	glBufferSubData(GL_ARRAY_BUFFER, 0, mesh->curr_vertex * sizeof(vertex_t), (void *)mesh->vertices);
-	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, mesh->curr_index * sizeof(uint32_t), (void *)mesh->indices);
+	uint64_t uploaded = _mesh_upload(mesh);
 	glDrawElements(mode, mesh->curr_index, GL_UNSIGNED_INT, NULL);
 	
+	if (_depth.mode == RENDER_DEPTH_PREPASS) {
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	}
+	
 	if (_statistics) {
 		++_statistics->draw_calls;
 		_statistics->vertices += mesh->vertex_count;
 		_statistics->indices += mesh->index_count;
+		_statistics->uploaded += uploaded;
+	}
+}
+
+void mesh_draw_xforms(mesh_t *mesh, shader_t shader, matrix_t *xforms, uint32_t count) {
+	if (!count) {
+		return;
+	}
+	
+	shader_instancing_t locations = shader_instancing(shader);
+	int32_t xform = locations.xform, instanced = locations.instanced;
+	
+	// shaders without the instance_xform attribute draw the transforms one by one
+	if (count == 1 || instanced < 0) {
+		for (uint32_t i = 0; i < count; ++i) {
+			glUniformMatrix4fv(xform, 1, GL_FALSE, xforms[i].elements[0]);
+			mesh_draw(mesh);
+		}
+		
+		return;
+	}
+	
+	uint32_t mode = (uint32_t)mesh->mode;
+	if (!mode) {
+		mode = GL_TRIANGLES;
+	} else {
+		mode += GL_POINTS - 1;
+	}
+	
+	uint64_t uploaded = _mesh_upload(mesh);
+	glUniform1i(instanced, 1);
+	for (uint32_t column = 0; column < 4; ++column) {
+		glEnableVertexAttribArray(4 + column);
+	}
+	
+	glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+	for (uint32_t start = 0; start < count; start += MAX_INSTANCE_COUNT) {
+		uint32_t batch = MIN(count - start, MAX_INSTANCE_COUNT);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, batch * sizeof(matrix_t), (void *)&xforms[start]);
+		glDrawElementsInstanced(mode, mesh->curr_index, GL_UNSIGNED_INT, NULL, batch);
+		
+		if (_statistics) {
+			++_statistics->draw_calls;
+			_statistics->vertices += mesh->vertex_count * batch;
+			_statistics->indices += mesh->index_count * batch;
+			_statistics->uploaded += batch * sizeof(matrix_t);
+		}
+	}
+	
+	for (uint32_t column = 0; column < 4; ++column) {
+		glDisableVertexAttribArray(4 + column);
+	}
+	
+	// left as if the transforms were drawn one by one
+	glUniform1i(instanced, 0);
+	glUniformMatrix4fv(xform, 1, GL_FALSE, xforms[count - 1].elements[0]);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	
+	if (_statistics) {
+		_statistics->uploaded += uploaded;
 	}
 }
 
@@ -302,6 +595,7 @@ void mesh_draw_instanced(mesh_t *mesh, uint32_t count) {
 		++_statistics->draw_calls;
 		_statistics->vertices += mesh->vertex_count * count;
 		_statistics->indices += mesh->index_count * count;
+		_statistics->uploaded += mesh->curr_vertex * sizeof(vertex_t) + mesh->curr_index * sizeof(uint32_t);
 	}
 }
 
@@ -320,6 +614,7 @@ void mesh_draw_vertices(mesh_t *mesh) {
 		++_statistics->draw_calls;
 		_statistics->vertices += mesh->vertex_count;
 		_statistics->indices += mesh->vertex_count;
+		_statistics->uploaded += mesh->curr_vertex * sizeof(vertex_t);
 	}
 }
 
@@ -343,6 +638,180 @@ void mesh_push_indices(mesh_t *mesh, uint32_t *indices, uint32_t count) {
 	mesh->curr_index += count;
 }
 
+//
+// occlusion queries
+//
+
+void render_query_begin(render_query_t *query) {
+	// NO_WAIT draws anyway while the result is still in flight, the gpu never stalls on it
+	if (query->id && !query->unconditional) {
+		glBeginConditionalRender(query->id, GL_QUERY_NO_WAIT);
+	}
+}
+
+void render_query_end(render_query_t *query) {
+	if (query->id && !query->unconditional) {
+		glEndConditionalRender();
+	}
+}
+
+void render_query_pass_begin(matrix_t view, matrix_t projection) {
+	++_queries.frame;
+	_queries.view_projection = matrix_mul(view, projection);
+	_queries.old_state = render_state_get();
+	
+	// boxes only test depth, they never write anything
+	render_state_set((render_state_t){ .depth_testing = true, .blending = false, .face_culling = false, .wireframe = false });
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	shader_bind(_queries.shader);
+}
+
+void render_query_issue(render_query_t *query, range3_t bounds, matrix_t xform) {
+	bool8_t fresh = !query->id;
+	if (fresh) {
+		if (_queries.free_count) {
+			query->id = _queries.free[--_queries.free_count];
+		} else {
+			glGenQueries(1, &query->id);
+		}
+		
+		query->visible = true;
+	}
+	
+	// pick up the last result once the gpu has it, without waiting
+	if (query->pending) {
+		uint32_t available = 0;
+		glGetQueryObjectuiv(query->id, GL_QUERY_RESULT_AVAILABLE, &available);
+		
+		if (available) {
+			uint32_t samples = 0;
+			glGetQueryObjectuiv(query->id, GL_QUERY_RESULT, &samples);
+			query->visible = samples != 0;
+			query->pending = false;
+		}
+	}
+	
+	// temporal coherence, visible objects rarely turn hidden so they are requeried less often
+	if (!fresh && query->visible && !query->unconditional && (_queries.frame + query->id) % RENDER_QUERY_INTERVAL) {
+		return;
+	}
+	
+	vec3_t size = sub3(bounds.max, bounds.min);
+	matrix_t box = matrix_mul(xform_translate(xform_scale(IDENTITY_MATRIX, size), bounds.min), xform);
+	matrix_t mvp = matrix_mul(box, _queries.view_projection);
+	
+	// a box crossing the near plane would be clipped away, draw the object unconditionally instead
+	query->unconditional = false;
+	for (uint32_t i = 0; i < 8; ++i) {
+		vec3_t p = _queries.box.vertices[i].pos;
+		vec4_t clip = matrix_transform(mvp, (vec4_t){ p.x, p.y, p.z, 1.0f });
+		if (clip.w <= 0.0f || clip.z < -clip.w) {
+			query->unconditional = true;
+			query->visible = true;
+			
+			// conditional rendering needs the query to have run once
+			if (!fresh) {
+				return;
+			}
+			
+			break;
+		}
+	}
+	
+	shader_uniform_matrix(_queries.shader, "mvp", mvp);
+	glBeginQuery(GL_ANY_SAMPLES_PASSED, query->id);
+	mesh_draw(&_queries.box);
+	glEndQuery(GL_ANY_SAMPLES_PASSED);
+	query->pending = true;
+	
+	if (_statistics) {
+		++_statistics->queries;
+	}
+}
+
+void render_query_pass_end() {
+	render_depth_mode(_depth.mode);
+	render_state_set(_queries.old_state);
+}
+
+void render_query_release(render_query_t *query) {
+	if (!query->id) {
+		return;
+	}
+	
+	if (_queries.free_count == _queries.free_capacity) {
+		_queries.free_capacity = MAX(64, _queries.free_capacity * 2);
+		_queries.free = realloc(_queries.free, _queries.free_capacity * sizeof(uint32_t));
+	}
+	
+	_queries.free[_queries.free_count++] = query->id;
+	ZERO_MEMORY(query);
+}
+
+
+//
+// gpu timers
+//
+
+render_timer_t render_timer_create() {
+	render_timer_t timer = { 0 };
+	glGenQueries(RENDER_TIMER_LATENCY, timer.ids);
+	return timer;
+}
+
+void render_timer_delete(render_timer_t *timer) {
+	glDeleteQueries(RENDER_TIMER_LATENCY, timer->ids);
+	ZERO_MEMORY(timer);
+}
+
+void render_timer_begin(render_timer_t *timer) {
+	uint32_t id = timer->ids[timer->frame % RENDER_TIMER_LATENCY];
+	
+	// this query last ran RENDER_TIMER_LATENCY frames ago, it is almost always done by now
+	if (timer->frame >= RENDER_TIMER_LATENCY) {
+		uint64_t elapsed = 0;
+		glGetQueryObjectui64v(id, GL_QUERY_RESULT, &elapsed);
+		timer->time = (float64_t)elapsed / 1000000.0;
+	}
+	
+	glBeginQuery(GL_TIME_ELAPSED, id);
+}
+
+void render_timer_end(render_timer_t *timer) {
+	glEndQuery(GL_TIME_ELAPSED);
+	++timer->frame;
+}
+
+render_counter_t render_counter_create() {
+	render_counter_t counter = { 0 };
+	glGenQueries(RENDER_TIMER_LATENCY, counter.ids);
+	return counter;
+}
+
+void render_counter_delete(render_counter_t *counter) {
+	glDeleteQueries(RENDER_TIMER_LATENCY, counter->ids);
+	ZERO_MEMORY(counter);
+}
+
+void render_counter_begin(render_counter_t *counter) {
+	uint32_t id = counter->ids[counter->frame % RENDER_TIMER_LATENCY];
+	
+	if (counter->frame >= RENDER_TIMER_LATENCY) {
+		uint64_t samples = 0;
+		glGetQueryObjectui64v(id, GL_QUERY_RESULT, &samples);
+		counter->samples = samples;
+	}
+	
+	glBeginQuery(GL_SAMPLES_PASSED, id);
+}
+
+void render_counter_end(render_counter_t *counter) {
+	glEndQuery(GL_SAMPLES_PASSED);
+	++counter->frame;
+}
+
+
 //
 // shaders
 //
@@ -351,7 +820,14 @@ internal inline int32_t gl_location(shader_t shader, string_t name) {
 	return glGetUniformLocation(shader, name);
 }
 
-shader_t shader_create(string_t source) {
+// gl hands out the names of deleted programs again, so shader_delete drops their entry
+global struct {
+	shader_t shaders[SHADER_INSTANCING_CACHE];
+	shader_instancing_t locations[SHADER_INSTANCING_CACHE];
+	uint32_t next;
+} _instancing;
+
+internal shader_t _shader_build(string_t source, string_t *varyings, uint32_t varying_count) {
 	shader_t program = 0;
 	int32_t error = 0;
 	
@@ -399,6 +875,12 @@ shader_t shader_create(string_t source) {
 	
 	glAttachShader(program, vert_module);
 	glAttachShader(program, frag_module);
+	
+	// transform feedback outputs have to be declared before linking
+	if (varying_count) {
+		glTransformFeedbackVaryings(program, varying_count, (const GLchar *const*)varyings, GL_INTERLEAVED_ATTRIBS);
+	}
+	
 	glLinkProgram(program);
 	
 	glGetProgramiv(program, GL_LINK_STATUS, &error);
@@ -422,6 +904,56 @@ shader_t shader_create(string_t source) {
 	return program;
 }
 
+shader_t shader_create(string_t source) {
+	return _shader_build(source, NULL, 0);
+}
+
+shader_t shader_create_feedback(string_t source, string_t *varyings, uint32_t varying_count) {
+	return _shader_build(source, varyings, varying_count);
+}
+
+shader_t shader_create_compute(string_t source) {
+	const string_t comp_source[2] = {"#version 430 core\n#define COMPUTE_SHADER 1\n", source};
+	int32_t error = 0;
+	
+	shader_t comp_module = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(comp_module, 2, (const GLchar *const*)comp_source, NULL);
+	glCompileShader(comp_module);
+	
+	glGetShaderiv(comp_module, GL_COMPILE_STATUS, &error);
+	if (!error) {
+		int32_t length = 0;
+		glGetShaderiv(comp_module, GL_INFO_LOG_LENGTH, &length);
+		
+		GLchar* info = (GLchar*)malloc(length * sizeof(GLchar));
+		glGetShaderInfoLog(comp_module, length * sizeof(GLchar), NULL, info);
+		
+		fprintf(stderr, "%s\n", info);
+		free(info);
+	}
+	
+	shader_t program = glCreateProgram();
+	glAttachShader(program, comp_module);
+	glLinkProgram(program);
+	
+	glGetProgramiv(program, GL_LINK_STATUS, &error);
+	if (!error) {
+		int32_t length = 0;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+		
+		GLchar* info = (GLchar*)malloc(length * sizeof(GLchar));
+		glGetProgramInfoLog(program, length * sizeof(GLchar), NULL, info);
+		
+		fprintf(stderr, "%s\n", info);
+		free(info);
+	}
+	
+	glDetachShader(program, comp_module);
+	glDeleteShader(comp_module);
+	
+	return program;
+}
+
 shader_t shader_load(string_t path) {
 	string_t source = os_read_entire_file(path);
 	shader_t shader = shader_create(source);
@@ -430,6 +962,12 @@ shader_t shader_load(string_t path) {
 }
 
 void shader_delete(shader_t shader) {
+	for (uint32_t i = 0; i < SHADER_INSTANCING_CACHE; ++i) {
+		if (_instancing.shaders[i] == shader) {
+			_instancing.shaders[i] = 0;
+		}
+	}
+	
 	glDeleteProgram(shader);
 }
 
@@ -458,58 +996,152 @@ void shader_uniform_vec2(shader_t shader, string_t name, vec2_t vec) {
 	glUniform2fv(gl_location(shader, name), 1, &vec.x);
 }
 
+void shader_uniform_vec4(shader_t shader, string_t name, vec4_t vec) {
+	glUniform4fv(gl_location(shader, name), 1, &vec.x);
+}
+
+void shader_uniform_float(shader_t shader, string_t name, float32_t value) {
+	glUniform1f(gl_location(shader, name), value);
+}
+
+void shader_uniform_int(shader_t shader, string_t name, int32_t value) {
+	glUniform1i(gl_location(shader, name), value);
+}
+
+void shader_uniform_matrix_array(shader_t shader, string_t name, matrix_t *matrices, uint32_t count) {
+	glUniformMatrix4fv(gl_location(shader, name), count, GL_FALSE, matrices[0].elements[0]);
+}
+
+shader_instancing_t shader_instancing(shader_t shader) {
+	if (!shader) {
+		return (shader_instancing_t){ -1, -1 };
+	}
+	
+	for (uint32_t i = 0; i < SHADER_INSTANCING_CACHE; ++i) {
+		if (_instancing.shaders[i] == shader) {
+			return _instancing.locations[i];
+		}
+	}
+	
+	shader_instancing_t locations = { gl_location(shader, "xform"), gl_location(shader, "instanced") };
+	if (glGetAttribLocation(shader, "instance_xform") != 4) {
+		locations.instanced = -1;
+	}
+	
+	// oldest entry goes when the cache is full
+	uint32_t slot = _instancing.next++ % SHADER_INSTANCING_CACHE;
+	_instancing.shaders[slot] = shader;
+	_instancing.locations[slot] = locations;
+	return locations;
+}
+
 
 //
 // framebuffer
 //
 
-framebuffer_t framebuffer_create(int32_t width, int32_t height, texture_params_t params, framebuffer_type_e type) {
-	framebuffer_t framebuffer = { 0, width, height, params, type, ZERO_STRUCT(texture_t) };
+typedef struct framebuffer_format_info {
+	uint32_t internal_format, format, type, attachment;
+} framebuffer_format_info_t;
+
+internal framebuffer_format_info_t _framebuffer_format(framebuffer_format_e format) {
+	switch (format) {
+		default:
+		case FRAMEBUFFER_FORMAT_RGBA8:            return (framebuffer_format_info_t){ GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, GL_COLOR_ATTACHMENT0 };
+		case FRAMEBUFFER_FORMAT_RGBA16F:          return (framebuffer_format_info_t){ GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, GL_COLOR_ATTACHMENT0 };
+		case FRAMEBUFFER_FORMAT_R11G11B10F:       return (framebuffer_format_info_t){ GL_R11F_G11F_B10F, GL_RGB, GL_HALF_FLOAT, GL_COLOR_ATTACHMENT0 };
+		case FRAMEBUFFER_FORMAT_DEPTH24:          return (framebuffer_format_info_t){ GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, GL_DEPTH_ATTACHMENT };
+		case FRAMEBUFFER_FORMAT_DEPTH24_STENCIL8: return (framebuffer_format_info_t){ GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, GL_DEPTH_STENCIL_ATTACHMENT };
+		case FRAMEBUFFER_FORMAT_DEPTH32F:         return (framebuffer_format_info_t){ GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT, GL_DEPTH_ATTACHMENT };
+	}
+}
+
+// attaches a texture, or a renderbuffer when the attachment is never sampled
+internal void _framebuffer_attach(framebuffer_t *framebuffer, framebuffer_format_e format, uint32_t attachment, uint32_t index, texture_t *texture) {
+	framebuffer_format_info_t info = _framebuffer_format(format);
 	
-	glGenFramebuffers(1, &framebuffer.id);
-	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.id);
+	if (framebuffer->desc.renderbuffers & (1 << index)) {
+		glGenRenderbuffers(1, &framebuffer->renderbuffers[index]);
+		glBindRenderbuffer(GL_RENDERBUFFER, framebuffer->renderbuffers[index]);
+		glRenderbufferStorage(GL_RENDERBUFFER, info.internal_format, framebuffer->width, framebuffer->height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, framebuffer->renderbuffers[index]);
+		return;
+	}
+	
+	texture->width = framebuffer->width;
+	texture->height = framebuffer->height;
+	texture->channels = (info.format == GL_RGBA) ? 4 : (info.format == GL_RGB) ? 3 : 1;
+	texture->params = framebuffer->params;
 	
-	texture_t texture = { 0 };
-	texture.width = width;
-	texture.height = height;
-	texture.params = params;
+	glGenTextures(1, &texture->id);
+	glBindTexture(GL_TEXTURE_2D, texture->id);
+	
+	glTexImage2D(GL_TEXTURE_2D, 0, info.internal_format, framebuffer->width, framebuffer->height, 0, info.format, info.type, NULL);
 	
-	uint32_t internal_format, format, attachment_type;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, _RENDER_FILTER(texture->params.min_filter));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, _RENDER_FILTER(texture->params.mag_filter));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, _RENDER_WRAP(texture->params.wrap_s));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, _RENDER_WRAP(texture->params.wrap_t));
+	
+	glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture->id, 0);
+}
+
+framebuffer_t framebuffer_create(int32_t width, int32_t height, texture_params_t params, framebuffer_type_e type) {
+	framebuffer_desc_t desc = { width, height, { FRAMEBUFFER_FORMAT_NONE }, FRAMEBUFFER_FORMAT_NONE, 0, params };
 	
 	switch (type) {
 		default:
 		case FRAMEBUFFER_COLOR:
-		internal_format = GL_RGBA8;
-		format = GL_RGBA;
-		attachment_type = GL_COLOR_ATTACHMENT0;
+		desc.colors[0] = FRAMEBUFFER_FORMAT_RGBA8;
 		break;
 		
 		case FRAMEBUFFER_DEPTH:
-		internal_format = GL_DEPTH_COMPONENT;
-		format = GL_DEPTH_COMPONENT;
-		attachment_type = GL_DEPTH_ATTACHMENT;
+		desc.depth = FRAMEBUFFER_FORMAT_DEPTH24;
 		break;
 		
 		case FRAMEBUFFER_STENCIL:
-		internal_format = GL_STENCIL_INDEX8;
-		format = GL_STENCIL_INDEX;
-		attachment_type = GL_STENCIL_ATTACHMENT;
+		desc.depth = FRAMEBUFFER_FORMAT_DEPTH24_STENCIL8;
 		break;
 	}
 	
-	glGenTextures(1, &texture.id);
-	glBindTexture(GL_TEXTURE_2D, texture.id);
+	framebuffer_t framebuffer = framebuffer_create_desc(desc);
+	framebuffer.type = type;
+	return framebuffer;
+}
+
+framebuffer_t framebuffer_create_desc(framebuffer_desc_t desc) {
+	framebuffer_t framebuffer = { 0 };
+	framebuffer.width = desc.width;
+	framebuffer.height = desc.height;
+	framebuffer.params = desc.params;
+	framebuffer.type = desc.colors[0] ? FRAMEBUFFER_COLOR : FRAMEBUFFER_DEPTH;
+	framebuffer.desc = desc;
 	
-	glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, GL_FLOAT, NULL);
+	int32_t old_texture = 0;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &old_texture);
 	
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, _RENDER_FILTER(texture.params.min_filter));
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, _RENDER_FILTER(texture.params.mag_filter));
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, _RENDER_WRAP(texture.params.wrap_s));
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, _RENDER_WRAP(texture.params.wrap_t));
+	glGenFramebuffers(1, &framebuffer.id);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.id);
 	
-	glFramebufferTexture2D(GL_FRAMEBUFFER, attachment_type, GL_TEXTURE_2D, texture.id, 0);
+	uint32_t draw_buffers[FRAMEBUFFER_MAX_COLORS];
+	for (uint32_t i = 0; i < FRAMEBUFFER_MAX_COLORS && desc.colors[i]; ++i) {
+		_framebuffer_attach(&framebuffer, desc.colors[i], GL_COLOR_ATTACHMENT0 + i, i, &framebuffer.colors[i]);
+		draw_buffers[framebuffer.color_count++] = GL_COLOR_ATTACHMENT0 + i;
+	}
 	
-	framebuffer.texture = texture;
+	if (desc.depth) {
+		_framebuffer_attach(&framebuffer, desc.depth, _framebuffer_format(desc.depth).attachment, FRAMEBUFFER_MAX_COLORS, &framebuffer.depth);
+	}
+	
+	if (framebuffer.color_count) {
+		glDrawBuffers(framebuffer.color_count, draw_buffers);
+	} else {
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+	
+	framebuffer.texture = framebuffer.color_count ? framebuffer.colors[0] : framebuffer.depth;
+	glBindTexture(GL_TEXTURE_2D, old_texture);
 	
 	// check completeness
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
@@ -525,7 +1157,18 @@ framebuffer_t framebuffer_create(int32_t width, int32_t height, texture_params_t
 void framebuffer_delete(framebuffer_t *framebuffer) {
 	if (framebuffer->id) {
 		glDeleteFramebuffers(1, &framebuffer->id);
-		texture_delete(&framebuffer->texture);
+		
+		for (uint32_t i = 0; i < FRAMEBUFFER_MAX_COLORS; ++i) {
+			texture_delete(&framebuffer->colors[i]);
+		}
+		texture_delete(&framebuffer->depth);
+		
+		for (uint32_t i = 0; i < FRAMEBUFFER_MAX_COLORS + 1; ++i) {
+			if (framebuffer->renderbuffers[i]) {
+				glDeleteRenderbuffers(1, &framebuffer->renderbuffers[i]);
+			}
+		}
+		
 		ZERO_MEMORY(framebuffer);
 	}
 }
@@ -539,3 +1182,58 @@ void framebuffer_unbind() {
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glViewport(0, 0, _event->width, _event->height);
 }
+
+internal bool8_t _framebuffer_desc_equal(framebuffer_desc_t *a, framebuffer_desc_t *b) {
+	bool8_t equal = a->width == b->width && a->height == b->height && a->depth == b->depth && a->renderbuffers == b->renderbuffers &&
+		a->params.min_filter == b->params.min_filter && a->params.mag_filter == b->params.mag_filter &&
+		a->params.wrap_s == b->params.wrap_s && a->params.wrap_t == b->params.wrap_t;
+	
+	for (uint32_t i = 0; i < FRAMEBUFFER_MAX_COLORS && equal; ++i) {
+		equal = a->colors[i] == b->colors[i];
+	}
+	
+	return equal;
+}
+
+framebuffer_t *framebuffer_pool_acquire(framebuffer_desc_t desc) {
+	int32_t empty = -1;
+	
+	for (uint32_t i = 0; i < FRAMEBUFFER_POOL_SIZE; ++i) {
+		framebuffer_t *framebuffer = &_framebuffer_pool.framebuffers[i];
+		if (!framebuffer->id) {
+			empty = (empty < 0) ? (int32_t)i : empty;
+		} else if (!_framebuffer_pool.used[i] && _framebuffer_desc_equal(&framebuffer->desc, &desc)) {
+			_framebuffer_pool.used[i] = true;
+			_framebuffer_pool.idle[i] = 0;
+			return framebuffer;
+		}
+	}
+	
+	if (empty < 0) {
+		os_message(OS_MESSAGE_ERROR, "Framebuffer pool is full");
+		return NULL;
+	}
+	
+	_framebuffer_pool.framebuffers[empty] = framebuffer_create_desc(desc);
+	if (!_framebuffer_pool.framebuffers[empty].id) {
+		return NULL;
+	}
+	
+	_framebuffer_pool.used[empty] = true;
+	_framebuffer_pool.idle[empty] = 0;
+	return &_framebuffer_pool.framebuffers[empty];
+}
+
+void framebuffer_pool_release(framebuffer_t *framebuffer) {
+	if (framebuffer) {
+		_framebuffer_pool.used[framebuffer - _framebuffer_pool.framebuffers] = false;
+	}
+}
+
+void framebuffer_pool_trim() {
+	for (uint32_t i = 0; i < FRAMEBUFFER_POOL_SIZE; ++i) {
+		if (_framebuffer_pool.framebuffers[i].id && !_framebuffer_pool.used[i] && ++_framebuffer_pool.idle[i] > FRAMEBUFFER_POOL_FRAMES) {
+			framebuffer_delete(&_framebuffer_pool.framebuffers[i]);
+		}
+	}
+}
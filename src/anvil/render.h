@@ -23,8 +23,19 @@ typedef struct render_state {
     bool8_t depth_testing, blending, face_culling, wireframe;
 } render_state_t;
 
+typedef uint32_t shader_t;
+
+// a depth pre-pass lays down depth with color writes off, the shading pass then only runs
+// for the fragments that stay visible. both passes must transform vertices the same way
+typedef enum render_depth_mode {
+	RENDER_DEPTH_DEFAULT,               // less, with depth writes
+	RENDER_DEPTH_PREPASS,               // depth only, mesh_draw streams vertex positions alone
+	RENDER_DEPTH_EQUAL                  // equal, without depth writes, for shading after a pre-pass
+} render_depth_mode_e;
+
 typedef struct render_statistics {
-    uint32_t draw_calls, vertices, indices;
+    uint32_t draw_calls, vertices, indices, queries;
+    uint64_t uploaded; // vertex and index bytes sent to the gpu
 } render_statistics_t;
 
 void render_init(os_event_t *event);
@@ -35,12 +46,26 @@ void render_clear(vec3_t color);
 void render_state_set(render_state_t state);
 render_state_t render_state_get();
 
+void render_depth_mode(render_depth_mode_e mode);
+render_depth_mode_e render_depth_mode_get();
+
 void render_statistics_monitor(render_statistics_t *stats);
 void render_statistics_stop();
 
+// for modules drawing from their own buffers, counted like the mesh draws
+void render_statistics_add(render_statistics_t stats);
+
 void render_point_size(float32_t size);
 void render_line_width(float32_t width);
 
+// rgba8 readback of the bound framebuffer, rows go top to bottom
+void render_read_pixels(int32_t x, int32_t y, int32_t width, int32_t height, uint8_t *pixels);
+
+// golden images are binary ppm files, compare returns the pixels off by more than tolerance
+bool8_t render_pixels_save(string_t path, uint8_t *pixels, int32_t width, int32_t height);
+uint8_t *render_pixels_load(string_t path, int32_t *width, int32_t *height);
+uint32_t render_pixels_compare(uint8_t *a, uint8_t *b, uint32_t pixel_count, uint8_t tolerance);
+
 
 //
 // texture
@@ -94,10 +119,17 @@ typedef struct mesh {
 mesh_t mesh_create(uint32_t vertex_count, uint32_t index_count);
 mesh_t mesh_load(string_t path);
 void mesh_delete(mesh_t *mesh);
+range3_t mesh_bounds(mesh_t *mesh);
 
 void mesh_clear(mesh_t *mesh);
 void mesh_draw(mesh_t *mesh);
 void mesh_draw_instanced(mesh_t *mesh, uint32_t count);
+
+// one draw per transform, instanced when the bound shader reads them from the instance_xform
+// attribute at location 4 and switches to it on the instanced uniform like default.glsl.
+// other shaders get the transforms in the xform uniform one draw at a time. shader has to be
+// the bound one, its locations come from shader_instancing
+void mesh_draw_xforms(mesh_t *mesh, shader_t shader, matrix_t *xforms, uint32_t count);
 void mesh_draw_vertices(mesh_t *mesh);
 
 void mesh_push_vertex(mesh_t *mesh, vertex_t vertex);
@@ -105,13 +137,64 @@ void mesh_push_index(mesh_t *mesh, uint32_t index);
 void mesh_push_vertices(mesh_t *mesh, vertex_t *vertices, uint32_t count);
 void mesh_push_indices(mesh_t *mesh, uint32_t *indices, uint32_t count);
 
+//
+// occlusion queries
+//
+
+// visible objects are requeried every RENDER_QUERY_INTERVAL frames, hidden ones every frame
+#define RENDER_QUERY_INTERVAL 4
+
+typedef struct render_query {
+    uint32_t id;
+    bool8_t pending, visible, unconditional;
+} render_query_t;
+
+// wrap the draws of an object, skipped on the gpu when its last box query saw no samples
+void render_query_begin(render_query_t *query);
+void render_query_end(render_query_t *query);
+
+// bounding box queries, issue after the opaque pass so the depth buffer is complete
+void render_query_pass_begin(matrix_t view, matrix_t projection);
+void render_query_issue(render_query_t *query, range3_t bounds, matrix_t xform);
+void render_query_pass_end();
+void render_query_release(render_query_t *query);
+
+//
+// gpu timers
+//
+
+// results are read RENDER_TIMER_LATENCY frames late so the cpu never waits on the gpu
+#define RENDER_TIMER_LATENCY 3
+
+typedef struct render_timer {
+    uint32_t ids[RENDER_TIMER_LATENCY];
+    uint32_t frame;
+    float64_t time; // milliseconds
+} render_timer_t;
+
+render_timer_t render_timer_create();
+void render_timer_delete(render_timer_t *timer);
+void render_timer_begin(render_timer_t *timer);
+void render_timer_end(render_timer_t *timer);
+
+// counts the samples that pass the depth test between begin and end, with the same latency
+typedef struct render_counter {
+    uint32_t ids[RENDER_TIMER_LATENCY];
+    uint32_t frame;
+    uint64_t samples;
+} render_counter_t;
+
+render_counter_t render_counter_create();
+void render_counter_delete(render_counter_t *counter);
+void render_counter_begin(render_counter_t *counter);
+void render_counter_end(render_counter_t *counter);
+
 //
 // shaders
 //
 
 #define SHADER_SOURCE(n) (string_t)(__shader_source_##n)
-
-typedef uint32_t shader_t;
+#define SHADER_INSTANCING_CACHE 64
 
 shader_t shader_create(string_t source);
 shader_t shader_load(string_t path);
@@ -119,33 +202,95 @@ void shader_delete(shader_t shader);
 void shader_bind(shader_t shader);
 void shader_unbind();
 
+// vertex outputs named in varyings are captured interleaved into the transform feedback buffer
+shader_t shader_create_feedback(string_t source, string_t *varyings, uint32_t varying_count);
+
+// gl 4.3 compute program, the source is prefixed with #version 430. the context has to support it
+shader_t shader_create_compute(string_t source);
+
+// depth only program with the vertex transform of default.glsl, it takes projection, view and xform
+shader_t render_depth_shader();
+
 void shader_uniform_matrix(shader_t shader, string_t name, matrix_t matrix);
 void shader_uniform_texture(shader_t shader, string_t name, uint32_t slot);
 void shader_uniform_vec3(shader_t shader, string_t name, vec3_t vec);
 void shader_uniform_vec2(shader_t shader, string_t name, vec2_t vec);
+void shader_uniform_vec4(shader_t shader, string_t name, vec4_t vec);
+void shader_uniform_float(shader_t shader, string_t name, float32_t value);
+void shader_uniform_int(shader_t shader, string_t name, int32_t value);
+void shader_uniform_matrix_array(shader_t shader, string_t name, matrix_t *matrices, uint32_t count);
+
+// locations of the instancing convention of default.glsl, looked up once per shader so draws
+// don't query gl. instanced is -1 when the shader has no instance_xform at location 4
+typedef struct shader_instancing {
+    int32_t xform, instanced;
+} shader_instancing_t;
+
+shader_instancing_t shader_instancing(shader_t shader);
 
 
 //
 // framebuffers
 //
 
+#define FRAMEBUFFER_MAX_COLORS 4
+
+// released pool framebuffers are deleted after going unused for this many trims
+#define FRAMEBUFFER_POOL_SIZE 32
+#define FRAMEBUFFER_POOL_FRAMES 3
+
 typedef enum framebuffer_type {
     FRAMEBUFFER_COLOR,
     FRAMEBUFFER_DEPTH,
     FRAMEBUFFER_STENCIL
 } framebuffer_type_e;
 
+typedef enum framebuffer_format {
+    FRAMEBUFFER_FORMAT_NONE,
+    FRAMEBUFFER_FORMAT_RGBA8,
+    FRAMEBUFFER_FORMAT_RGBA16F,
+    FRAMEBUFFER_FORMAT_R11G11B10F,
+    FRAMEBUFFER_FORMAT_DEPTH24,
+    FRAMEBUFFER_FORMAT_DEPTH24_STENCIL8,
+    FRAMEBUFFER_FORMAT_DEPTH32F
+} framebuffer_format_e;
+
+// bits of framebuffer_desc_t renderbuffers, color attachment i is bit i
+#define FRAMEBUFFER_RENDERBUFFER_DEPTH (1 << FRAMEBUFFER_MAX_COLORS)
+
+// colors end at the first FRAMEBUFFER_FORMAT_NONE. attachments in renderbuffers are never
+// sampled, they are allocated as renderbuffers and have no texture
+typedef struct framebuffer_desc {
+    int32_t width, height;
+    framebuffer_format_e colors[FRAMEBUFFER_MAX_COLORS];
+    framebuffer_format_e depth;
+    uint32_t renderbuffers;
+    texture_params_t params;
+} framebuffer_desc_t;
+
 typedef struct framebuffer {
     uint32_t id;
     int32_t width, height;
     texture_params_t params;
     framebuffer_type_e type;
-    texture_t texture;
+    texture_t texture;                  // the first color attachment, or depth when there are none
+    framebuffer_desc_t desc;
+    uint32_t color_count;
+    texture_t colors[FRAMEBUFFER_MAX_COLORS], depth;
+    uint32_t renderbuffers[FRAMEBUFFER_MAX_COLORS + 1];
 } framebuffer_t;
 
 framebuffer_t framebuffer_create(int32_t width, int32_t height, texture_params_t params, framebuffer_type_e type);
+framebuffer_t framebuffer_create_desc(framebuffer_desc_t desc);
 void framebuffer_delete(framebuffer_t *framebuffer);
 void framebuffer_bind(framebuffer_t *framebuffer);
 void framebuffer_unbind();
 
+// pooled framebuffers are matched by their whole desc, acquire returns NULL when the pool is full.
+// trim once per frame, it deletes the ones released and left unused, such as those of old sizes.
+// graph_execute trims, so frames run through a graph must not trim again
+framebuffer_t *framebuffer_pool_acquire(framebuffer_desc_t desc);
+void framebuffer_pool_release(framebuffer_t *framebuffer);
+void framebuffer_pool_trim();
+
 #endif // RENDER_H
\ No newline at end of file
@@ -0,0 +1,132 @@
+#include "base.h"
+#include "core.h"
+#include "math.h"
+#include "render.h"
+#include "resolution.h"
+#include <glad.h>
+
+//
+// dynamic resolution
+//
+
+// widths and heights are kept to multiples of this, small scale changes do not move every pixel
+#define RESOLUTION_ALIGN 8
+
+global struct {
+	resolution_params_t params;
+	shader_t shader;
+	uint32_t vao;
+	framebuffer_t target;
+	int32_t output, viewport[4];        // framebuffer bound at begin, the upscale draws into it
+	render_timer_t timer;
+	float32_t scale;
+	int32_t width, height;
+	float64_t begin_time, cpu_time;
+} _resolution;
+
+const string_t _resolution_source = "#ifdef VERTEX_SHADER\n\nout vec2 uv;\n\nvoid main() {\n	vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n	uv = p;\n	gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);\n}\n\n#else\n\nin vec2 uv;\n\nuniform sampler2D scene;\nuniform vec2 uv_scale;\nuniform vec2 texel;\nuniform float sharpness;\n\nout vec4 frag_color;\n\nvec3 tap(vec2 coord) {\n	return texture(scene, clamp(coord, texel * 0.5, uv_scale - texel * 0.5)).rgb;\n}\n\nvoid main() {\n	vec2 coord = uv * uv_scale;\n	vec3 c = tap(coord);\n	\n	if (sharpness > 0.0) {\n		vec3 n = tap(coord + vec2(0.0, texel.y));\n		vec3 s = tap(coord - vec2(0.0, texel.y));\n		vec3 e = tap(coord + vec2(texel.x, 0.0));\n		vec3 w = tap(coord - vec2(texel.x, 0.0));\n		\n		vec3 lo = min(c, min(min(n, s), min(e, w)));\n		vec3 hi = max(c, max(max(n, s), max(e, w)));\n		vec3 amount = sqrt(clamp(min(lo, 1.0 - hi) / max(hi, 0.0001), 0.0, 1.0));\n		vec3 weight = -amount * mix(0.125, 0.2, sharpness);\n		c = clamp((c + (n + s + e + w) * weight) / (1.0 + 4.0 * weight), 0.0, 1.0);\n	}\n	\n	frag_color = vec4(c, 1.0);\n}\n\n#endif";
+
+void resolution_init(resolution_params_t params) {
+	params.min_scale = params.min_scale > 0.0f ? params.min_scale : 0.5f;
+	params.max_scale = params.max_scale > 0.0f ? params.max_scale : 1.0f;
+	params.adapt_rate = params.adapt_rate > 0.0f ? params.adapt_rate : 0.1f;
+	params.color = params.color ? params.color : FRAMEBUFFER_FORMAT_RGBA8;
+	
+	_resolution.params = params;
+	_resolution.scale = params.max_scale;
+	_resolution.shader = shader_create(_resolution_source);
+	_resolution.timer = render_timer_create();
+	glGenVertexArrays(1, &_resolution.vao);
+}
+
+void resolution_close() {
+	shader_delete(_resolution.shader);
+	render_timer_delete(&_resolution.timer);
+	framebuffer_delete(&_resolution.target);
+	glDeleteVertexArrays(1, &_resolution.vao);
+	ZERO_MEMORY(&_resolution);
+}
+
+void resolution_begin(int32_t width, int32_t height) {
+	if (_resolution.target.width != width || _resolution.target.height != height) {
+		framebuffer_delete(&_resolution.target);
+		
+		framebuffer_desc_t desc = { 0 };
+		desc.width = width;
+		desc.height = height;
+		desc.colors[0] = _resolution.params.color;
+		desc.depth = FRAMEBUFFER_FORMAT_DEPTH24;
+		desc.renderbuffers = FRAMEBUFFER_RENDERBUFFER_DEPTH;
+		desc.params = (texture_params_t){ TEXTURE_FILTER_LINEAR, TEXTURE_FILTER_LINEAR, TEXTURE_WRAP_CLAMP_TO_EDGE, TEXTURE_WRAP_CLAMP_TO_EDGE, false };
+		_resolution.target = framebuffer_create_desc(desc);
+	}
+	
+	_resolution.width = MIN(((int32_t)(width * _resolution.scale) + RESOLUTION_ALIGN - 1) / RESOLUTION_ALIGN * RESOLUTION_ALIGN, width);
+	_resolution.height = MIN(((int32_t)(height * _resolution.scale) + RESOLUTION_ALIGN - 1) / RESOLUTION_ALIGN * RESOLUTION_ALIGN, height);
+	
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &_resolution.output);
+	glGetIntegerv(GL_VIEWPORT, _resolution.viewport);
+	
+	framebuffer_bind(&_resolution.target);
+	glViewport(0, 0, _resolution.width, _resolution.height);
+	
+	_resolution.begin_time = os_time();
+	render_timer_begin(&_resolution.timer);
+}
+
+// pixel cost goes with the square of the scale, so the wanted scale follows the square root of
+// the time ratio. a cpu bound frame is never helped by a lower resolution, it can only go up
+internal void _resolution_adapt() {
+	float64_t gpu_time = (_resolution.timer.frame > RENDER_TIMER_LATENCY) ? _resolution.timer.time : 0.0;
+	float64_t frame_time = MAX(gpu_time, _resolution.cpu_time);
+	if (frame_time <= 0.0 || _resolution.params.target_time <= 0.0f) {
+		return;
+	}
+	
+	float32_t wanted = _resolution.scale * sqrtf((float32_t)(_resolution.params.target_time / frame_time));
+	if (wanted < _resolution.scale && gpu_time <= _resolution.cpu_time) {
+		return;
+	}
+	
+	float32_t scale = _resolution.scale + (wanted - _resolution.scale) * _resolution.params.adapt_rate;
+	_resolution.scale = MIN(MAX(scale, _resolution.params.min_scale), _resolution.params.max_scale);
+}
+
+void resolution_end() {
+	render_timer_end(&_resolution.timer);
+	_resolution.cpu_time = (os_time() - _resolution.begin_time) * 1000.0;
+	
+	glBindFramebuffer(GL_FRAMEBUFFER, (uint32_t)_resolution.output);
+	glViewport(_resolution.viewport[0], _resolution.viewport[1], _resolution.viewport[2], _resolution.viewport[3]);
+	
+	render_state_t old_state = render_state_get();
+	render_state_set((render_state_t){ .depth_testing = false, .blending = false, .face_culling = false, .wireframe = false });
+	
+	float32_t width = (float32_t)_resolution.target.width;
+	float32_t height = (float32_t)_resolution.target.height;
+	bool8_t sharpen = _resolution.params.filter == RESOLUTION_FILTER_SHARPEN && _resolution.width < _resolution.target.width;
+	
+	shader_bind(_resolution.shader);
+	texture_bind(&_resolution.target.texture, 0);
+	shader_uniform_texture(_resolution.shader, "scene", 0);
+	shader_uniform_vec2(_resolution.shader, "uv_scale", (vec2_t){ _resolution.width / width, _resolution.height / height });
+	shader_uniform_vec2(_resolution.shader, "texel", (vec2_t){ 1.0f / width, 1.0f / height });
+	shader_uniform_float(_resolution.shader, "sharpness", sharpen ? MAX(_resolution.params.sharpness, 0.001f) : 0.0f);
+	
+	int32_t old_vao = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+	glBindVertexArray(_resolution.vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(old_vao);
+	
+	render_state_set(old_state);
+	_resolution_adapt();
+}
+
+void resolution_scale_set(float32_t scale) {
+	_resolution.scale = MIN(MAX(scale, _resolution.params.min_scale), _resolution.params.max_scale);
+}
+
+resolution_statistics_t resolution_statistics_get() {
+	return (resolution_statistics_t){ _resolution.scale, _resolution.width, _resolution.height, _resolution.timer.time, _resolution.cpu_time };
+}
@@ -0,0 +1,47 @@
+#ifndef RESOLUTION_H
+#define RESOLUTION_H
+
+#include "base.h"
+#include "math.h"
+#include "render.h"
+
+//
+// dynamic resolution
+//
+
+typedef enum resolution_filter {
+	RESOLUTION_FILTER_BILINEAR,
+	RESOLUTION_FILTER_SHARPEN           // bilinear followed by a contrast adaptive sharpen
+} resolution_filter_e;
+
+typedef struct resolution_params {
+	float32_t target_time;              // frame budget in milliseconds
+	float32_t min_scale, max_scale;     // of each axis, 0 picks 0.5 and 1
+	float32_t adapt_rate;               // fraction of the way to the wanted scale moved per frame, 0 picks 0.1
+	float32_t sharpness;                // 0 to 1, for RESOLUTION_FILTER_SHARPEN
+	resolution_filter_e filter;         // the sharpen assumes colors from 0 to 1, use bilinear for hdr
+	framebuffer_format_e color;         // 0 picks RGBA8, depth is always a DEPTH24 renderbuffer
+} resolution_params_t;
+
+typedef struct resolution_statistics {
+	float32_t scale;
+	int32_t width, height;              // size the scene is rendered at
+	float64_t gpu_time, cpu_time;       // milliseconds the scene took, the gpu one is a few frames old
+} resolution_statistics_t;
+
+void resolution_init(resolution_params_t params);
+void resolution_close();
+
+// binds the scaled target for the 3D scene, width and height are the output size. the target
+// is allocated at full size and only its lower left corner is rendered, so the scale changes
+// without reallocating. shadow maps and other offscreen passes go before begin
+void resolution_begin(int32_t width, int32_t height);
+
+// upscales the scene into the framebuffer and viewport bound at begin, the window or a hdr
+// target for post_process, and adapts the scale. draw the ui after this
+void resolution_end();
+
+void resolution_scale_set(float32_t scale);
+resolution_statistics_t resolution_statistics_get();
+
+#endif // RESOLUTION_H
@@ -0,0 +1,345 @@
+#include "base.h"
+#include "core.h"
+#include "math.h"
+#include "render.h"
+#include "shadow.h"
+#include <glad.h>
+
+//
+// cascaded shadow maps
+//
+
+global render_state_t _caster_old_state;
+global bool8_t _caster_active;
+
+internal uint32_t _shadow_texture_create(shadow_params_t params) {
+	uint32_t texture = 0;
+	uint32_t internal_format = (params.format == SHADOW_DEPTH_16) ? GL_DEPTH_COMPONENT16 : GL_DEPTH_COMPONENT24;
+	float32_t border[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internal_format, params.resolution, params.resolution, params.cascade_count, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+	
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	
+	return texture;
+}
+
+internal uint32_t _shadow_framebuffer_create(uint32_t texture) {
+	uint32_t fbo = 0;
+	
+	// depth only, the cascade layer is attached when the pass starts
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	
+	bool8_t complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	
+	if (!complete) {
+		glDeleteFramebuffers(1, &fbo);
+		return 0;
+	}
+	
+	return fbo;
+}
+
+shadow_map_t shadow_map_create(shadow_params_t params) {
+	shadow_map_t shadow = { 0 };
+	
+	if (!params.cascade_count) params.cascade_count = 3;
+	if (!params.resolution) params.resolution = 2048;
+	if (params.split_lambda == 0.0f) params.split_lambda = 0.75f;
+	if (params.caster_distance == 0.0f) params.caster_distance = 50.0f;
+	params.cascade_count = MIN(params.cascade_count, SHADOW_MAX_CASCADES);
+	shadow.params = params;
+	
+	// one sized depth layer per cascade, sampled with hardware comparison
+	shadow.texture = _shadow_texture_create(params);
+	shadow.fbo = _shadow_framebuffer_create(shadow.texture);
+	
+	// static casters only, copied into the live map every frame
+	shadow.cache_texture = _shadow_texture_create(params);
+	shadow.cache_fbo = _shadow_framebuffer_create(shadow.cache_texture);
+	shadow.cache_dirty = BIT(params.cascade_count) - 1;
+	
+	if (!shadow.fbo || !shadow.cache_fbo) {
+		os_message(OS_MESSAGE_ERROR, "Shadow framebuffer is not complete");
+		shadow_map_delete(&shadow);
+		return ZERO_STRUCT(shadow_map_t);
+	}
+	
+	const string_t caster_source = "#ifdef VERTEX_SHADER\n\nlayout (location = 0) in vec3 position;\n\nuniform mat4 view_light;\nuniform mat4 xform;\n\nvoid main() {\n	gl_Position = view_light * xform * vec4(position, 1.0);\n}\n\n#else\n\nvoid main() {\n}\n\n#endif";
+	shadow.caster_shader = shader_create(caster_source);
+	
+	return shadow;
+}
+
+void shadow_map_delete(shadow_map_t *shadow) {
+	if (shadow->fbo) {
+		glDeleteFramebuffers(1, &shadow->fbo);
+	}
+	
+	if (shadow->texture) {
+		glDeleteTextures(1, &shadow->texture);
+	}
+	
+	if (shadow->cache_fbo) {
+		glDeleteFramebuffers(1, &shadow->cache_fbo);
+	}
+	
+	if (shadow->cache_texture) {
+		glDeleteTextures(1, &shadow->cache_texture);
+	}
+	
+	free(shadow->casters);
+	
+	if (shadow->caster_shader) {
+		shader_delete(shadow->caster_shader);
+	}
+	
+	ZERO_MEMORY(shadow);
+}
+
+void shadow_map_update(shadow_map_t *shadow, vec3_t light_dir, matrix_t view, float32_t fov, float32_t aspect, float32_t znear, float32_t zfar) {
+	shadow_params_t *p = &shadow->params;
+	shadow->light_dir = normalize3(light_dir);
+	
+	float32_t range = (p->max_distance > 0.0f) ? MIN(p->max_distance, zfar) : zfar;
+	float32_t tan_y = tanf(DEG_TO_RAD(fov) / 2);
+	float32_t tan_x = tan_y * aspect;
+	matrix_t inv_view = matrix_inverse(view);
+	
+	// rotation only light view, keeps texel snapping stable while the camera moves
+	vec3_t up = (fabsf(shadow->light_dir.y) > 0.99f) ? (vec3_t){ 0.0f, 0.0f, 1.0f } : (vec3_t){ 0.0f, 1.0f, 0.0f };
+	matrix_t light_view = xform_lookat(ZERO_STRUCT(vec3_t), shadow->light_dir, up);
+	
+	float32_t split_near = znear;
+	for (uint32_t i = 0; i < p->cascade_count; ++i) {
+		// practical split scheme, blend of logarithmic and uniform
+		float32_t t = (float32_t)(i + 1) / p->cascade_count;
+		float32_t split_log = znear * powf(range / znear, t);
+		float32_t split_uniform = znear + (range - znear) * t;
+		float32_t split_far = p->split_lambda * split_log + (1.0f - p->split_lambda) * split_uniform;
+		
+		// world space corners of the frustum slice
+		vec3_t corners[8];
+		vec3_t center = { 0 };
+		for (uint32_t j = 0; j < 8; ++j) {
+			float32_t d = (j < 4) ? split_near : split_far;
+			vec4_t corner = {
+				((j & 1) ? 1.0f : -1.0f) * d * tan_x,
+				((j & 2) ? 1.0f : -1.0f) * d * tan_y,
+				-d,
+				1.0f
+			};
+			
+			corner = matrix_transform(inv_view, corner);
+			corners[j] = (vec3_t){ corner.x, corner.y, corner.z };
+			center = add3(center, corners[j]);
+		}
+		
+		center = mul3(center, vec3_scalar(1.0f / 8.0f));
+		
+		// bounding sphere, so the cascade size is independent of camera rotation
+		float32_t radius = 0.0f;
+		for (uint32_t j = 0; j < 8; ++j) {
+			radius = MAX(radius, distance3(center, corners[j]));
+		}
+		
+		radius = ceilf(radius * 16.0f) / 16.0f;
+		
+		// snap the center to whole shadow map texels
+		float32_t texel = (2.0f * radius) / p->resolution;
+		vec4_t c = matrix_transform(light_view, (vec4_t){ center.x, center.y, center.z, 1.0f });
+		c.x = floorf(c.x / texel) * texel;
+		c.y = floorf(c.y / texel) * texel;
+		c.z = floorf(c.z / texel) * texel;
+		
+		matrix_t projection = matrix_projection_ortho(c.x - radius, c.x + radius, c.y - radius, c.y + radius,
+													  -c.z - radius - p->caster_distance, -c.z + radius);
+		
+		// snapping keeps the matrix bit identical until the cascade really moves
+		matrix_t view_light = matrix_mul(light_view, projection);
+		if (memcmp(&view_light, &shadow->view_light[i], sizeof(matrix_t)) != 0) {
+			shadow->cache_dirty |= BIT(i);
+		}
+		
+		shadow->view_light[i] = view_light;
+		shadow->splits[i] = split_far;
+		split_near = split_far;
+	}
+}
+
+internal void _shadow_pass_begin(shadow_map_t *shadow, uint32_t fbo, uint32_t texture, uint32_t cascade, bool8_t clear) {
+	if (!_caster_active) {
+		_caster_old_state = render_state_get();
+		_caster_active = true;
+	}
+	
+	render_state_set((render_state_t){ .depth_testing = true, .blending = false, .face_culling = _caster_old_state.face_culling, .wireframe = false });
+	
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, cascade);
+	glViewport(0, 0, shadow->params.resolution, shadow->params.resolution);
+	
+	if (clear) {
+		glClear(GL_DEPTH_BUFFER_BIT);
+	}
+	
+	// slope scaled bias at raster time instead of a per fragment constant
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(2.0f, 4.0f);
+	
+	shader_bind(shadow->caster_shader);
+	shader_uniform_matrix(shadow->caster_shader, "view_light", shadow->view_light[cascade]);
+}
+
+internal void _shadow_casters_draw(shadow_map_t *shadow, bool8_t is_static) {
+	for (uint32_t i = 0; i < shadow->caster_count; ++i) {
+		shadow_caster_t *caster = &shadow->casters[i];
+		if (caster->active && caster->is_static == is_static) {
+			shader_uniform_matrix(shadow->caster_shader, "xform", caster->xform);
+			mesh_draw(caster->mesh);
+		}
+	}
+}
+
+void shadow_map_begin(shadow_map_t *shadow, uint32_t cascade) {
+	// manual passes bypass the cache, so the live layer no longer matches it
+	_shadow_pass_begin(shadow, shadow->fbo, shadow->texture, cascade, true);
+	shadow->live_has_dynamic |= BIT(cascade);
+}
+
+void shadow_map_end() {
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	framebuffer_unbind();
+	render_state_set(_caster_old_state);
+	_caster_active = false;
+}
+
+// casters
+uint32_t shadow_caster_add(shadow_map_t *shadow, mesh_t *mesh, matrix_t xform, bool8_t is_static) {
+	uint32_t index = shadow->caster_count;
+	
+	// reuse removed slots so handles stay small
+	for (uint32_t i = 0; i < shadow->caster_count; ++i) {
+		if (!shadow->casters[i].active) {
+			index = i;
+			break;
+		}
+	}
+	
+	if (index == shadow->caster_count) {
+		if (shadow->caster_count == shadow->caster_capacity) {
+			shadow->caster_capacity = MAX(16, shadow->caster_capacity * 2);
+			shadow->casters = realloc(shadow->casters, shadow->caster_capacity * sizeof(shadow_caster_t));
+		}
+		
+		++shadow->caster_count;
+	}
+	
+	shadow->casters[index] = (shadow_caster_t){ mesh, xform, is_static, true };
+	
+	if (is_static) {
+		shadow_map_invalidate(shadow);
+	} else {
+		++shadow->dynamic_count;
+	}
+	
+	return index;
+}
+
+void shadow_caster_move(shadow_map_t *shadow, uint32_t caster, matrix_t xform) {
+	shadow_caster_t *c = &shadow->casters[caster];
+	
+	if (c->is_static && memcmp(&c->xform, &xform, sizeof(matrix_t)) != 0) {
+		shadow_map_invalidate(shadow);
+	}
+	
+	c->xform = xform;
+}
+
+void shadow_caster_remove(shadow_map_t *shadow, uint32_t caster) {
+	shadow_caster_t *c = &shadow->casters[caster];
+	if (!c->active) {
+		return;
+	}
+	
+	if (c->is_static) {
+		shadow_map_invalidate(shadow);
+	} else {
+		--shadow->dynamic_count;
+	}
+	
+	c->active = false;
+}
+
+void shadow_map_invalidate(shadow_map_t *shadow) {
+	shadow->cache_dirty = BIT(shadow->params.cascade_count) - 1;
+}
+
+void shadow_map_render(shadow_map_t *shadow) {
+	int32_t res = shadow->params.resolution;
+	
+	for (uint32_t i = 0; i < shadow->params.cascade_count; ++i) {
+		bool8_t dirty = (shadow->cache_dirty & BIT(i)) != 0;
+		
+		// nothing moved and the live layer already equals the cache
+		if (!dirty && !shadow->dynamic_count && !(shadow->live_has_dynamic & BIT(i))) {
+			continue;
+		}
+		
+		if (dirty) {
+			_shadow_pass_begin(shadow, shadow->cache_fbo, shadow->cache_texture, i, true);
+			_shadow_casters_draw(shadow, true);
+		}
+		
+		// copy the static depth into the live layer
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, shadow->cache_fbo);
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadow->cache_texture, 0, i);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadow->fbo);
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadow->texture, 0, i);
+		glBlitFramebuffer(0, 0, res, res, 0, 0, res, res, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		
+		if (shadow->dynamic_count) {
+			_shadow_pass_begin(shadow, shadow->fbo, shadow->texture, i, false);
+			_shadow_casters_draw(shadow, false);
+			shadow->live_has_dynamic |= BIT(i);
+		} else {
+			shadow->live_has_dynamic &= ~BIT(i);
+		}
+	}
+	
+	shadow->cache_dirty = 0;
+	
+	if (_caster_active) {
+		shadow_map_end();
+	} else {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+}
+
+void shadow_map_bind(shadow_map_t *shadow, shader_t shader, uint32_t slot) {
+	glActiveTexture(GL_TEXTURE0 + slot);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, shadow->texture);
+	
+	vec4_t splits = { 0 };
+	memcpy(&splits, shadow->splits, sizeof(float32_t) * shadow->params.cascade_count);
+	
+	shader_uniform_texture(shader, "shadow_map", slot);
+	shader_uniform_matrix_array(shader, "shadow_view_light", shadow->view_light, shadow->params.cascade_count);
+	shader_uniform_vec4(shader, "shadow_splits", splits);
+	shader_uniform_int(shader, "shadow_cascade_count", shadow->params.cascade_count);
+	shader_uniform_vec3(shader, "shadow_light_dir", shadow->light_dir);
+}
@@ -0,0 +1,71 @@
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include "base.h"
+#include "math.h"
+#include "render.h"
+
+//
+// cascaded shadow maps
+//
+
+#define SHADOW_MAX_CASCADES 4
+
+typedef enum shadow_depth_format {
+	SHADOW_DEPTH_24,
+	SHADOW_DEPTH_16
+} shadow_depth_format_e;
+
+typedef struct shadow_params {
+	uint32_t cascade_count;        // 1 - SHADOW_MAX_CASCADES, 0 picks 3
+	int32_t resolution;            // per cascade, 0 picks 2048
+	shadow_depth_format_e format;
+	float32_t max_distance;        // shadow range from the camera, 0 uses the camera far plane
+	float32_t split_lambda;        // 0 = uniform splits, 1 = logarithmic splits
+	float32_t caster_distance;     // how far behind a cascade casters are still captured
+} shadow_params_t;
+
+typedef struct shadow_caster {
+	mesh_t *mesh;
+	matrix_t xform;
+	bool8_t is_static, active;
+} shadow_caster_t;
+
+typedef struct shadow_map {
+	uint32_t fbo, texture;
+	shader_t caster_shader;
+	shadow_params_t params;
+	vec3_t light_dir;
+	float32_t splits[SHADOW_MAX_CASCADES];
+	matrix_t view_light[SHADOW_MAX_CASCADES];
+	
+	// static casters are cached per cascade and only redrawn when dirty
+	uint32_t cache_fbo, cache_texture;
+	uint32_t cache_dirty, live_has_dynamic; // cascade bitmasks
+	shadow_caster_t *casters;
+	uint32_t caster_count, caster_capacity, dynamic_count;
+} shadow_map_t;
+
+shadow_map_t shadow_map_create(shadow_params_t params);
+void shadow_map_delete(shadow_map_t *shadow);
+
+// fits every cascade to a slice of the camera frustum, light_dir points from the light into the scene
+void shadow_map_update(shadow_map_t *shadow, vec3_t light_dir, matrix_t view, float32_t fov, float32_t aspect, float32_t znear, float32_t zfar);
+
+// depth only caster pass, binds caster_shader, draw with its "xform" uniform set
+void shadow_map_begin(shadow_map_t *shadow, uint32_t cascade);
+void shadow_map_end();
+
+// registered casters, moving or removing a static caster invalidates the cache
+uint32_t shadow_caster_add(shadow_map_t *shadow, mesh_t *mesh, matrix_t xform, bool8_t is_static);
+void shadow_caster_move(shadow_map_t *shadow, uint32_t caster, matrix_t xform);
+void shadow_caster_remove(shadow_map_t *shadow, uint32_t caster);
+void shadow_map_invalidate(shadow_map_t *shadow);
+
+// caster pass for registered casters, copies the static cache and draws only dynamic casters on top
+void shadow_map_render(shadow_map_t *shadow);
+
+// sets shadow_map, shadow_view_light[], shadow_splits and shadow_cascade_count on a lit shader
+void shadow_map_bind(shadow_map_t *shadow, shader_t shader, uint32_t slot);
+
+#endif // SHADOW_H
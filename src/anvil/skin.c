@@ -0,0 +1,464 @@
+#include "base.h"
+#include "core.h"
+#include "math.h"
+#include "render.h"
+#include "job.h"
+#include "skin.h"
+#include <glad.h>
+#include <assimp/cimport.h>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SKIN_SIMD 1
+#endif
+
+//
+// skeletons
+//
+
+typedef struct skin_palette_job {
+	skeleton_t *skeleton;
+	joint_pose_t *poses;
+	matrix_t *worlds;
+	matrix_t *palettes;
+} skin_palette_job_t;
+
+// row vector product, out may not alias a or b
+internal void _skin_matrix_mul(const matrix_t *a, const matrix_t *b, matrix_t *out) {
+#if SKIN_SIMD
+	__m128 b0 = _mm_loadu_ps(b->elements[0]);
+	__m128 b1 = _mm_loadu_ps(b->elements[1]);
+	__m128 b2 = _mm_loadu_ps(b->elements[2]);
+	__m128 b3 = _mm_loadu_ps(b->elements[3]);
+	
+	for (uint32_t i = 0; i < 4; ++i) {
+		__m128 row = _mm_mul_ps(_mm_set1_ps(a->elements[i][0]), b0);
+		row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a->elements[i][1]), b1));
+		row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a->elements[i][2]), b2));
+		row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a->elements[i][3]), b3));
+		_mm_storeu_ps(out->elements[i], row);
+	}
+#else
+	*out = matrix_mul(*a, *b);
+#endif
+}
+
+void skeleton_delete(skeleton_t *skeleton) {
+	free(skeleton->joints);
+	free(skeleton->bone_joints);
+	free(skeleton->inverse_binds);
+	ZERO_MEMORY(skeleton);
+}
+
+int32_t skeleton_find(skeleton_t *skeleton, string_t name) {
+	for (uint32_t i = 0; i < skeleton->joint_count; ++i) {
+		if (!strcmp(skeleton->joints[i].name, name)) {
+			return (int32_t)i;
+		}
+	}
+	
+	return -1;
+}
+
+void skeleton_pose_bind(skeleton_t *skeleton, joint_pose_t *pose) {
+	for (uint32_t i = 0; i < skeleton->joint_count; ++i) {
+		pose[i] = skeleton->joints[i].bind;
+	}
+}
+
+void skeleton_palette(skeleton_t *skeleton, joint_pose_t *pose, matrix_t world, matrix_t *palette) {
+	matrix_t globals[SKIN_MAX_JOINTS];
+	
+	// parents come first, so one pass resolves the hierarchy
+	for (uint32_t i = 0; i < skeleton->joint_count; ++i) {
+		matrix_t local = xform_trs(pose[i].pos, pose[i].rot, pose[i].scale);
+		int32_t parent = skeleton->joints[i].parent;
+		_skin_matrix_mul(&local, parent < 0 ? &world : &globals[parent], &globals[i]);
+	}
+	
+	for (uint32_t i = 0; i < skeleton->bone_count; ++i) {
+		_skin_matrix_mul(&skeleton->inverse_binds[i], &globals[skeleton->bone_joints[i]], &palette[i]);
+	}
+}
+
+internal void _skin_palettes(void *data, uint32_t start, uint32_t end) {
+	skin_palette_job_t *job = data;
+	skeleton_t *skeleton = job->skeleton;
+	
+	for (uint32_t i = start; i < end; ++i) {
+		skeleton_palette(skeleton, job->poses + i * skeleton->joint_count, job->worlds[i], job->palettes + i * skeleton->bone_count);
+	}
+}
+
+void skeleton_palettes(skeleton_t *skeleton, joint_pose_t *poses, matrix_t *worlds, uint32_t count, matrix_t *palettes) {
+	skin_palette_job_t job = { skeleton, poses, worlds, palettes };
+	job_parallel_for(count, 16, _skin_palettes, &job);
+}
+
+//
+// skinned meshes
+//
+
+global struct {
+	uint32_t palette_buffer, palette_texture;
+	uint32_t palette_capacity;          // matrices
+	int32_t max_texels;
+} _skin;
+
+internal matrix_t _skin_ai_matrix(struct aiMatrix4x4 *m) {
+	// assimp multiplies column vectors, the engine row vectors
+	return (matrix_t){{
+		{ m->a1, m->b1, m->c1, m->d1 },
+		{ m->a2, m->b2, m->c2, m->d2 },
+		{ m->a3, m->b3, m->c3, m->d3 },
+		{ m->a4, m->b4, m->c4, m->d4 }
+	}};
+}
+
+// bones of all meshes by name, meshes weighted to the same node share its bone
+internal int32_t _skin_bone_find(struct aiBone **bones, uint32_t count, struct aiString *name) {
+	for (uint32_t i = 0; i < count; ++i) {
+		if (!strcmp(bones[i]->mName.data, name->data)) {
+			return (int32_t)i;
+		}
+	}
+	
+	return -1;
+}
+
+internal bool8_t _skin_has_bones(struct aiBone **bones, uint32_t count, struct aiNode *node) {
+	if (_skin_bone_find(bones, count, &node->mName) >= 0) {
+		return true;
+	}
+	
+	for (uint32_t i = 0; i < node->mNumChildren; ++i) {
+		if (_skin_has_bones(bones, count, node->mChildren[i])) {
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+// depth first so parents always precede their children, branches without bones are dropped.
+// fails on more than SKIN_MAX_JOINTS joints or a name that does not fit, either would skin wrong
+internal bool8_t _skin_collect(skeleton_t *skeleton, struct aiBone **bones, uint32_t count, struct aiNode *node, int32_t parent) {
+	if (!_skin_has_bones(bones, count, node)) {
+		return true;
+	}
+	
+	if (skeleton->joint_count == SKIN_MAX_JOINTS) {
+		os_message(OS_MESSAGE_ERROR, "Skeleton has more than %d joints", SKIN_MAX_JOINTS);
+		return false;
+	}
+	
+	if (node->mName.length >= SKIN_MAX_NAME) {
+		os_message(OS_MESSAGE_ERROR, "Joint name longer than %d characters\nName: %s", SKIN_MAX_NAME - 1, node->mName.data);
+		return false;
+	}
+	
+	joint_t *joint = &skeleton->joints[skeleton->joint_count];
+	int32_t index = (int32_t)skeleton->joint_count++;
+	
+	struct aiVector3D scale, pos;
+	struct aiQuaternion rot;
+	aiDecomposeMatrix(&node->mTransformation, &scale, &rot, &pos);
+	
+	memcpy(joint->name, node->mName.data, node->mName.length);
+	joint->name[node->mName.length] = '\0';
+	joint->parent = parent;
+	joint->bind = (joint_pose_t){ { pos.x, pos.y, pos.z }, { rot.x, rot.y, rot.z, rot.w }, { scale.x, scale.y, scale.z } };
+	
+	for (uint32_t i = 0; i < node->mNumChildren; ++i) {
+		if (!_skin_collect(skeleton, bones, count, node->mChildren[i], index)) {
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+// keeps the four largest weights per vertex, sorted
+internal void _skin_weight(float32_t (*weights)[4], uint8_t (*joints)[4], uint32_t vertex, uint32_t bone, float32_t weight) {
+	float32_t *w = weights[vertex];
+	uint8_t *j = joints[vertex];
+	
+	if (weight <= w[3]) {
+		return;
+	}
+	
+	int32_t slot = 3;
+	while (slot > 0 && w[slot - 1] < weight) {
+		w[slot] = w[slot - 1];
+		j[slot] = j[slot - 1];
+		--slot;
+	}
+	
+	w[slot] = weight;
+	j[slot] = (uint8_t)bone;
+}
+
+void skin_init() {
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &_skin.max_texels);
+	glGenBuffers(1, &_skin.palette_buffer);
+	glGenTextures(1, &_skin.palette_texture);
+}
+
+void skin_close() {
+	glDeleteBuffers(1, &_skin.palette_buffer);
+	glDeleteTextures(1, &_skin.palette_texture);
+	ZERO_MEMORY(&_skin);
+}
+
+skin_mesh_t skin_mesh_load(string_t path) {
+	// no graph optimization, it would merge the nodes the bones hang from
+	const struct aiScene *scene = aiImportFile(path, aiProcess_Triangulate | aiProcess_FlipUVs |
+											   aiProcess_GenNormals | aiProcess_JoinIdenticalVertices |
+											   aiProcess_LimitBoneWeights);
+	
+	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode || !scene->mNumMeshes) {
+		os_message(OS_MESSAGE_ERROR, "Failed to load mesh\nPath: %s", path);
+		return ZERO_STRUCT(skin_mesh_t);
+	}
+	
+	// every mesh with bones goes into the one draw, meshes without any are skipped
+	struct aiBone *bones[SKIN_MAX_JOINTS];
+	uint32_t bone_count = 0, vertex_count = 0, index_count = 0;
+	bool8_t too_many = false;
+	
+	for (uint32_t i = 0; i < scene->mNumMeshes; ++i) {
+		struct aiMesh *ai_mesh = scene->mMeshes[i];
+		if (!ai_mesh->mNumBones) {
+			continue;
+		}
+		
+		for (uint32_t j = 0; j < ai_mesh->mNumBones; ++j) {
+			if (_skin_bone_find(bones, bone_count, &ai_mesh->mBones[j]->mName) >= 0) {
+				continue;
+			}
+			
+			if (bone_count == SKIN_MAX_JOINTS) {
+				too_many = true;
+				break;
+			}
+			
+			bones[bone_count++] = ai_mesh->mBones[j];
+		}
+		
+		vertex_count += ai_mesh->mNumVertices;
+		for (uint32_t j = 0; j < ai_mesh->mNumFaces; ++j) {
+			index_count += ai_mesh->mFaces[j].mNumIndices;
+		}
+	}
+	
+	if (!bone_count || too_many) {
+		os_message(OS_MESSAGE_ERROR, "Skinned mesh needs between 1 and %d bones\nPath: %s", SKIN_MAX_JOINTS, path);
+		aiReleaseImport(scene);
+		return ZERO_STRUCT(skin_mesh_t);
+	}
+	
+	skin_mesh_t m = { 0 };
+	
+	// Skeleton
+	skeleton_t *skeleton = &m.skeleton;
+	skeleton->joints = calloc(SKIN_MAX_JOINTS, sizeof(joint_t));
+	skeleton->bone_count = bone_count;
+	skeleton->bone_joints = calloc(skeleton->bone_count, sizeof(uint32_t));
+	skeleton->inverse_binds = malloc(skeleton->bone_count * sizeof(matrix_t));
+	bool8_t complete = _skin_collect(skeleton, bones, bone_count, scene->mRootNode, -1);
+	
+	// the first mesh using a bone decides its bind pose
+	for (uint32_t i = 0; complete && i < bone_count; ++i) {
+		int32_t joint = skeleton_find(skeleton, bones[i]->mName.data);
+		if (joint < 0) {
+			os_message(OS_MESSAGE_ERROR, "Bone without a node in the hierarchy\nName: %s", bones[i]->mName.data);
+			complete = false;
+			break;
+		}
+		
+		skeleton->bone_joints[i] = (uint32_t)joint;
+		skeleton->inverse_binds[i] = _skin_ai_matrix(&bones[i]->mOffsetMatrix);
+	}
+	
+	if (!complete) {
+		os_message(OS_MESSAGE_ERROR, "Failed to load skeleton\nPath: %s", path);
+		skeleton_delete(skeleton);
+		aiReleaseImport(scene);
+		return ZERO_STRUCT(skin_mesh_t);
+	}
+	
+	m.mesh = mesh_create(vertex_count, index_count);
+	
+	float32_t (*weights)[4] = calloc(MAX(vertex_count, 1), sizeof(*weights));
+	uint8_t (*joints)[4] = calloc(MAX(vertex_count, 1), sizeof(*joints));
+	
+	for (uint32_t i = 0; i < scene->mNumMeshes; ++i) {
+		struct aiMesh *ai_mesh = scene->mMeshes[i];
+		uint32_t base = m.mesh.curr_vertex;
+		if (!ai_mesh->mNumBones) {
+			continue;
+		}
+		
+		// Vertices
+		for (uint32_t j = 0; j < ai_mesh->mNumVertices; ++j) {
+			vertex_t vertex = { 0 };
+			vertex.pos = (vec3_t){ ai_mesh->mVertices[j].x, ai_mesh->mVertices[j].y, ai_mesh->mVertices[j].z };
+			vertex.normal = (vec3_t){ ai_mesh->mNormals[j].x, ai_mesh->mNormals[j].y, ai_mesh->mNormals[j].z };
+			vertex.color = vec4_scalar(1.0f);
+			
+			if (ai_mesh->mColors[0]) {
+				vertex.color = (vec4_t){ ai_mesh->mColors[0][j].r, ai_mesh->mColors[0][j].g, ai_mesh->mColors[0][j].b, ai_mesh->mColors[0][j].a };
+			}
+			
+			if (ai_mesh->mTextureCoords[0]) {
+				vertex.uv = (vec2_t){ ai_mesh->mTextureCoords[0][j].x, ai_mesh->mTextureCoords[0][j].y };
+			}
+			
+			mesh_push_vertex(&m.mesh, vertex);
+		}
+		
+		// Indices
+		for (uint32_t j = 0; j < ai_mesh->mNumFaces; ++j) {
+			struct aiFace face = ai_mesh->mFaces[j];
+			for (uint32_t k = 0; k < face.mNumIndices; ++k) {
+				mesh_push_index(&m.mesh, base + (uint32_t)face.mIndices[k]);
+			}
+		}
+		
+		// Weights
+		for (uint32_t j = 0; j < ai_mesh->mNumBones; ++j) {
+			struct aiBone *bone = ai_mesh->mBones[j];
+			int32_t index = _skin_bone_find(bones, bone_count, &bone->mName);
+			if (index < 0) {
+				continue;
+			}
+			
+			for (uint32_t k = 0; k < bone->mNumWeights; ++k) {
+				struct aiVertexWeight w = bone->mWeights[k];
+				if (w.mVertexId < ai_mesh->mNumVertices) {
+					_skin_weight(weights, joints, base + w.mVertexId, (uint32_t)index, w.mWeight);
+				}
+			}
+		}
+	}
+	
+	// quantize, rounding error goes to the strongest influence so every vertex sums to 255
+	m.skin = calloc(MAX(vertex_count, 1), sizeof(skin_vertex_t));
+	for (uint32_t i = 0; i < vertex_count; ++i) {
+		float32_t *w = weights[i];
+		float32_t sum = w[0] + w[1] + w[2] + w[3];
+		skin_vertex_t *s = &m.skin[i];
+		memcpy(s->joints, joints[i], 4);
+		
+		if (sum <= 0.0f) {
+			s->weights[0] = 255;
+			continue;
+		}
+		
+		int32_t total = 0;
+		for (uint32_t k = 1; k < 4; ++k) {
+			s->weights[k] = (uint8_t)(w[k] / sum * 255.0f + 0.5f);
+			total += s->weights[k];
+		}
+		
+		s->weights[0] = (uint8_t)(255 - total);
+	}
+	
+	free(weights);
+	free(joints);
+	aiReleaseImport(scene);
+	
+	skin_mesh_upload(&m);
+	return m;
+}
+
+void skin_mesh_upload(skin_mesh_t *mesh) {
+	int32_t old_vao = 0, old_buffer = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &old_buffer);
+	
+	if (!mesh->vao) {
+		glGenVertexArrays(1, &mesh->vao);
+		glGenBuffers(1, &mesh->vbo);
+		glGenBuffers(1, &mesh->skin_vbo);
+		glGenBuffers(1, &mesh->ebo);
+	}
+	
+	// static buffers, unlike mesh_draw nothing is sent again per draw
+	glBindVertexArray(mesh->vao);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+	glBufferData(GL_ARRAY_BUFFER, mesh->mesh.curr_vertex * sizeof(vertex_t), mesh->mesh.vertices, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, pos));
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, uv));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, color));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, normal));
+	glEnableVertexAttribArray(3);
+	
+	glBindBuffer(GL_ARRAY_BUFFER, mesh->skin_vbo);
+	glBufferData(GL_ARRAY_BUFFER, mesh->mesh.curr_vertex * sizeof(skin_vertex_t), mesh->skin, GL_STATIC_DRAW);
+	glVertexAttribIPointer(4, 4, GL_UNSIGNED_BYTE, sizeof(skin_vertex_t), (void *)offsetof(skin_vertex_t, joints));
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(5, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(skin_vertex_t), (void *)offsetof(skin_vertex_t, weights));
+	glEnableVertexAttribArray(5);
+	
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->mesh.curr_index * sizeof(uint32_t), mesh->mesh.indices, GL_STATIC_DRAW);
+	
+	glBindVertexArray(old_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, old_buffer);
+}
+
+void skin_mesh_delete(skin_mesh_t *mesh) {
+	if (mesh->vao) {
+		glDeleteVertexArrays(1, &mesh->vao);
+		glDeleteBuffers(1, &mesh->vbo);
+		glDeleteBuffers(1, &mesh->skin_vbo);
+		glDeleteBuffers(1, &mesh->ebo);
+	}
+	
+	mesh_delete(&mesh->mesh);
+	skeleton_delete(&mesh->skeleton);
+	free(mesh->skin);
+	ZERO_MEMORY(mesh);
+}
+
+void skin_mesh_draw(skin_mesh_t *mesh, matrix_t *palettes, uint32_t count, shader_t shader, uint32_t slot) {
+	uint32_t bones = mesh->skeleton.bone_count;
+	if (!count || !bones || !mesh->vao) {
+		return;
+	}
+	
+	// a buffer texture is limited in texels, split the instances to fit
+	uint32_t batch = MAX((uint32_t)_skin.max_texels / (bones * 4), 1u);
+	int32_t old_vao = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+	
+	shader_uniform_texture(shader, "skin_palette", slot);
+	shader_uniform_int(shader, "skin_bones", (int32_t)bones);
+	glBindVertexArray(mesh->vao);
+	
+	for (uint32_t first = 0; first < count; first += batch) {
+		uint32_t instances = MIN(batch, count - first);
+		uint32_t matrices = instances * bones;
+		
+		// orphaned every batch, the previous draw may still read the old storage
+		glBindBuffer(GL_TEXTURE_BUFFER, _skin.palette_buffer);
+		_skin.palette_capacity = MAX(_skin.palette_capacity, matrices);
+		glBufferData(GL_TEXTURE_BUFFER, _skin.palette_capacity * sizeof(matrix_t), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, matrices * sizeof(matrix_t), palettes + first * bones);
+		
+		glActiveTexture(GL_TEXTURE0 + slot);
+		glBindTexture(GL_TEXTURE_BUFFER, _skin.palette_texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, _skin.palette_buffer);
+		
+		glDrawElementsInstanced(GL_TRIANGLES, mesh->mesh.curr_index, GL_UNSIGNED_INT, NULL, instances);
+	}
+	
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glBindVertexArray(old_vao);
+}
@@ -0,0 +1,77 @@
+#ifndef SKIN_H
+#define SKIN_H
+
+#include "base.h"
+#include "math.h"
+#include "render.h"
+
+//
+// skeletons
+//
+
+// bones are addressed by a byte in the vertex stream
+#define SKIN_MAX_JOINTS 256
+#define SKIN_MAX_NAME 64                // with the terminator, longer names fail the import
+
+typedef struct joint_pose {
+	vec3_t pos;
+	vec4_t rot;                         // unit quaternion
+	vec3_t scale;
+} joint_pose_t;
+
+typedef struct joint {
+	char name[SKIN_MAX_NAME];
+	int32_t parent;                     // always lower than the joint's own index, -1 for roots
+	joint_pose_t bind;                  // local transform relative to the parent
+} joint_t;
+
+// joints are the node hierarchy, bones are the joints the vertices are weighted to
+typedef struct skeleton {
+	uint32_t joint_count, bone_count;
+	joint_t *joints;
+	uint32_t *bone_joints;
+	matrix_t *inverse_binds;
+} skeleton_t;
+
+void skeleton_delete(skeleton_t *skeleton);
+int32_t skeleton_find(skeleton_t *skeleton, string_t name);
+
+// fills joint_count local poses with the bind pose
+void skeleton_pose_bind(skeleton_t *skeleton, joint_pose_t *pose);
+
+// bone_count matrices taking bind space vertices to world space
+void skeleton_palette(skeleton_t *skeleton, joint_pose_t *pose, matrix_t world, matrix_t *palette);
+
+// one palette per instance across the job threads, poses and palettes are packed per instance
+void skeleton_palettes(skeleton_t *skeleton, joint_pose_t *poses, matrix_t *worlds, uint32_t count, matrix_t *palettes);
+
+//
+// skinned meshes
+//
+
+// four strongest influences, weights are unorm bytes summing to 255
+typedef struct skin_vertex {
+	uint8_t joints[4];
+	uint8_t weights[4];
+} skin_vertex_t;
+
+typedef struct skin_mesh {
+	mesh_t mesh;
+	skin_vertex_t *skin;
+	skeleton_t skeleton;
+	uint32_t vao, vbo, skin_vbo, ebo;
+} skin_mesh_t;
+
+void skin_init();
+void skin_close();
+
+// imports every mesh of the file with bones as one mesh, skeleton and draw, and uploads it once
+skin_mesh_t skin_mesh_load(string_t path);
+void skin_mesh_upload(skin_mesh_t *mesh);
+void skin_mesh_delete(skin_mesh_t *mesh);
+
+// draws count instances, palettes holds bone_count matrices per instance. they are read in
+// the vertex shader from the samplerBuffer skin_palette bound to slot, skin_bones is the stride
+void skin_mesh_draw(skin_mesh_t *mesh, matrix_t *palettes, uint32_t count, shader_t shader, uint32_t slot);
+
+#endif // SKIN_H
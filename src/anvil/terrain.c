@@ -0,0 +1,408 @@
+#include "base.h"
+#include "core.h"
+#include "math.h"
+#include "render.h"
+#include "terrain.h"
+#include <glad.h>
+
+//
+// terrain
+//
+
+global struct {
+	shader_t shader;
+} _terrain;
+
+// positions are whole cells of the level times the cell size, so the shared edge of two levels
+// lands on the same floats. close to its outer edge a level blends its odd vertices to the
+// heights of the coarser level, which hides the t junctions between them
+const string_t _terrain_source =
+	"uniform sampler2D heightmap;\n"
+	"uniform vec2 map_origin;\n"
+	"uniform vec2 map_size;\n"
+	"uniform float texel_size;\n"
+	"uniform float height_scale;\n"
+	"uniform float cell_size;\n"
+	"\n"
+	"float height(vec2 xz, float lod) {\n"
+	"	vec2 uv = ((xz - map_origin) / texel_size + 0.5) / map_size;\n"
+	"	return textureLod(heightmap, uv, lod).r * height_scale;\n"
+	"}\n"
+	"\n"
+	"float level_lod(float spacing) {\n"
+	"	return max(log2(spacing / texel_size), 0.0);\n"
+	"}\n"
+	"\n"
+	"#ifdef VERTEX_SHADER\n"
+	"\n"
+	"layout (location = 0) in vec2 grid;\n"
+	"layout (location = 1) in vec3 offset;\n"
+	"\n"
+	"uniform mat4 view_projection;\n"
+	"uniform ivec2 level_origin[12];\n"
+	"uniform int block;\n"
+	"\n"
+	"out vec3 world_pos;\n"
+	"flat out float spacing;\n"
+	"\n"
+	"void main() {\n"
+	"	int level = int(offset.z);\n"
+	"	ivec2 cell = ivec2(offset.xy + grid);\n"
+	"	ivec2 global_cell = level_origin[level] + cell;\n"
+	"	ivec2 odd = global_cell & 1;\n"
+	"	spacing = cell_size * exp2(float(level));\n"
+	"	\n"
+	"	vec2 xz = vec2(global_cell) * spacing;\n"
+	"	float fine = height(xz, level_lod(spacing));\n"
+	"	float lod = level_lod(spacing * 2.0);\n"
+	"	float coarse = (height(vec2(global_cell - odd) * spacing, lod) + height(vec2(global_cell + odd) * spacing, lod)) * 0.5;\n"
+	"	\n"
+	"	float half_size = float(2 * block + 1);\n"
+	"	vec2 d = abs(vec2(cell) - half_size);\n"
+	"	float blend_width = max(float(block / 4), 2.0);\n"
+	"	float alpha = clamp((max(d.x, d.y) - (half_size - blend_width - 1.0)) / blend_width, 0.0, 1.0);\n"
+	"	\n"
+	"	world_pos = vec3(xz.x, mix(fine, coarse, alpha), xz.y);\n"
+	"	gl_Position = view_projection * vec4(world_pos, 1.0);\n"
+	"}\n"
+	"\n"
+	"#else\n"
+	"\n"
+	"in vec3 world_pos;\n"
+	"flat in float spacing;\n"
+	"\n"
+	"uniform vec3 light_dir;\n"
+	"\n"
+	"out vec4 frag_color;\n"
+	"\n"
+	"void main() {\n"
+	"	float e = max(spacing, texel_size);\n"
+	"	float lod = level_lod(spacing);\n"
+	"	vec2 xz = world_pos.xz;\n"
+	"	float dx = height(xz - vec2(e, 0.0), lod) - height(xz + vec2(e, 0.0), lod);\n"
+	"	float dz = height(xz - vec2(0.0, e), lod) - height(xz + vec2(0.0, e), lod);\n"
+	"	vec3 normal = normalize(vec3(dx, 2.0 * e, dz));\n"
+	"	\n"
+	"	vec3 color = mix(vec3(0.42, 0.40, 0.37), vec3(0.30, 0.45, 0.20), smoothstep(0.7, 0.9, normal.y));\n"
+	"	float light = 0.35 + 0.65 * max(dot(normal, -normalize(light_dir)), 0.0);\n"
+	"	frag_color = vec4(color * light, 1.0);\n"
+	"}\n"
+	"\n"
+	"#endif";
+
+void terrain_init() {
+	_terrain.shader = shader_create(_terrain_source);
+}
+
+void terrain_close() {
+	shader_delete(_terrain.shader);
+	ZERO_MEMORY(&_terrain);
+}
+
+//
+// geometry
+//
+
+// cells of every mesh along x and z, in blocks and extra cells
+const int32_t _terrain_mesh_size[TERRAIN_MESH_COUNT][4] = {
+	{ 1, 0, 1, 0 },
+	{ 1, 0, 0, 2 },
+	{ 0, 2, 1, 0 },
+	{ 2, 1, 0, 1 },
+	{ 0, 1, 2, 2 }
+};
+
+internal void _terrain_mesh_cells(uint32_t block, uint32_t mesh, uint32_t *x, uint32_t *z) {
+	*x = _terrain_mesh_size[mesh][0] * block + _terrain_mesh_size[mesh][1];
+	*z = _terrain_mesh_size[mesh][2] * block + _terrain_mesh_size[mesh][3];
+}
+
+// level origins sit on even cells of their level so the next level's cells line up with them. a
+// level is 2 * block + 1 cells of the next one, which leaves one of them for the trims
+internal int32_t _terrain_snap(float32_t position, float32_t spacing, uint32_t block) {
+	return 2 * (int32_t)floorf(position / (2.0f * spacing)) - 2 * (int32_t)block;
+}
+
+// the trims cover the one cell wide l left over by the inner level, on the side facing its parity
+internal void _terrain_trims(terrain_t *terrain, uint32_t level, vec3_t *trim_x, vec3_t *trim_z) {
+	int32_t m = (int32_t)terrain->params.block;
+	int32_t shift_x = terrain->level_x[level - 1] / 2 - terrain->level_x[level] - m;
+	int32_t shift_z = terrain->level_z[level - 1] / 2 - terrain->level_z[level] - m;
+	
+	*trim_z = (vec3_t){ (float32_t)(shift_x ? m : 3 * m + 1), (float32_t)m, (float32_t)level };
+	*trim_x = (vec3_t){ (float32_t)(m + shift_x), (float32_t)(shift_z ? m : 3 * m + 1), (float32_t)level };
+}
+
+terrain_t terrain_create(float32_t *heights, uint32_t width, uint32_t height, terrain_params_t params) {
+	terrain_t terrain = { 0 };
+	params.levels = params.levels ? MIN(params.levels, TERRAIN_MAX_LEVELS) : 6;
+	params.block = params.block ? params.block : 16;
+	params.cell_size = params.cell_size > 0.0f ? params.cell_size : 1.0f;
+	params.texel_size = params.texel_size > 0.0f ? params.texel_size : 1.0f;
+	params.height_scale = params.height_scale != 0.0f ? params.height_scale : 1.0f;
+	terrain.params = params;
+	terrain.width = width;
+	terrain.height = height;
+	terrain.heights = malloc(MAX(width * height, 1) * sizeof(float32_t));
+	memcpy(terrain.heights, heights, width * height * sizeof(float32_t));
+	
+	int32_t old_vao = 0, old_buffer = 0, old_texture = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &old_buffer);
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &old_texture);
+	
+	terrain.heightmap = (texture_t){ 0, (int32_t)width, (int32_t)height, 1, { TEXTURE_FILTER_LINEAR, TEXTURE_FILTER_LINEAR, TEXTURE_WRAP_CLAMP_TO_EDGE, TEXTURE_WRAP_CLAMP_TO_EDGE, true } };
+	glGenTextures(1, &terrain.heightmap.id);
+	glBindTexture(GL_TEXTURE_2D, terrain.heightmap.id);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, heights);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, old_texture);
+	
+	// every mesh once, as cell corners in one buffer with absolute indices
+	uint32_t m = params.block, vertex_total = 0, index_total = 0;
+	for (uint32_t i = 0; i < TERRAIN_MESH_COUNT; ++i) {
+		uint32_t x, z;
+		_terrain_mesh_cells(m, i, &x, &z);
+		terrain.first_index[i] = index_total;
+		terrain.index_count[i] = x * z * 6;
+		vertex_total += (x + 1) * (z + 1);
+		index_total += x * z * 6;
+	}
+	
+	vec2_t *grid = malloc(vertex_total * sizeof(vec2_t));
+	uint32_t *indices = malloc(index_total * sizeof(uint32_t));
+	uint32_t vertex = 0, index = 0;
+	
+	for (uint32_t i = 0; i < TERRAIN_MESH_COUNT; ++i) {
+		uint32_t x, z, base = vertex;
+		_terrain_mesh_cells(m, i, &x, &z);
+		
+		for (uint32_t cz = 0; cz <= z; ++cz) {
+			for (uint32_t cx = 0; cx <= x; ++cx) {
+				grid[vertex++] = (vec2_t){ (float32_t)cx, (float32_t)cz };
+			}
+		}
+		
+		// counter clockwise seen from above
+		for (uint32_t cz = 0; cz < z; ++cz) {
+			for (uint32_t cx = 0; cx < x; ++cx) {
+				uint32_t a = base + cz * (x + 1) + cx, b = a + x + 1;
+				uint32_t quad[6] = { a, b, b + 1, a, b + 1, a + 1 };
+				memcpy(indices + index, quad, sizeof(quad));
+				index += 6;
+			}
+		}
+	}
+	
+	// instances are the offset of a mesh in cells of its level and the level. level 0 fills
+	// its inside too, with two trim columns through the middle, the others leave it to the level
+	// within them
+	uint32_t levels = params.levels;
+	int32_t n = (int32_t)m;
+	terrain.instance_count[TERRAIN_BLOCK] = 12 * levels + 4;
+	terrain.instance_count[TERRAIN_FIXUP_X] = 2 * levels + 2;
+	terrain.instance_count[TERRAIN_FIXUP_Z] = 2 * levels;
+	terrain.instance_count[TERRAIN_TRIM_X] = levels - 1;
+	terrain.instance_count[TERRAIN_TRIM_Z] = levels + 1;
+	
+	uint32_t instance_total = 0;
+	for (uint32_t i = 0; i < TERRAIN_MESH_COUNT; ++i) {
+		uint32_t x, z;
+		_terrain_mesh_cells(m, i, &x, &z);
+		terrain.first_instance[i] = instance_total;
+		instance_total += terrain.instance_count[i];
+		terrain.vertex_count += terrain.instance_count[i] * (x + 1) * (z + 1);
+	}
+	
+	vec3_t *instances = malloc(instance_total * sizeof(vec3_t));
+	vec3_t *blocks = instances + terrain.first_instance[TERRAIN_BLOCK];
+	vec3_t *fixup_x = instances + terrain.first_instance[TERRAIN_FIXUP_X];
+	vec3_t *fixup_z = instances + terrain.first_instance[TERRAIN_FIXUP_Z];
+	vec3_t *trim_z = instances + terrain.first_instance[TERRAIN_TRIM_Z];
+	const int32_t ring[4] = { 0, n, 2 * n + 2, 3 * n + 2 };
+	
+	for (uint32_t l = 0; l < levels; ++l) {
+		float32_t level = (float32_t)l;
+		for (uint32_t j = 0; j < 4; ++j) {
+			*blocks++ = (vec3_t){ (float32_t)ring[j], 0.0f, level };
+			*blocks++ = (vec3_t){ (float32_t)ring[j], (float32_t)(3 * n + 2), level };
+		}
+		for (uint32_t j = 1; j < 3; ++j) {
+			*blocks++ = (vec3_t){ 0.0f, (float32_t)ring[j], level };
+			*blocks++ = (vec3_t){ (float32_t)(3 * n + 2), (float32_t)ring[j], level };
+		}
+		
+		*fixup_x++ = (vec3_t){ 0.0f, (float32_t)(2 * n), level };
+		*fixup_x++ = (vec3_t){ (float32_t)(3 * n + 2), (float32_t)(2 * n), level };
+		*fixup_z++ = (vec3_t){ (float32_t)(2 * n), 0.0f, level };
+		*fixup_z++ = (vec3_t){ (float32_t)(2 * n), (float32_t)(3 * n + 2), level };
+	}
+	
+	for (uint32_t j = 1; j < 3; ++j) {
+		*blocks++ = (vec3_t){ (float32_t)ring[1], (float32_t)ring[j], 0.0f };
+		*blocks++ = (vec3_t){ (float32_t)ring[2], (float32_t)ring[j], 0.0f };
+		*fixup_x++ = (vec3_t){ (float32_t)ring[j], (float32_t)(2 * n), 0.0f };
+	}
+	trim_z[0] = (vec3_t){ (float32_t)(2 * n), (float32_t)n, 0.0f };
+	trim_z[levels] = (vec3_t){ (float32_t)(2 * n + 1), (float32_t)n, 0.0f };
+	
+	// the other trims are placed by terrain_update
+	for (uint32_t l = 1; l < levels; ++l) {
+		instances[terrain.first_instance[TERRAIN_TRIM_X] + l - 1] = (vec3_t){ (float32_t)n, (float32_t)n, (float32_t)l };
+		trim_z[l] = (vec3_t){ (float32_t)n, (float32_t)n, (float32_t)l };
+	}
+	
+	glGenVertexArrays(1, &terrain.vao);
+	glGenBuffers(1, &terrain.vbo);
+	glGenBuffers(1, &terrain.ebo);
+	glGenBuffers(1, &terrain.instance_vbo);
+	
+	glBindVertexArray(terrain.vao);
+	glBindBuffer(GL_ARRAY_BUFFER, terrain.vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertex_total * sizeof(vec2_t), grid, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(vec2_t), NULL);
+	glEnableVertexAttribArray(0);
+	
+	// the instance pointer moves to the first instance of every mesh in terrain_draw
+	glBindBuffer(GL_ARRAY_BUFFER, terrain.instance_vbo);
+	glBufferData(GL_ARRAY_BUFFER, instance_total * sizeof(vec3_t), instances, GL_DYNAMIC_DRAW);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), NULL);
+	glVertexAttribDivisor(1, 1);
+	glEnableVertexAttribArray(1);
+	
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terrain.ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_total * sizeof(uint32_t), indices, GL_STATIC_DRAW);
+	
+	glBindVertexArray(old_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, old_buffer);
+	
+	free(grid);
+	free(indices);
+	free(instances);
+	return terrain;
+}
+
+void terrain_delete(terrain_t *terrain) {
+	uint32_t buffers[3] = { terrain->vbo, terrain->ebo, terrain->instance_vbo };
+	glDeleteBuffers(3, buffers);
+	glDeleteVertexArrays(1, &terrain->vao);
+	glDeleteTextures(1, &terrain->heightmap.id);
+	
+	free(terrain->heights);
+	ZERO_MEMORY(terrain);
+}
+
+//
+// drawing
+//
+
+uint32_t terrain_update(terrain_t *terrain, vec3_t camera_pos) {
+	int32_t old_x[TERRAIN_MAX_LEVELS], old_z[TERRAIN_MAX_LEVELS];
+	memcpy(old_x, terrain->level_x, sizeof(old_x));
+	memcpy(old_z, terrain->level_z, sizeof(old_z));
+	
+	for (uint32_t l = 0; l < terrain->params.levels; ++l) {
+		float32_t spacing = terrain->params.cell_size * (float32_t)(1 << l);
+		terrain->level_x[l] = _terrain_snap(camera_pos.x, spacing, terrain->params.block);
+		terrain->level_z[l] = _terrain_snap(camera_pos.z, spacing, terrain->params.block);
+	}
+	
+	int32_t old_buffer = 0;
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &old_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, terrain->instance_vbo);
+	
+	// a level only moves its trims when the parity of the inner level relative to it flips
+	uint32_t updated = 0;
+	for (uint32_t l = 1; l < terrain->params.levels; ++l) {
+		int32_t shift_x = terrain->level_x[l - 1] / 2 - terrain->level_x[l];
+		int32_t shift_z = terrain->level_z[l - 1] / 2 - terrain->level_z[l];
+		if (terrain->placed && shift_x == old_x[l - 1] / 2 - old_x[l] && shift_z == old_z[l - 1] / 2 - old_z[l]) {
+			continue;
+		}
+		
+		vec3_t trim_x, trim_z;
+		_terrain_trims(terrain, l, &trim_x, &trim_z);
+		glBufferSubData(GL_ARRAY_BUFFER, (terrain->first_instance[TERRAIN_TRIM_X] + l - 1) * sizeof(vec3_t), sizeof(vec3_t), &trim_x);
+		glBufferSubData(GL_ARRAY_BUFFER, (terrain->first_instance[TERRAIN_TRIM_Z] + l) * sizeof(vec3_t), sizeof(vec3_t), &trim_z);
+		++updated;
+	}
+	
+	glBindBuffer(GL_ARRAY_BUFFER, old_buffer);
+	render_statistics_add((render_statistics_t){ .uploaded = updated * 2 * sizeof(vec3_t) });
+	terrain->placed = true;
+	return updated;
+}
+
+void terrain_draw(terrain_t *terrain, matrix_t view_projection, vec3_t light_dir) {
+	int32_t old_program = 0, old_vao = 0, old_buffer = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &old_program);
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &old_buffer);
+	
+	render_state_t old_state = render_state_get();
+	render_state_set((render_state_t){ .depth_testing = true, .blending = false, .face_culling = true, .wireframe = old_state.wireframe });
+	
+	int32_t origins[TERRAIN_MAX_LEVELS * 2];
+	for (uint32_t l = 0; l < terrain->params.levels; ++l) {
+		origins[l * 2 + 0] = terrain->level_x[l];
+		origins[l * 2 + 1] = terrain->level_z[l];
+	}
+	
+	shader_t shader = _terrain.shader;
+	shader_bind(shader);
+	texture_bind(&terrain->heightmap, 0);
+	shader_uniform_texture(shader, "heightmap", 0);
+	shader_uniform_matrix(shader, "view_projection", view_projection);
+	shader_uniform_vec3(shader, "light_dir", light_dir);
+	shader_uniform_vec2(shader, "map_origin", terrain->params.origin);
+	shader_uniform_vec2(shader, "map_size", (vec2_t){ (float32_t)terrain->width, (float32_t)terrain->height });
+	shader_uniform_float(shader, "texel_size", terrain->params.texel_size);
+	shader_uniform_float(shader, "height_scale", terrain->params.height_scale);
+	shader_uniform_float(shader, "cell_size", terrain->params.cell_size);
+	shader_uniform_int(shader, "block", (int32_t)terrain->params.block);
+	glUniform2iv(glGetUniformLocation(shader, "level_origin"), terrain->params.levels, origins);
+	
+	glBindVertexArray(terrain->vao);
+	glBindBuffer(GL_ARRAY_BUFFER, terrain->instance_vbo);
+	
+	for (uint32_t i = 0; i < TERRAIN_MESH_COUNT; ++i) {
+		if (!terrain->instance_count[i]) {
+			continue;
+		}
+		
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void *)(terrain->first_instance[i] * sizeof(vec3_t)));
+		glDrawElementsInstanced(GL_TRIANGLES, terrain->index_count[i], GL_UNSIGNED_INT, (void *)(terrain->first_index[i] * sizeof(uint32_t)), terrain->instance_count[i]);
+		
+		uint32_t x, z;
+		_terrain_mesh_cells(terrain->params.block, i, &x, &z);
+		render_statistics_add((render_statistics_t){
+			.draw_calls = 1,
+			.vertices = (x + 1) * (z + 1) * terrain->instance_count[i],
+			.indices = terrain->index_count[i] * terrain->instance_count[i]
+		});
+	}
+	
+	glBindVertexArray(old_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, old_buffer);
+	glUseProgram(old_program);
+	render_state_set(old_state);
+}
+
+float32_t terrain_height(terrain_t *terrain, float32_t x, float32_t z) {
+	float32_t u = (x - terrain->params.origin.x) / terrain->params.texel_size;
+	float32_t v = (z - terrain->params.origin.y) / terrain->params.texel_size;
+	CLAMP(u, 0.0f, (float32_t)(terrain->width - 1));
+	CLAMP(v, 0.0f, (float32_t)(terrain->height - 1));
+	uint32_t x0 = (uint32_t)u, z0 = (uint32_t)v;
+	uint32_t x1 = MIN(x0 + 1, terrain->width - 1), z1 = MIN(z0 + 1, terrain->height - 1);
+	float32_t fx = u - x0, fz = v - z0;
+	
+	float32_t *h = terrain->heights;
+	float32_t bottom = h[z0 * terrain->width + x0] * (1.0f - fx) + h[z0 * terrain->width + x1] * fx;
+	float32_t top = h[z1 * terrain->width + x0] * (1.0f - fx) + h[z1 * terrain->width + x1] * fx;
+	return (bottom * (1.0f - fz) + top * fz) * terrain->params.height_scale;
+}
@@ -0,0 +1,65 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include "base.h"
+#include "math.h"
+#include "render.h"
+
+//
+// terrain
+//
+
+#define TERRAIN_MAX_LEVELS 12
+
+// geometry clipmaps, every level is a square of 4 * block + 2 cells twice as coarse as the one
+// inside it. all levels draw the same few grid meshes, so the vertex count follows the params only
+typedef struct terrain_params {
+	uint32_t levels;                    // 0 picks 6
+	uint32_t block;                     // cells per block side, 0 picks 16
+	float32_t cell_size;                // world size of a cell of the finest level, 0 picks 1
+	float32_t texel_size;               // world size of a heightmap texel, 0 picks 1
+	float32_t height_scale;             // 0 picks 1
+	vec2_t origin;                      // world xz of the first heightmap texel
+} terrain_params_t;
+
+enum {
+	TERRAIN_BLOCK,                      // block by block cells
+	TERRAIN_FIXUP_X,                    // block by 2 cells, fills the gaps between blocks
+	TERRAIN_FIXUP_Z,
+	TERRAIN_TRIM_X,                     // 2 * block + 1 by 1 cells, the side of the inner level left open
+	TERRAIN_TRIM_Z,                     // 1 by 2 * block + 2 cells
+	TERRAIN_MESH_COUNT
+};
+
+typedef struct terrain {
+	terrain_params_t params;
+	uint32_t width, height;
+	float32_t *heights;                 // copy for terrain_height
+	texture_t heightmap;                // r32f with mipmaps, sampled by the vertex shader
+	
+	// the level origins in cells of their level, trims only move when the inner level changes parity
+	int32_t level_x[TERRAIN_MAX_LEVELS], level_z[TERRAIN_MAX_LEVELS];
+	bool8_t placed;
+	
+	uint32_t first_index[TERRAIN_MESH_COUNT], index_count[TERRAIN_MESH_COUNT];
+	uint32_t first_instance[TERRAIN_MESH_COUNT], instance_count[TERRAIN_MESH_COUNT];
+	uint32_t vertex_count;              // vertices drawn by terrain_draw
+	
+	uint32_t vao, vbo, ebo, instance_vbo;
+} terrain_t;
+
+void terrain_init();
+void terrain_close();
+
+// heights are width * height floats in rows of increasing z and are copied
+terrain_t terrain_create(float32_t *heights, uint32_t width, uint32_t height, terrain_params_t params);
+void terrain_delete(terrain_t *terrain);
+
+// centers the levels on the camera and returns how many of them rewrote their trim instances
+uint32_t terrain_update(terrain_t *terrain, vec3_t camera_pos);
+void terrain_draw(terrain_t *terrain, matrix_t view_projection, vec3_t light_dir);
+
+// bilinear height at world xz, clamped to the heightmap like the shader
+float32_t terrain_height(terrain_t *terrain, float32_t x, float32_t z);
+
+#endif // TERRAIN_H
@@ -0,0 +1,256 @@
+#include "base.h"
+#include "core.h"
+#include "math.h"
+#include "render.h"
+#include "tilemap.h"
+#include <glad.h>
+
+//
+// tilemap
+//
+
+#define TILEMAP_CHUNK_QUADS (TILEMAP_CHUNK_SIZE * TILEMAP_CHUNK_SIZE)
+
+global struct {
+	shader_t shader;
+	uint32_t ebo;                       // quad indices shared by every chunk
+	float32_t *vertices;                // build scratch, x y u v per corner
+	tilemap_statistics_t statistics;
+} _tilemap;
+
+const string_t _tilemap_source = "#ifdef VERTEX_SHADER\n\nlayout (location = 0) in vec2 position;\nlayout (location = 1) in vec2 uv;\n\nuniform mat4 view_projection;\n\nout vec2 tex_coord;\n\nvoid main() {\n	gl_Position = view_projection * vec4(position, 0.0, 1.0);\n	tex_coord = uv;\n}\n\n#else\n\nin vec2 tex_coord;\n\nuniform sampler2D tileset;\n\nout vec4 frag_color;\n\nvoid main() {\n	frag_color = texture(tileset, tex_coord);\n}\n\n#endif";
+
+internal void _tilemap_build(tilemap_t *map, uint32_t cx, uint32_t cy) {
+	tilemap_chunk_t *chunk = &map->chunks[cy * map->chunks_x + cx];
+	uint32_t x0 = cx * TILEMAP_CHUNK_SIZE, y0 = cy * TILEMAP_CHUNK_SIZE;
+	uint32_t x1 = MIN(x0 + TILEMAP_CHUNK_SIZE, map->width), y1 = MIN(y0 + TILEMAP_CHUNK_SIZE, map->height);
+	
+	// half a texel inset keeps neighbouring atlas cells from bleeding in
+	float32_t cell_u = 1.0f / map->columns, cell_v = 1.0f / map->rows;
+	float32_t inset_u = map->tileset && map->tileset->width ? 0.5f / map->tileset->width : 0.0f;
+	float32_t inset_v = map->tileset && map->tileset->height ? 0.5f / map->tileset->height : 0.0f;
+	
+	float32_t *v = _tilemap.vertices;
+	uint32_t quads = 0;
+	
+	for (uint32_t y = y0; y < y1; ++y) {
+		for (uint32_t x = x0; x < x1; ++x) {
+			tile_t tile = map->tiles[y * map->width + x];
+			if (!tile) {
+				continue;
+			}
+			
+			uint32_t cell = tile - 1u;
+			float32_t u0 = (cell % map->columns) * cell_u + inset_u;
+			float32_t u1 = (cell % map->columns + 1) * cell_u - inset_u;
+			float32_t v1 = 1.0f - (cell / map->columns) * cell_v - inset_v;
+			float32_t v0 = 1.0f - (cell / map->columns + 1) * cell_v + inset_v;
+			
+			float32_t px0 = map->origin.x + x * map->tile_size, px1 = px0 + map->tile_size;
+			float32_t py0 = map->origin.y + y * map->tile_size, py1 = py0 + map->tile_size;
+			
+			float32_t quad[16] = {
+				px0, py0, u0, v0,
+				px1, py0, u1, v0,
+				px1, py1, u1, v1,
+				px0, py1, u0, v1
+			};
+			
+			memcpy(v, quad, sizeof(quad));
+			v += 16;
+			++quads;
+		}
+	}
+	
+	if (!chunk->vao && quads) {
+		glGenVertexArrays(1, &chunk->vao);
+		glBindVertexArray(chunk->vao);
+		glGenBuffers(1, &chunk->vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, chunk->vbo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _tilemap.ebo);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float32_t), (void *)0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float32_t), (void *)(2 * sizeof(float32_t)));
+		glEnableVertexAttribArray(1);
+	}
+	
+	if (chunk->vbo) {
+		glBindBuffer(GL_ARRAY_BUFFER, chunk->vbo);
+		glBufferData(GL_ARRAY_BUFFER, quads * 16 * sizeof(float32_t), _tilemap.vertices, GL_STATIC_DRAW);
+		render_statistics_add((render_statistics_t){ .uploaded = quads * 16 * sizeof(float32_t) });
+	}
+	
+	chunk->quad_count = quads;
+	chunk->dirty = false;
+	++_tilemap.statistics.chunks_built;
+}
+
+void tilemap_init() {
+	_tilemap.shader = shader_create(_tilemap_source);
+	_tilemap.vertices = malloc(TILEMAP_CHUNK_QUADS * 16 * sizeof(float32_t));
+	
+	uint16_t *indices = malloc(TILEMAP_CHUNK_QUADS * 6 * sizeof(uint16_t));
+	for (uint32_t i = 0; i < TILEMAP_CHUNK_QUADS; ++i) {
+		uint16_t base = (uint16_t)(i * 4);
+		uint16_t quad[6] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+		memcpy(indices + i * 6, quad, sizeof(quad));
+	}
+	
+	// element buffers belong to a vao, keep the renderer's from picking this one up
+	int32_t old_vao = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+	glBindVertexArray(0);
+	
+	glGenBuffers(1, &_tilemap.ebo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _tilemap.ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, TILEMAP_CHUNK_QUADS * 6 * sizeof(uint16_t), indices, GL_STATIC_DRAW);
+	glBindVertexArray(old_vao);
+	
+	free(indices);
+}
+
+void tilemap_close() {
+	shader_delete(_tilemap.shader);
+	glDeleteBuffers(1, &_tilemap.ebo);
+	free(_tilemap.vertices);
+	ZERO_MEMORY(&_tilemap);
+}
+
+tilemap_t tilemap_create(uint32_t width, uint32_t height, float32_t tile_size, texture_t *tileset, uint32_t columns, uint32_t rows) {
+	if (!width || !height || !columns || !rows) {
+		os_message(OS_MESSAGE_ERROR, "Tilemap needs a size and an atlas layout");
+		return ZERO_STRUCT(tilemap_t);
+	}
+	
+	tilemap_t map = { 0 };
+	map.width = width;
+	map.height = height;
+	map.chunks_x = (width + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE;
+	map.chunks_y = (height + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE;
+	map.tile_size = tile_size;
+	map.tileset = tileset;
+	map.columns = columns;
+	map.rows = rows;
+	map.tiles = calloc((size_t)width * height, sizeof(tile_t));
+	
+	// chunks get their buffers the first time they are drawn with tiles in them
+	map.chunks = calloc(map.chunks_x * map.chunks_y, sizeof(tilemap_chunk_t));
+	for (uint32_t i = 0; i < map.chunks_x * map.chunks_y; ++i) {
+		map.chunks[i].dirty = true;
+	}
+	
+	return map;
+}
+
+void tilemap_delete(tilemap_t *map) {
+	for (uint32_t i = 0; i < map->chunks_x * map->chunks_y; ++i) {
+		if (map->chunks[i].vao) {
+			glDeleteVertexArrays(1, &map->chunks[i].vao);
+			glDeleteBuffers(1, &map->chunks[i].vbo);
+		}
+	}
+	
+	free(map->tiles);
+	free(map->chunks);
+	ZERO_MEMORY(map);
+}
+
+void tilemap_set(tilemap_t *map, uint32_t x, uint32_t y, tile_t tile) {
+	if (x >= map->width || y >= map->height) {
+		return;
+	}
+	
+	tile_t *t = &map->tiles[y * map->width + x];
+	if (*t != tile) {
+		*t = tile;
+		map->chunks[(y / TILEMAP_CHUNK_SIZE) * map->chunks_x + x / TILEMAP_CHUNK_SIZE].dirty = true;
+	}
+}
+
+tile_t tilemap_get(tilemap_t *map, uint32_t x, uint32_t y) {
+	if (x >= map->width || y >= map->height) {
+		return 0;
+	}
+	
+	return map->tiles[y * map->width + x];
+}
+
+void tilemap_fill(tilemap_t *map, uint32_t x, uint32_t y, uint32_t width, uint32_t height, tile_t tile) {
+	uint32_t x1 = MIN(x + width, map->width), y1 = MIN(y + height, map->height);
+	if (x >= x1 || y >= y1) {
+		return;
+	}
+	
+	for (uint32_t ty = y; ty < y1; ++ty) {
+		for (uint32_t tx = x; tx < x1; ++tx) {
+			map->tiles[ty * map->width + tx] = tile;
+		}
+	}
+	
+	for (uint32_t cy = y / TILEMAP_CHUNK_SIZE; cy <= (y1 - 1) / TILEMAP_CHUNK_SIZE; ++cy) {
+		for (uint32_t cx = x / TILEMAP_CHUNK_SIZE; cx <= (x1 - 1) / TILEMAP_CHUNK_SIZE; ++cx) {
+			map->chunks[cy * map->chunks_x + cx].dirty = true;
+		}
+	}
+}
+
+void tilemap_draw(tilemap_t *map, range2_t visible, matrix_t view_projection) {
+	if (!map->chunks || map->tile_size <= 0.0f) {
+		return;
+	}
+	
+	// visible rect to an inclusive chunk range, clamped to the map
+	float32_t chunk_extent = map->tile_size * TILEMAP_CHUNK_SIZE;
+	float32_t fx0 = floorf((visible.min.x - map->origin.x) / chunk_extent);
+	float32_t fy0 = floorf((visible.min.y - map->origin.y) / chunk_extent);
+	float32_t fx1 = floorf((visible.max.x - map->origin.x) / chunk_extent);
+	float32_t fy1 = floorf((visible.max.y - map->origin.y) / chunk_extent);
+	
+	if (fx1 < 0.0f || fy1 < 0.0f || fx0 >= (float32_t)map->chunks_x || fy0 >= (float32_t)map->chunks_y) {
+		return;
+	}
+	
+	uint32_t cx0 = (uint32_t)MAX(fx0, 0.0f), cy0 = (uint32_t)MAX(fy0, 0.0f);
+	uint32_t cx1 = (uint32_t)MIN(fx1, (float32_t)(map->chunks_x - 1)), cy1 = (uint32_t)MIN(fy1, (float32_t)(map->chunks_y - 1));
+	
+	int32_t old_program = 0, old_vao = 0, old_buffer = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &old_program);
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &old_vao);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &old_buffer);
+	
+	shader_bind(_tilemap.shader);
+	shader_uniform_matrix(_tilemap.shader, "view_projection", view_projection);
+	shader_uniform_texture(_tilemap.shader, "tileset", 0);
+	if (map->tileset) {
+		texture_bind(map->tileset, 0);
+	}
+	
+	for (uint32_t cy = cy0; cy <= cy1; ++cy) {
+		for (uint32_t cx = cx0; cx <= cx1; ++cx) {
+			tilemap_chunk_t *chunk = &map->chunks[cy * map->chunks_x + cx];
+			if (chunk->dirty) {
+				_tilemap_build(map, cx, cy);
+			}
+			
+			if (!chunk->quad_count) {
+				continue;
+			}
+			
+			glBindVertexArray(chunk->vao);
+			glDrawElements(GL_TRIANGLES, chunk->quad_count * 6, GL_UNSIGNED_SHORT, NULL);
+			render_statistics_add((render_statistics_t){ .draw_calls = 1, .vertices = chunk->quad_count * 4, .indices = chunk->quad_count * 6 });
+			++_tilemap.statistics.chunks_drawn;
+			_tilemap.statistics.quads += chunk->quad_count;
+		}
+	}
+	
+	glBindVertexArray(old_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, old_buffer);
+	glUseProgram(old_program);
+}
+
+tilemap_statistics_t tilemap_statistics_get() {
+	tilemap_statistics_t statistics = _tilemap.statistics;
+	ZERO_MEMORY(&_tilemap.statistics);
+	return statistics;
+}
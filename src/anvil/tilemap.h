@@ -0,0 +1,56 @@
+#ifndef TILEMAP_H
+#define TILEMAP_H
+
+#include "base.h"
+#include "math.h"
+#include "render.h"
+
+//
+// tilemap
+//
+
+// tiles per chunk side, a chunk is baked into one vertex buffer and drawn with one call
+#define TILEMAP_CHUNK_SIZE 32
+
+// 0 is empty, n is atlas cell n - 1 counted left to right from the top left
+typedef uint16_t tile_t;
+
+typedef struct tilemap_chunk {
+	uint32_t vao, vbo;
+	uint32_t quad_count;
+	bool8_t dirty;
+} tilemap_chunk_t;
+
+typedef struct tilemap {
+	uint32_t width, height;             // tiles, tile (0, 0) is the bottom left one
+	uint32_t chunks_x, chunks_y;
+	float32_t tile_size;                // world units
+	vec2_t origin;
+	texture_t *tileset;
+	uint32_t columns, rows;             // atlas cells
+	tile_t *tiles;
+	tilemap_chunk_t *chunks;
+} tilemap_t;
+
+typedef struct tilemap_statistics {
+	uint32_t chunks_drawn, chunks_built, quads;
+} tilemap_statistics_t;
+
+void tilemap_init();
+void tilemap_close();
+
+tilemap_t tilemap_create(uint32_t width, uint32_t height, float32_t tile_size, texture_t *tileset, uint32_t columns, uint32_t rows);
+void tilemap_delete(tilemap_t *map);
+
+// edits only mark the chunk dirty, it is rebuilt the next time it is drawn
+void tilemap_set(tilemap_t *map, uint32_t x, uint32_t y, tile_t tile);
+tile_t tilemap_get(tilemap_t *map, uint32_t x, uint32_t y);
+void tilemap_fill(tilemap_t *map, uint32_t x, uint32_t y, uint32_t width, uint32_t height, tile_t tile);
+
+// draws the chunks overlapping the visible world rect, view_projection maps world to clip space
+void tilemap_draw(tilemap_t *map, range2_t visible, matrix_t view_projection);
+
+// counts since the last call
+tilemap_statistics_t tilemap_statistics_get();
+
+#endif // TILEMAP_H
@@ -0,0 +1,942 @@
+#include "../anvil/anvil.h"
+
+//
+// anvil_bench
+//
+// renders a parameterized stress scene for a fixed number of frames with a fixed dt and
+// prints one csv row of frame time percentiles, draw calls, upload bytes and gpu pass times.
+// with --anim it instead samples and blends compressed clips for n characters and prints
+// clip memory, compression error and sampling throughput. --prepass 1 lays down the depth of the
+// static and dynamic geometry first and shades it with an equal depth test, the fragments and
+// overdraw columns count the fragments the default shader ran for. --foliage n scatters n
+// instances that are frustum and distance culled every frame, on the cpu or with compute shaders.
+// --resolution ms renders the scene through dynamic resolution with that frame budget, the scene
+// pass is then timed by the resolution module and the scale and scene size are averaged.
+// --post 1 runs the frame as a render graph, the scene goes to transient hdr and depth targets
+// from the framebuffer pool, then through bloom, tonemapping and fxaa to the window.
+// --meshlets n draws n clustered spheres, culled per meshlet against the frustum and their normal
+// cones with --meshlet_cull 1, or each in one draw of every cluster with 0.
+// --image saves the last frame, --golden compares it against a saved one instead and exits with
+// a failure when any pixel is off by more than --tolerance in a channel.
+//
+// anvil_bench [--name s] [--static n] [--dynamic n] [--glyphs n] [--instanced n] [--shadows 0|1] [--prepass 0|1]
+//             [--foliage n] [--foliage_cull cpu|gpu] [--resolution ms] [--post 0|1]
+//             [--meshlets n] [--meshlet_cull 0|1]
+//             [--frames n] [--warmup n] [--width n] [--height n] [--window] [--csv path] [--image path]
+//             [--golden path] [--tolerance n] [--anim n]
+//
+
+#define BENCH_DT (1.0f / 60.0f)
+#define BENCH_QUADS_PER_BATCH 512 // 4 vertices and 6 indices each, fits the renderer's stream buffer
+#define BENCH_GLYPHS_PER_LINE 64
+#define BENCH_ANIM_JOINTS 64
+#define BENCH_ANIM_FRAMES 61 // two seconds at 30 hz
+#define BENCH_SPHERE_SLICES 128 // 16384 triangles
+#define BENCH_SPHERE_RINGS 64
+
+typedef enum bench_pass {
+	BENCH_PASS_SHADOW,
+	BENCH_PASS_SCENE,
+	BENCH_PASS_UI,
+	BENCH_PASS_POST,
+	BENCH_PASS_COUNT
+} bench_pass_e;
+
+typedef struct bench_params {
+	string_t name, csv, image, golden;
+	uint32_t static_meshes, dynamic_quads, glyphs, instanced_cubes;
+	bool8_t shadows, prepass, post, window;
+	uint32_t frames, warmup;
+	uint16_t width, height;
+	uint32_t anim_characters;
+	uint32_t foliage;
+	foliage_cull_e foliage_cull;
+	float32_t resolution;
+	uint32_t meshlets;
+	bool8_t meshlet_cull;
+	uint8_t tolerance;
+} bench_params_t;
+
+typedef struct bench_result {
+	float64_t p50, p95, p99, mean;
+	float64_t draw_calls, vertices, uploaded;
+	float64_t gpu[BENCH_PASS_COUNT];
+	float64_t fragments, overdraw;
+	uint32_t foliage_visible;
+	bool8_t foliage_gpu;
+	float64_t scale, scene_width, scene_height;
+	graph_statistics_t graph;
+	float64_t clusters_visible, clusters_frustum, clusters_backface, cluster_ranges;
+	int64_t golden_different;                 // -1 when the golden image did not load or match in size
+} bench_result_t;
+
+global struct {
+	os_window_o *window;
+	os_event_t event;
+	shader_t shader, instanced_shader;
+	texture_t white;
+	shadow_map_t shadow;
+	mesh_t cube, quads;
+	matrix_t *xforms;
+	render_timer_t timers[BENCH_PASS_COUNT];
+	render_counter_t fragments;
+	render_statistics_t statistics, shadow_statistics;
+	foliage_t foliage;
+	meshlet_mesh_t sphere;
+	meshlet_draw_list_t meshlet_list;
+	matrix_t *sphere_xforms;
+	uint32_t clusters_visible, clusters_frustum, clusters_backface, cluster_ranges;
+	
+	// camera of the current frame
+	float32_t aspect;
+	matrix_t projection, view;
+	vec3_t eye, light_dir;
+	string_t line;
+} _bench;
+
+const string_t _bench_instanced_source = "#ifdef VERTEX_SHADER\n\nlayout (location = 0) in vec3 position;\nlayout (location = 3) in vec3 normal0;\n\nuniform mat4 projection;\nuniform mat4 view;\nuniform int side;\n\nout vec3 normal;\n\nvoid main() {\n	vec3 offset = vec3(gl_InstanceID % side, -2.0, gl_InstanceID / side) * 2.0 - vec3(side, 0.0, side);\n	normal = normal0;\n	gl_Position = projection * view * vec4(position + offset, 1.0);\n}\n\n#else\n\nin vec3 normal;\n\nout vec4 frag_color;\n\nvoid main() {\n	frag_color = vec4(vec3(0.2 + 0.8 * max(dot(normal, normalize(vec3(0.3, 1.0, 0.5))), 0.0)), 1.0);\n}\n\n#endif";
+
+//
+// scene
+//
+
+internal mesh_t bench_cube() {
+	mesh_t mesh = mesh_create(24, 36);
+	
+	vec3_t normals[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	for (uint32_t face = 0; face < 6; ++face) {
+		vec3_t n = normals[face];
+		vec3_t u = (vec3_t){ n.y != 0.0f ? 1.0f : 0.0f, 0.0f, n.y != 0.0f ? 0.0f : 1.0f };
+		u = (n.z != 0.0f) ? (vec3_t){ 1.0f, 0.0f, 0.0f } : u;
+		vec3_t v = cross3(n, u);
+		
+		for (uint32_t i = 0; i < 4; ++i) {
+			float32_t su = (i == 1 || i == 2) ? 0.5f : -0.5f;
+			float32_t sv = (i >= 2) ? 0.5f : -0.5f;
+			vec3_t p = add3(mul3(n, vec3_scalar(0.5f)), add3(mul3(u, vec3_scalar(su)), mul3(v, vec3_scalar(sv))));
+			mesh_push_vertex(&mesh, (vertex_t){ p, (vec2_t){ su + 0.5f, sv + 0.5f }, vec4_scalar(1.0f), n });
+		}
+		
+		uint32_t base = face * 4;
+		uint32_t indices[6] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+		mesh_push_indices(&mesh, indices, 6);
+	}
+	
+	return mesh;
+}
+
+internal mesh_t bench_sphere() {
+	mesh_t mesh = mesh_create((BENCH_SPHERE_SLICES + 1) * (BENCH_SPHERE_RINGS + 1), BENCH_SPHERE_SLICES * BENCH_SPHERE_RINGS * 6);
+	
+	for (uint32_t ring = 0; ring <= BENCH_SPHERE_RINGS; ++ring) {
+		for (uint32_t slice = 0; slice <= BENCH_SPHERE_SLICES; ++slice) {
+			float32_t theta = (float32_t)PI * ring / BENCH_SPHERE_RINGS;
+			float32_t phi = 2.0f * (float32_t)PI * slice / BENCH_SPHERE_SLICES;
+			vec3_t n = (vec3_t){ sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi) };
+			mesh_push_vertex(&mesh, (vertex_t){ n, (vec2_t){ (float32_t)slice / BENCH_SPHERE_SLICES, (float32_t)ring / BENCH_SPHERE_RINGS }, vec4_scalar(1.0f), n });
+		}
+	}
+	
+	for (uint32_t ring = 0; ring < BENCH_SPHERE_RINGS; ++ring) {
+		for (uint32_t slice = 0; slice < BENCH_SPHERE_SLICES; ++slice) {
+			uint32_t a = ring * (BENCH_SPHERE_SLICES + 1) + slice, b = a + BENCH_SPHERE_SLICES + 1;
+			uint32_t indices[6] = { a, a + 1, b, a + 1, b + 1, b };
+			mesh_push_indices(&mesh, indices, 6);
+		}
+	}
+	
+	return mesh;
+}
+
+internal uint32_t bench_side(uint32_t count) {
+	uint32_t side = 1;
+	while (side * side < count) {
+		++side;
+	}
+	
+	return side;
+}
+
+internal void bench_draw_static(shader_t shader, bench_params_t *params) {
+	for (uint32_t i = 0; i < params->static_meshes; ++i) {
+		shader_uniform_matrix(shader, "xform", _bench.xforms[i]);
+		mesh_draw(&_bench.cube);
+	}
+}
+
+internal void bench_draw_dynamic(shader_t shader, bench_params_t *params, float32_t time) {
+	uint32_t side = bench_side(params->dynamic_quads);
+	shader_uniform_matrix(shader, "xform", IDENTITY_MATRIX);
+	
+	// rebuilt and streamed every frame in batches that fit the stream buffer
+	for (uint32_t start = 0; start < params->dynamic_quads; start += BENCH_QUADS_PER_BATCH) {
+		uint32_t end = MIN(start + BENCH_QUADS_PER_BATCH, params->dynamic_quads);
+		mesh_clear(&_bench.quads);
+		
+		for (uint32_t i = start; i < end; ++i) {
+			float32_t x = (float32_t)(i % side) * 1.5f - side * 0.75f;
+			float32_t z = (float32_t)(i / side) * 1.5f - side * 0.75f;
+			float32_t y = 2.0f + sinf(time * 2.0f + i * 0.37f);
+			vec3_t n = (vec3_t){ 0.0f, 1.0f, 0.0f };
+			vec4_t c = (vec4_t){ 0.5f + 0.5f * sinf(i * 0.1f), 0.5f, 0.5f + 0.5f * cosf(i * 0.1f), 1.0f };
+			
+			uint32_t base = _bench.quads.curr_vertex;
+			mesh_push_vertex(&_bench.quads, (vertex_t){ (vec3_t){ x - 0.5f, y, z - 0.5f }, (vec2_t){ 0, 0 }, c, n });
+			mesh_push_vertex(&_bench.quads, (vertex_t){ (vec3_t){ x - 0.5f, y, z + 0.5f }, (vec2_t){ 0, 1 }, c, n });
+			mesh_push_vertex(&_bench.quads, (vertex_t){ (vec3_t){ x + 0.5f, y, z + 0.5f }, (vec2_t){ 1, 1 }, c, n });
+			mesh_push_vertex(&_bench.quads, (vertex_t){ (vec3_t){ x + 0.5f, y, z - 0.5f }, (vec2_t){ 1, 0 }, c, n });
+			
+			uint32_t indices[6] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+			mesh_push_indices(&_bench.quads, indices, 6);
+		}
+		
+		mesh_draw(&_bench.quads);
+	}
+}
+
+internal void bench_draw_glyphs(bench_params_t *params) {
+	float32_t y = _bench.event.height / 2 - 30.0f;
+	
+	for (uint32_t drawn = 0; drawn < params->glyphs; drawn += BENCH_GLYPHS_PER_LINE) {
+		uint32_t count = MIN(BENCH_GLYPHS_PER_LINE, params->glyphs - drawn);
+		_bench.line[count] = 0;
+		ui_text(_bench.line, (vec2_t){ -_bench.event.width / 2 + 10.0f, y }, 0.5f, UI_ANCHOR_LEFT);
+		_bench.line[count] = (count < BENCH_GLYPHS_PER_LINE) ? 'a' + (count % 26) : 0;
+		
+		y -= 14.0f;
+		if (y < -_bench.event.height / 2) {
+			y = _bench.event.height / 2 - 30.0f;
+		}
+	}
+}
+
+internal void bench_draw_meshlets(shader_t shader, bench_params_t *params, matrix_t view_projection, vec3_t eye) {
+	_bench.clusters_visible = _bench.clusters_frustum = _bench.clusters_backface = _bench.cluster_ranges = 0;
+	
+	for (uint32_t i = 0; i < params->meshlets; ++i) {
+		shader_uniform_matrix(shader, "xform", _bench.sphere_xforms[i]);
+		
+		if (!params->meshlet_cull) {
+			meshlet_draw_all(&_bench.sphere);
+			continue;
+		}
+		
+		meshlet_cull(&_bench.sphere, _bench.sphere_xforms[i], view_projection, eye, &_bench.meshlet_list);
+		meshlet_draw(&_bench.sphere, &_bench.meshlet_list);
+		
+		_bench.clusters_visible += _bench.meshlet_list.visible;
+		_bench.clusters_frustum += _bench.meshlet_list.frustum_culled;
+		_bench.clusters_backface += _bench.meshlet_list.backface_culled;
+		_bench.cluster_ranges += _bench.meshlet_list.range_count;
+	}
+}
+
+// shadow casters are registered once, the static cache makes this mostly dynamic-only work
+internal void bench_shadow(bench_params_t *params) {
+	_bench.shadow_statistics = ZERO_STRUCT(render_statistics_t);
+	if (!params->shadows) {
+		return;
+	}
+	
+	render_timer_begin(&_bench.timers[BENCH_PASS_SHADOW]);
+	shadow_map_update(&_bench.shadow, _bench.light_dir, _bench.view, 60.0f, _bench.aspect, 0.1f, 500.0f);
+	shadow_map_render(&_bench.shadow);
+	render_timer_end(&_bench.timers[BENCH_PASS_SHADOW]);
+	_bench.shadow_statistics = _bench.statistics;
+}
+
+internal void bench_scene(bench_params_t *params, float32_t time) {
+	float32_t aspect = _bench.aspect;
+	matrix_t projection = _bench.projection, view = _bench.view;
+	vec3_t eye = _bench.eye, light_dir = _bench.light_dir;
+	render_statistics_t shadow = _bench.shadow_statistics;
+	
+	// the resolution module times the scene itself and gl queries of one target do not nest
+	if (params->resolution > 0.0f) {
+		resolution_begin(_bench.event.width, _bench.event.height);
+	} else {
+		render_timer_begin(&_bench.timers[BENCH_PASS_SCENE]);
+	}
+	
+	// render_clear resets the statistics, the shadow draws are added back on top
+	render_clear((vec3_t){ 0.1f, 0.1f, 0.12f });
+	_bench.statistics.draw_calls += shadow.draw_calls;
+	_bench.statistics.vertices += shadow.vertices;
+	_bench.statistics.indices += shadow.indices;
+	_bench.statistics.queries += shadow.queries;
+	_bench.statistics.uploaded += shadow.uploaded;
+	render_state_set((render_state_t){ .depth_testing = true, .face_culling = true });
+	
+	light_clear();
+	light_push((light_t){ .type = LIGHT_DIRECTIONAL, .dir = light_dir, .color = vec3_scalar(0.8f), .intensity = 1.0f });
+	light_update(view, 60.0f, aspect, 0.1f, 500.0f);
+	
+	shader_bind(_bench.shader);
+	shader_uniform_matrix(_bench.shader, "projection", projection);
+	shader_uniform_matrix(_bench.shader, "view", view);
+	shader_uniform_vec3(_bench.shader, "view_pos", eye);
+	texture_bind(&_bench.white, 0);
+	shader_uniform_texture(_bench.shader, "texture0", 0);
+	light_bind(_bench.shader, 2);
+	
+	if (params->shadows) {
+		shadow_map_bind(&_bench.shadow, _bench.shader, 1);
+	} else {
+		shader_uniform_int(_bench.shader, "shadow_cascade_count", 0);
+		shader_uniform_texture(_bench.shader, "shadow_map", 1);
+	}
+	
+	// same draws twice, so the shading pass below only runs for the front-most fragments.
+	// the scene time includes this pass, compare it against a run without
+	if (params->prepass) {
+		shader_t depth = render_depth_shader();
+		shader_bind(depth);
+		shader_uniform_matrix(depth, "projection", projection);
+		shader_uniform_matrix(depth, "view", view);
+		
+		render_depth_mode(RENDER_DEPTH_PREPASS);
+		bench_draw_static(depth, params);
+		if (params->dynamic_quads) {
+			bench_draw_dynamic(depth, params, time);
+		}
+		
+		render_depth_mode(RENDER_DEPTH_EQUAL);
+		shader_bind(_bench.shader);
+	}
+	
+	render_counter_begin(&_bench.fragments);
+	bench_draw_static(_bench.shader, params);
+	if (params->dynamic_quads) {
+		bench_draw_dynamic(_bench.shader, params, time);
+	}
+	render_counter_end(&_bench.fragments);
+	render_depth_mode(RENDER_DEPTH_DEFAULT);
+	
+	if (params->foliage) {
+		foliage_cull(&_bench.foliage, matrix_mul(view, projection), eye, 80.0f, params->foliage_cull);
+		foliage_draw(&_bench.foliage, _bench.shader);
+	}
+	
+	if (params->meshlets) {
+		shader_bind(_bench.shader);
+		bench_draw_meshlets(_bench.shader, params, matrix_mul(view, projection), eye);
+	}
+	
+	if (params->instanced_cubes) {
+		uint32_t side = bench_side(params->instanced_cubes);
+		shader_bind(_bench.instanced_shader);
+		shader_uniform_matrix(_bench.instanced_shader, "projection", projection);
+		shader_uniform_matrix(_bench.instanced_shader, "view", view);
+		shader_uniform_int(_bench.instanced_shader, "side", side);
+		mesh_draw_instanced(&_bench.cube, params->instanced_cubes);
+	}
+	
+	if (params->resolution > 0.0f) {
+		resolution_end();
+	} else {
+		render_timer_end(&_bench.timers[BENCH_PASS_SCENE]);
+	}
+}
+
+internal void bench_ui(bench_params_t *params) {
+	render_timer_begin(&_bench.timers[BENCH_PASS_UI]);
+	if (params->glyphs) {
+		bench_draw_glyphs(params);
+	}
+	render_timer_end(&_bench.timers[BENCH_PASS_UI]);
+}
+
+//
+// graph
+//
+
+typedef struct bench_graph_pass {
+	bench_params_t *params;
+	float32_t time;
+	graph_resource_t hdr;
+} bench_graph_pass_t;
+
+internal void bench_shadow_pass(void *data) {
+	bench_graph_pass_t *pass = (bench_graph_pass_t *)data;
+	bench_shadow(pass->params);
+}
+
+internal void bench_scene_pass(void *data) {
+	bench_graph_pass_t *pass = (bench_graph_pass_t *)data;
+	bench_scene(pass->params, pass->time);
+}
+
+internal void bench_post_pass(void *data) {
+	bench_graph_pass_t *pass = (bench_graph_pass_t *)data;
+	texture_t hdr = graph_texture(pass->hdr);
+	
+	render_timer_begin(&_bench.timers[BENCH_PASS_POST]);
+	post_process(&hdr, NULL, (post_params_t){ .gamma = 2.2f, .bloom_levels = 5, .bloom_threshold = 1.0f, .bloom_knee = 0.5f, .bloom_intensity = 0.6f, .fxaa = true });
+	render_timer_end(&_bench.timers[BENCH_PASS_POST]);
+}
+
+internal void bench_ui_pass(void *data) {
+	bench_graph_pass_t *pass = (bench_graph_pass_t *)data;
+	bench_ui(pass->params);
+}
+
+// dynamic resolution brings its own depth, there the scene pass only writes the upscaled color
+internal void bench_graph(bench_params_t *params, float32_t time) {
+	static bench_graph_pass_t data;
+	data = (bench_graph_pass_t){ params, time, 0 };
+	
+	graph_begin(_bench.event.width, _bench.event.height);
+	graph_resource_t shadow = graph_import("shadow", NULL);
+	data.hdr = graph_create("hdr", (graph_texture_desc_t){ .format = FRAMEBUFFER_FORMAT_RGBA16F });
+	
+	graph_pass_t pass = graph_pass_add("shadow", GRAPH_PASS_NONE, bench_shadow_pass, &data);
+	graph_pass_write(pass, shadow, true);
+	
+	pass = graph_pass_add("scene", GRAPH_PASS_NONE, bench_scene_pass, &data);
+	graph_pass_read(pass, shadow);
+	graph_pass_write(pass, data.hdr, false);
+	if (params->resolution <= 0.0f) {
+		graph_pass_write(pass, graph_create("depth", (graph_texture_desc_t){ .format = FRAMEBUFFER_FORMAT_DEPTH24 }), false);
+	}
+	
+	pass = graph_pass_add("post", GRAPH_PASS_NONE, bench_post_pass, &data);
+	graph_pass_read(pass, data.hdr);
+	graph_pass_write(pass, graph_backbuffer(), false);
+	
+	pass = graph_pass_add("ui", GRAPH_PASS_NONE, bench_ui_pass, &data);
+	graph_pass_write(pass, graph_backbuffer(), false);
+	
+	graph_execute();
+}
+
+internal void bench_frame(bench_params_t *params, float32_t time) {
+	_bench.aspect = (float32_t)_bench.event.width / _bench.event.height;
+	_bench.projection = matrix_projection_perspective(60.0f, _bench.aspect, 0.1f, 500.0f);
+	_bench.eye = (vec3_t){ 0.0f, 25.0f, 50.0f };
+	_bench.view = xform_camera(_bench.eye, (vec3_t){ 25.0f, 0.0f, 0.0f });
+	_bench.light_dir = (vec3_t){ 1.0f, -2.0f, -1.0f };
+	_bench.statistics = ZERO_STRUCT(render_statistics_t);
+	
+	if (params->post) {
+		bench_graph(params, time);
+	} else {
+		bench_shadow(params);
+		bench_scene(params, time);
+		bench_ui(params);
+	}
+}
+
+//
+// run
+//
+
+internal int bench_compare(const void *a, const void *b) {
+	float64_t x = *(const float64_t *)a, y = *(const float64_t *)b;
+	return (x > y) - (x < y);
+}
+
+internal float64_t bench_percentile(float64_t *sorted, uint32_t count, float64_t p) {
+	uint32_t index = (uint32_t)(p * (count - 1) + 0.5);
+	return sorted[MIN(index, count - 1)];
+}
+
+internal int64_t bench_golden(bench_params_t *params, uint8_t *pixels) {
+	int32_t width, height;
+	uint8_t *golden = render_pixels_load(params->golden, &width, &height);
+	if (!golden) {
+		return -1;
+	}
+	
+	int64_t different = -1;
+	if (width == _bench.event.width && height == _bench.event.height) {
+		different = render_pixels_compare(pixels, golden, width * height, params->tolerance);
+	}
+	
+	free(golden);
+	return different;
+}
+
+internal bench_result_t bench_run(bench_params_t *params) {
+	bench_result_t result = { 0 };
+	float64_t *times = malloc(MAX(params->frames, 1) * sizeof(float64_t));
+	float64_t last = os_time(), scene_pixels = 0.0;
+	
+	// queries are read RENDER_TIMER_LATENCY frames late and the first frame's is not usable,
+	// the gpu columns would average in garbage or zeros with a shorter warmup
+	uint32_t warmup = MAX(params->warmup, RENDER_TIMER_LATENCY + 1);
+	
+	render_statistics_monitor(&_bench.statistics);
+	
+	for (uint32_t frame = 0; frame < warmup + params->frames; ++frame) {
+		os_event_pull(_bench.window, &_bench.event);
+		ui_event_push(&_bench.event);
+		
+		bench_frame(params, frame * BENCH_DT);
+		
+		// statistics are reset by the next frame, so read them before the swap
+		if (frame >= warmup) {
+			result.draw_calls += _bench.statistics.draw_calls;
+			result.vertices += _bench.statistics.vertices;
+			result.uploaded += (float64_t)_bench.statistics.uploaded;
+			
+			for (uint32_t pass = 0; pass < BENCH_PASS_COUNT; ++pass) {
+				result.gpu[pass] += _bench.timers[pass].time;
+			}
+			
+			result.fragments += (float64_t)_bench.fragments.samples;
+			
+			// overdraw is relative to the pixels the scene was actually rendered at
+			if (params->resolution > 0.0f) {
+				resolution_statistics_t resolution = resolution_statistics_get();
+				result.gpu[BENCH_PASS_SCENE] += resolution.gpu_time;
+				result.scale += resolution.scale;
+				result.scene_width += resolution.width;
+				result.scene_height += resolution.height;
+				scene_pixels += (float64_t)resolution.width * resolution.height;
+			} else {
+				scene_pixels += (float64_t)params->width * params->height;
+			}
+		}
+		
+		if (params->post) {
+			result.graph = graph_statistics_get();
+		}
+		
+		if (frame >= warmup) {
+			result.clusters_visible += _bench.clusters_visible;
+			result.clusters_frustum += _bench.clusters_frustum;
+			result.clusters_backface += _bench.clusters_backface;
+			result.cluster_ranges += _bench.cluster_ranges;
+		}
+		
+		// reading the visible instances back waits for the gpu, so only the last frame does
+		if (params->foliage && frame + 1 == warmup + params->frames) {
+			matrix_t *visible = malloc(params->foliage * sizeof(matrix_t));
+			result.foliage_visible = foliage_read(&_bench.foliage, visible);
+			result.foliage_gpu = _bench.foliage.gpu;
+			free(visible);
+		}
+		
+		// last frame as a golden image, fixed dt makes it deterministic
+		if ((params->image || params->golden) && frame + 1 == warmup + params->frames) {
+			uint8_t *pixels = malloc(_bench.event.width * _bench.event.height * 4);
+			render_read_pixels(0, 0, _bench.event.width, _bench.event.height, pixels);
+			
+			if (params->image) {
+				render_pixels_save(params->image, pixels, _bench.event.width, _bench.event.height);
+			}
+			
+			if (params->golden) {
+				result.golden_different = bench_golden(params, pixels);
+			}
+			
+			free(pixels);
+		}
+		
+		os_window_swap_buffers(_bench.window);
+		
+		float64_t now = os_time();
+		if (frame >= warmup) {
+			times[frame - warmup] = (now - last) * 1000.0;
+		}
+		last = now;
+	}
+	
+	render_statistics_stop();
+	
+	if (params->frames) {
+		for (uint32_t i = 0; i < params->frames; ++i) {
+			result.mean += times[i];
+		}
+		
+		qsort(times, params->frames, sizeof(float64_t), bench_compare);
+		result.p50 = bench_percentile(times, params->frames, 0.50);
+		result.p95 = bench_percentile(times, params->frames, 0.95);
+		result.p99 = bench_percentile(times, params->frames, 0.99);
+		result.mean /= params->frames;
+		result.draw_calls /= params->frames;
+		result.vertices /= params->frames;
+		result.uploaded /= params->frames;
+		result.fragments /= params->frames;
+		result.overdraw = scene_pixels > 0.0 ? result.fragments * params->frames / scene_pixels : 0.0;
+		result.scale /= params->frames;
+		result.scene_width /= params->frames;
+		result.scene_height /= params->frames;
+		result.clusters_visible /= params->frames;
+		result.clusters_frustum /= params->frames;
+		result.clusters_backface /= params->frames;
+		result.cluster_ranges /= params->frames;
+		
+		for (uint32_t pass = 0; pass < BENCH_PASS_COUNT; ++pass) {
+			result.gpu[pass] /= params->frames;
+		}
+	}
+	
+	free(times);
+	return result;
+}
+
+// appending to an existing csv keeps one header
+internal FILE *bench_open(bench_params_t *params, bool8_t *header) {
+	*header = true;
+	if (!params->csv) {
+		return stdout;
+	}
+	
+	FILE *existing = fopen(params->csv, "rb");
+	if (existing) {
+		*header = false;
+		fclose(existing);
+	}
+	
+	FILE *file = fopen(params->csv, "ab");
+	if (!file) {
+		os_message(OS_MESSAGE_ERROR, "Failed to open %s", params->csv);
+	}
+	
+	return file;
+}
+
+internal void bench_write(bench_params_t *params, bench_result_t *result) {
+	bool8_t header;
+	FILE *file = bench_open(params, &header);
+	if (!file) {
+		return;
+	}
+	
+	if (header) {
+		fprintf(file, "name,static,dynamic,glyphs,instanced,shadows,width,height,frames,p50_ms,p95_ms,p99_ms,mean_ms,draw_calls,vertices,bytes_uploaded,gpu_shadow_ms,gpu_scene_ms,gpu_ui_ms,prepass,fragments,overdraw,foliage,foliage_gpu,foliage_visible,resolution_ms,scale,scene_width,scene_height,post,gpu_post_ms,graph_passes,graph_resources,graph_textures,meshlets,meshlet_cull,clusters,clusters_visible,clusters_frustum,clusters_backface,cluster_ranges\n");
+	}
+	
+	fprintf(file, "%s,%u,%u,%u,%u,%d,%u,%u,%u,%.3f,%.3f,%.3f,%.3f,%.0f,%.0f,%.0f,%.3f,%.3f,%.3f,%d,%.0f,%.3f,%u,%d,%u,%.2f,%.3f,%.0f,%.0f,%d,%.3f,%u,%u,%u,%u,%d,%u,%.0f,%.0f,%.0f,%.0f\n",
+			params->name, params->static_meshes, params->dynamic_quads, params->glyphs, params->instanced_cubes, params->shadows,
+			params->width, params->height, params->frames,
+			result->p50, result->p95, result->p99, result->mean,
+			result->draw_calls, result->vertices, result->uploaded,
+			result->gpu[BENCH_PASS_SHADOW], result->gpu[BENCH_PASS_SCENE], result->gpu[BENCH_PASS_UI],
+			params->prepass, result->fragments, result->overdraw,
+			params->foliage, result->foliage_gpu, result->foliage_visible,
+			params->resolution, result->scale, result->scene_width, result->scene_height,
+			params->post, result->gpu[BENCH_PASS_POST], result->graph.passes, result->graph.resources, result->graph.textures,
+			params->meshlets, params->meshlet_cull, params->meshlets * _bench.sphere.meshlet_count,
+			result->clusters_visible, result->clusters_frustum, result->clusters_backface, result->cluster_ranges);
+	
+	if (file != stdout) {
+		fclose(file);
+	}
+}
+
+//
+// animation
+//
+
+// a swaying joint chain whose root also travels, phase makes a second clip to blend with
+internal joint_pose_t *bench_anim_frames(float32_t phase) {
+	joint_pose_t *frames = malloc(BENCH_ANIM_FRAMES * BENCH_ANIM_JOINTS * sizeof(joint_pose_t));
+	vec3_t axes[3] = { { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } };
+	
+	for (uint32_t f = 0; f < BENCH_ANIM_FRAMES; ++f) {
+		float32_t time = f / 30.0f;
+		
+		for (uint32_t j = 0; j < BENCH_ANIM_JOINTS; ++j) {
+			float32_t angle = 0.5f * sinf(time * (float32_t)PI + j * 0.3f + phase);
+			frames[f * BENCH_ANIM_JOINTS + j] = (joint_pose_t){
+				.pos = (vec3_t){ j ? 0.0f : sinf(time + phase), j ? 0.1f : 0.0f, 0.0f },
+				.rot = quat_axis_angle(axes[j % 3], angle),
+				.scale = vec3_scalar(1.0f)
+			};
+		}
+	}
+	
+	return frames;
+}
+
+internal void bench_anim(bench_params_t *params) {
+	anim_compress_params_t compress = { .sample_rate = 30.0f, .position_error = 0.0005f, .rotation_error = 0.001f, .scale_error = 0.0005f };
+	joint_pose_t *frames[2] = { bench_anim_frames(0.0f), bench_anim_frames(1.3f) };
+	anim_clip_t clips[2] = {
+		anim_clip_create(frames[0], BENCH_ANIM_FRAMES, BENCH_ANIM_JOINTS, compress),
+		anim_clip_create(frames[1], BENCH_ANIM_FRAMES, BENCH_ANIM_JOINTS, compress)
+	};
+	
+	// worst rotation error over every stored frame
+	float32_t max_error = 0.0f;
+	joint_pose_t pose[BENCH_ANIM_JOINTS];
+	for (uint32_t f = 0; f < BENCH_ANIM_FRAMES; ++f) {
+		anim_clip_sample(&clips[0], MIN(f / 30.0f, clips[0].duration * 0.99999f), pose);
+		
+		for (uint32_t j = 0; j < BENCH_ANIM_JOINTS; ++j) {
+			float32_t d = fabsf(dot4(pose[j].rot, frames[0][f * BENCH_ANIM_JOINTS + j].rot));
+			max_error = MAX(max_error, 2.0f * acosf(MIN(d, 1.0f)));
+		}
+	}
+	
+	uint32_t count = params->anim_characters;
+	anim_sample_t *samples = malloc(count * sizeof(anim_sample_t));
+	joint_pose_t *poses = malloc(count * BENCH_ANIM_JOINTS * sizeof(joint_pose_t));
+	float64_t *times = malloc(MAX(params->frames, 1) * sizeof(float64_t));
+	
+	for (uint32_t frame = 0; frame < params->warmup + params->frames; ++frame) {
+		for (uint32_t i = 0; i < count; ++i) {
+			float32_t time = frame * BENCH_DT + i * 0.01f;
+			samples[i] = (anim_sample_t){ &clips[0], &clips[1], time, time * 1.1f, 0.5f };
+		}
+		
+		float64_t start = os_time();
+		anim_sample_many(samples, count, BENCH_ANIM_JOINTS, poses);
+		if (frame >= params->warmup) {
+			times[frame - params->warmup] = (os_time() - start) * 1000.0;
+		}
+	}
+	
+	float64_t mean = 0.0;
+	for (uint32_t i = 0; i < params->frames; ++i) {
+		mean += times[i];
+	}
+	mean /= MAX(params->frames, 1);
+	qsort(times, params->frames, sizeof(float64_t), bench_compare);
+	
+	bool8_t header;
+	FILE *file = bench_open(params, &header);
+	if (file) {
+		if (header) {
+			fprintf(file, "name,characters,joints,clip_frames,raw_bytes,clip_bytes,ratio,max_rotation_error,p50_ms,p95_ms,mean_ms,joints_per_second\n");
+		}
+		
+		uint32_t raw = BENCH_ANIM_FRAMES * BENCH_ANIM_JOINTS * sizeof(joint_pose_t);
+		uint32_t size = anim_clip_size(&clips[0]);
+		fprintf(file, "%s,%u,%u,%u,%u,%u,%.2f,%.5f,%.3f,%.3f,%.3f,%.0f\n",
+				params->name, count, BENCH_ANIM_JOINTS, BENCH_ANIM_FRAMES, raw, size, (float64_t)raw / size, max_error,
+				params->frames ? bench_percentile(times, params->frames, 0.50) : 0.0,
+				params->frames ? bench_percentile(times, params->frames, 0.95) : 0.0,
+				mean, mean > 0.0 ? count * 2.0 * BENCH_ANIM_JOINTS / (mean / 1000.0) : 0.0);
+		
+		if (file != stdout) {
+			fclose(file);
+		}
+	}
+	
+	free(times);
+	free(poses);
+	free(samples);
+	free(frames[0]);
+	free(frames[1]);
+	anim_clip_delete(&clips[0]);
+	anim_clip_delete(&clips[1]);
+}
+
+internal bench_params_t bench_parse(int32_t argc, string_t *argv) {
+	bench_params_t params = {
+		.name = "default",
+		.static_meshes = 1000,
+		.dynamic_quads = 1000,
+		.glyphs = 1000,
+		.instanced_cubes = 10000,
+		.shadows = true,
+		.meshlet_cull = true,
+		.frames = 300,
+		.warmup = 30,
+		.width = 1280,
+		.height = 720
+	};
+	
+	for (int32_t i = 1; i < argc; ++i) {
+		string_t arg = argv[i];
+		string_t value = (i + 1 < argc) ? argv[i + 1] : "0";
+		
+		if (!strcmp(arg, "--window")) {
+			params.window = true;
+			continue;
+		}
+		
+		if      (!strcmp(arg, "--name"))      params.name = value;
+		else if (!strcmp(arg, "--csv"))       params.csv = value;
+		else if (!strcmp(arg, "--image"))     params.image = value;
+		else if (!strcmp(arg, "--golden"))    params.golden = value;
+		else if (!strcmp(arg, "--tolerance")) params.tolerance = (uint8_t)atoi(value);
+		else if (!strcmp(arg, "--static"))    params.static_meshes = atoi(value);
+		else if (!strcmp(arg, "--dynamic"))   params.dynamic_quads = atoi(value);
+		else if (!strcmp(arg, "--glyphs"))    params.glyphs = atoi(value);
+		else if (!strcmp(arg, "--instanced")) params.instanced_cubes = atoi(value);
+		else if (!strcmp(arg, "--shadows"))   params.shadows = atoi(value) != 0;
+		else if (!strcmp(arg, "--prepass"))   params.prepass = atoi(value) != 0;
+		else if (!strcmp(arg, "--frames"))    params.frames = atoi(value);
+		else if (!strcmp(arg, "--warmup"))    params.warmup = atoi(value);
+		else if (!strcmp(arg, "--width"))     params.width = atoi(value);
+		else if (!strcmp(arg, "--height"))    params.height = atoi(value);
+		else if (!strcmp(arg, "--anim"))      params.anim_characters = atoi(value);
+		else if (!strcmp(arg, "--foliage"))   params.foliage = atoi(value);
+		else if (!strcmp(arg, "--foliage_cull")) params.foliage_cull = !strcmp(value, "cpu") ? FOLIAGE_CULL_CPU : FOLIAGE_CULL_GPU;
+		else if (!strcmp(arg, "--resolution")) params.resolution = (float32_t)atof(value);
+		else if (!strcmp(arg, "--post"))      params.post = atoi(value) != 0;
+		else if (!strcmp(arg, "--meshlets"))  params.meshlets = atoi(value);
+		else if (!strcmp(arg, "--meshlet_cull")) params.meshlet_cull = atoi(value) != 0;
+		else {
+			fprintf(stderr, "unknown argument %s\n", arg);
+			continue;
+		}
+		
+		++i;
+	}
+	
+	return params;
+}
+
+int32_t main(int32_t argc, string_t *argv) {
+	bench_params_t params = bench_parse(argc, argv);
+	
+	// cpu only, no window or context needed
+	if (params.anim_characters) {
+		job_init(0);
+		bench_anim(&params);
+		job_close();
+		return EXIT_SUCCESS;
+	}
+	
+	// headless unless asked otherwise, so it runs on machines without a display
+	_bench.window = os_window_create("anvil_bench", params.width, params.height, 0, 0, params.window ? OS_WINDOW_CENTERED : OS_WINDOW_HEADLESS);
+	os_window_vsync(_bench.window, false);
+	os_event_pull(_bench.window, &_bench.event);
+	_bench.event.width = params.width;
+	_bench.event.height = params.height;
+	
+	render_init(&_bench.event);
+	ui_init();
+	job_init(0);
+	light_init();
+	foliage_init();
+	
+	if (params.post) {
+		graph_init();
+		post_init();
+	}
+	
+	if (params.resolution > 0.0f) {
+		resolution_init((resolution_params_t){ .target_time = params.resolution, .min_scale = 0.5f, .filter = RESOLUTION_FILTER_SHARPEN, .sharpness = 0.5f });
+	}
+	
+	ui_style_t style = ui_style_get();
+	if (!style.font) {
+		style.font = font_load("data/fonts/NotoSerif-Regular.ttf", 1024, 1024, ZERO_STRUCT(texture_params_t));
+		ui_style_set(style);
+	}
+	
+	_bench.shader = shader_load("data/shaders/default.glsl");
+	_bench.instanced_shader = shader_create(_bench_instanced_source);
+	_bench.cube = bench_cube();
+	_bench.quads = mesh_create(BENCH_QUADS_PER_BATCH * 4, BENCH_QUADS_PER_BATCH * 6);
+	_bench.line = string_create(BENCH_GLYPHS_PER_LINE + 1);
+	
+	for (uint32_t i = 0; i < BENCH_GLYPHS_PER_LINE; ++i) {
+		_bench.line[i] = 'a' + (i % 26);
+	}
+	_bench.line[BENCH_GLYPHS_PER_LINE] = 0;
+	
+	for (uint32_t pass = 0; pass < BENCH_PASS_COUNT; ++pass) {
+		_bench.timers[pass] = render_timer_create();
+	}
+	_bench.fragments = render_counter_create();
+	
+	// white texture so default.glsl samples something, ui_text rebinds slot 0 to the font
+	uint32_t white = 0xFFFFFFFF;
+	_bench.white = texture_create((uint8_t *)&white, 1, 1, 4, ZERO_STRUCT(texture_params_t));
+	
+	// static meshes on a grid, registered as cached shadow casters
+	uint32_t side = bench_side(params.static_meshes);
+	_bench.xforms = malloc(MAX(params.static_meshes, 1) * sizeof(matrix_t));
+	if (params.shadows) {
+		_bench.shadow = shadow_map_create((shadow_params_t){ .cascade_count = 3, .resolution = 2048, .max_distance = 150.0f });
+	}
+	
+	for (uint32_t i = 0; i < params.static_meshes; ++i) {
+		vec3_t pos = (vec3_t){ (float32_t)(i % side) * 2.0f - side, 0.0f, (float32_t)(i / side) * 2.0f - side };
+		_bench.xforms[i] = xform_translate(IDENTITY_MATRIX, pos);
+		
+		if (params.shadows) {
+			shadow_caster_add(&_bench.shadow, &_bench.cube, _bench.xforms[i], true);
+		}
+	}
+	
+	// foliage scattered with a fixed seed, rotated and scaled like vegetation would be
+	if (params.foliage) {
+		matrix_t *xforms = malloc(params.foliage * sizeof(matrix_t));
+		srand(1);
+		
+		for (uint32_t i = 0; i < params.foliage; ++i) {
+			float32_t scale = 0.5f + (rand() % 100) / 100.0f;
+			matrix_t xform = xform_scale(IDENTITY_MATRIX, vec3_scalar(scale));
+			xform = xform_rotate(xform, (vec3_t){ 0.0f, 1.0f, 0.0f }, (rand() % 628) / 100.0f);
+			xforms[i] = xform_translate(xform, (vec3_t){ (rand() % 4000) / 10.0f - 200.0f, 1.0f, (rand() % 4000) / 10.0f - 200.0f });
+		}
+		
+		_bench.foliage = foliage_create(&_bench.cube, xforms, params.foliage);
+		free(xforms);
+	}
+	
+	// spheres a little above the static grid, the clustering is part of the setup and not timed
+	if (params.meshlets) {
+		uint32_t spheres = bench_side(params.meshlets);
+		_bench.sphere = meshlet_mesh_build(bench_sphere());
+		_bench.sphere_xforms = malloc(params.meshlets * sizeof(matrix_t));
+		
+		for (uint32_t i = 0; i < params.meshlets; ++i) {
+			vec3_t pos = (vec3_t){ (float32_t)(i % spheres) * 4.0f - spheres * 2.0f, 3.0f, (float32_t)(i / spheres) * 4.0f - spheres * 2.0f };
+			_bench.sphere_xforms[i] = xform_translate(xform_scale(IDENTITY_MATRIX, vec3_scalar(1.5f)), pos);
+		}
+	}
+	
+	bench_result_t result = bench_run(&params);
+	bench_write(&params, &result);
+	
+	bool8_t passed = !params.golden || result.golden_different == 0;
+	if (result.golden_different < 0) {
+		fprintf(stderr, "golden image %s missing or not %ux%u\n", params.golden, params.width, params.height);
+	} else if (!passed) {
+		fprintf(stderr, "golden image %s differs in %lld pixels\n", params.golden, (long long)result.golden_different);
+	}
+	
+	// cleanup
+	for (uint32_t pass = 0; pass < BENCH_PASS_COUNT; ++pass) {
+		render_timer_delete(&_bench.timers[pass]);
+	}
+	render_counter_delete(&_bench.fragments);
+	
+	if (params.shadows) {
+		shadow_map_delete(&_bench.shadow);
+	}
+	
+	if (params.foliage) {
+		foliage_delete(&_bench.foliage);
+	}
+	
+	if (params.meshlets) {
+		meshlet_draw_list_delete(&_bench.meshlet_list);
+		meshlet_mesh_delete(&_bench.sphere);
+		free(_bench.sphere_xforms);
+	}
+	
+	texture_delete(&_bench.white);
+	free(_bench.xforms);
+	string_delete(_bench.line);
+	mesh_delete(&_bench.cube);
+	mesh_delete(&_bench.quads);
+	shader_delete(_bench.shader);
+	shader_delete(_bench.instanced_shader);
+	
+	if (params.resolution > 0.0f) {
+		resolution_close();
+	}
+	
+	if (params.post) {
+		post_close();
+		graph_close();
+	}
+	
+	foliage_close();
+	light_close();
+	job_close();
+	ui_close();
+	render_close();
+	os_window_delete(_bench.window);
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}